@@ -0,0 +1,119 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Memory for GEMM: per-thread packing buffers that are reused
+ * from one gebp call to the next, and operand matrices that can
+ * be backed by 2 MB transparent huge pages.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include "arena.h"
+#include "matrix_ops.h"
+
+/**
+ * One thread's packing buffers.
+ */
+typedef struct
+{
+    void* buffer[ARENA_SLOTS]; // Buffer per slot, NULL until first used
+    size_t bytes[ARENA_SLOTS]; // Capacity of each buffer
+    int registered; // 1 once arena_key holds this thread's arena
+} arena_t;
+
+static __thread arena_t arena; // The calling thread's buffers
+static pthread_key_t arena_key; // Frees the buffers of exiting threads
+static pthread_once_t arena_key_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Destructor of arena_key, run when a thread that used its arena exits.
+ */
+static void arena_exit(void* unused)
+{
+    arena_release();
+}
+
+/**
+ * Creates arena_key.
+ */
+static void arena_create_key(void)
+{
+    pthread_key_create(&arena_key, arena_exit);
+}
+
+/**
+ * Allocates bytes (a multiple of the alignment) aligned to PACK_ALIGNMENT,
+ * or to HUGE_PAGE_BYTES with the huge page advice when huge is set.
+ */
+static void* alloc_aligned(size_t bytes, int huge)
+{
+    void* p = aligned_alloc(huge ? HUGE_PAGE_BYTES : PACK_ALIGNMENT, bytes);
+
+#ifdef MADV_HUGEPAGE
+    // Advice only: the pages are still faulted in lazily, and ignored if THP is off
+    if (p != NULL && huge) 
+    {
+        madvise(p, bytes, MADV_HUGEPAGE);
+    }
+#endif
+    return p;
+}
+
+/**
+ * Rounds bytes up to the alignment alloc_aligned uses for it.
+ */
+static size_t round_bytes(size_t bytes, int huge)
+{
+    size_t align = huge ? HUGE_PAGE_BYTES : PACK_ALIGNMENT;
+    return (bytes + align - 1) / align * align;
+}
+
+void* arena_get(int slot, size_t bytes)
+{
+    arena_t* a = &arena;
+
+    if (bytes > a->bytes[slot]) 
+    {
+        // Register once so that the buffers are freed when this thread exits
+        if (!a->registered) 
+        {
+            pthread_once(&arena_key_once, arena_create_key);
+            pthread_setspecific(arena_key, a);
+            a->registered = 1;
+        }
+
+        int huge = bytes >= HUGE_PAGE_BYTES;
+        size_t capacity = round_bytes(bytes, huge);
+
+        free(a->buffer[slot]);
+        a->buffer[slot] = alloc_aligned(capacity, huge);
+        a->bytes[slot] = (a->buffer[slot] != NULL) ? capacity : 0;
+    }
+    return a->buffer[slot];
+}
+
+void arena_release(void)
+{
+    for (int slot = 0; slot < ARENA_SLOTS; slot++) 
+    {
+        free(arena.buffer[slot]);
+        arena.buffer[slot] = NULL;
+        arena.bytes[slot] = 0;
+    }
+}
+
+size_t arena_bytes(void)
+{
+    size_t total = 0;
+    for (int slot = 0; slot < ARENA_SLOTS; slot++) 
+    {
+        total += arena.bytes[slot];
+    }
+    return total;
+}
+
+void* alloc_matrix(size_t count, size_t size, int huge_pages)
+{
+    return alloc_aligned(round_bytes(count * size, huge_pages), huge_pages);
+}
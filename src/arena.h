@@ -0,0 +1,58 @@
+#ifndef ARENA_H
+#define ARENA_H
+#include <stddef.h>
+
+#define HUGE_PAGE_BYTES (2UL * 1024 * 1024) // Size of a transparent huge page on x86-64
+
+#define ARENA_PACK_A 0 // Slot of the packed block of A, one per thread of the team
+#define ARENA_PACK_B 1 // Slot of the packed panel of B, owned by the thread calling gebp
+#define ARENA_SLOTS 2 // Number of slots per thread
+
+/**
+ * ## Packing arena
+ *
+ * Every thread has one buffer per slot, kept from one call to the next, so
+ * that gebp stops calling the allocator (and faulting in fresh pages) on
+ * every invocation. This function returns the calling thread's buffer for a
+ * slot, grown to at least bytes if it is smaller. Buffers are aligned to
+ * PACK_ALIGNMENT bytes; buffers of HUGE_PAGE_BYTES or more are aligned to a
+ * huge page and advised to be backed by huge pages. The returned pointer
+ * stays valid until the same thread asks for more bytes in the same slot,
+ * calls arena_release, or exits.
+ *
+ * @param slot ARENA_PACK_A or ARENA_PACK_B
+ * @param bytes Bytes needed
+ * @return Pointer to the buffer, or NULL if it could not be grown.
+ */
+void* arena_get(int slot, size_t bytes);
+
+/**
+ * This function frees the calling thread's arena buffers. They are freed
+ * when the thread exits as well; this gives the memory back sooner, e.g.
+ * after a large product in a long running program.
+ */
+void arena_release(void);
+
+/**
+ * This function returns the bytes currently held by the calling thread's arena.
+ */
+size_t arena_bytes(void);
+
+/**
+ * This function allocates an operand matrix of count elements of size bytes,
+ * aligned to PACK_ALIGNMENT bytes. With huge_pages, the size is rounded up to
+ * whole huge pages, the buffer is aligned to one, and the kernel is asked
+ * with madvise(MADV_HUGEPAGE) to back it with 2 MB pages, so that strided
+ * walks over the matrix (the columns of B read by pack_B) miss the TLB 512
+ * times less often. Transparent huge pages must be set to "madvise" or
+ * "always" in /sys/kernel/mm/transparent_hugepage/enabled; otherwise the
+ * advice is ignored and the buffer is an ordinary one. Release it with free().
+ *
+ * @param count Number of elements
+ * @param size Bytes per element
+ * @param huge_pages 1 to ask for huge pages, 0 for 4 KB pages
+ * @return Pointer to the matrix, or NULL if the allocation failed.
+ */
+void* alloc_matrix(size_t count, size_t size, int huge_pages);
+
+#endif
@@ -0,0 +1,202 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Batched GEMM for many small products. Small operands are
+ * read in place by unpacked kernels specialized at compile
+ * time for common sizes; the batch is split across threads.
+ * Everything is column major.
+ */
+
+#include <stddef.h>
+#include <omp.h>
+#include "batch.h"
+#include "gemm.h"
+#include "matrix_ops.h"
+#include "tune.h"
+
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f,fma")))
+#define SMALL_COLS 4 // Columns of C accumulated at once, sharing the loads of A
+
+typedef double vec8_t __attribute__((vector_size(64), aligned(8), may_alias)); // AVX-512 register, unaligned
+typedef double vec4_t __attribute__((vector_size(32), aligned(8), may_alias)); // AVX2 register, unaligned
+typedef double vec2_t __attribute__((vector_size(16), aligned(8), may_alias)); // SSE2 register, unaligned
+
+/**
+ * An unpacked kernel: C = alpha * A * B + beta * C on operands read in place.
+ */
+typedef void (*small_kernel_fn)(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc);
+
+/**
+ * An unpacked kernel, the instruction set it needs, and the square
+ * size it is specialized for (0 for any M, N, K up to BATCH_SMALL_MAX).
+ */
+typedef struct
+{
+    const char* name; // Instruction set and size, e.g. "avx2 8x8x8"
+    int isa; // ISA_* level the kernel needs
+    int size; // M = N = K it is compiled for, 0 for any
+    small_kernel_fn kernel;
+} small_kernel_t;
+
+/**
+ * Scalar edge tile: merges an m x n block of A * B into C, for the
+ * rows (fewer than one vector) the vector tiles leave over.
+ */
+static inline __attribute__((always_inline)) void small_tile(int m, int n, int K, double alpha, const double* A, int lda, 
+                                                             const double* B, int ldb, double beta, double* C, int ldc)
+{
+    double ab[SMALL_COLS][8] = {{0}};
+
+    for (int k = 0; k < K; k++) 
+    {
+        for (int jj = 0; jj < n; jj++) 
+        {
+            for (int i = 0; i < m; i++) 
+            {
+                ab[jj][i] += A[(size_t)k * lda + i] * B[(size_t)jj * ldb + k];
+            }
+        }
+    }
+
+    for (int jj = 0; jj < n; jj++) 
+    {
+        for (int i = 0; i < m; i++) 
+        {
+            double* c = &C[(size_t)jj * ldc + i];
+            *c = alpha * ab[jj][i] + (beta == 0.0 ? 0.0 : beta * *c);
+        }
+    }
+}
+
+// The kernels, once per instruction set
+#define TARGET TARGET_AVX512
+#define ISA(name) name##_avx512
+#define VEC vec8_t
+#include "small_template.h"
+#undef TARGET
+#undef ISA
+#undef VEC
+
+#define TARGET TARGET_AVX2
+#define ISA(name) name##_avx2
+#define VEC vec4_t
+#include "small_template.h"
+#undef TARGET
+#undef ISA
+#undef VEC
+
+#define TARGET
+#define ISA(name) name##_scalar
+#define VEC vec2_t
+#include "small_template.h"
+#undef TARGET
+#undef ISA
+#undef VEC
+
+static const small_kernel_t small_kernels[] = {
+    {"avx512 4x4x4", ISA_AVX512, 4, small_4_avx512},
+    {"avx512 8x8x8", ISA_AVX512, 8, small_8_avx512},
+    {"avx512 16x16x16", ISA_AVX512, 16, small_16_avx512},
+    {"avx512 32x32x32", ISA_AVX512, 32, small_32_avx512},
+    {"avx512 64x64x64", ISA_AVX512, 64, small_64_avx512},
+    {"avx512 any", ISA_AVX512, 0, small_any_avx512},
+    {"avx2 4x4x4", ISA_AVX2, 4, small_4_avx2},
+    {"avx2 8x8x8", ISA_AVX2, 8, small_8_avx2},
+    {"avx2 16x16x16", ISA_AVX2, 16, small_16_avx2},
+    {"avx2 32x32x32", ISA_AVX2, 32, small_32_avx2},
+    {"avx2 64x64x64", ISA_AVX2, 64, small_64_avx2},
+    {"avx2 any", ISA_AVX2, 0, small_any_avx2},
+    {"scalar 4x4x4", ISA_SCALAR, 4, small_4_scalar},
+    {"scalar 8x8x8", ISA_SCALAR, 8, small_8_scalar},
+    {"scalar 16x16x16", ISA_SCALAR, 16, small_16_scalar},
+    {"scalar 32x32x32", ISA_SCALAR, 32, small_32_scalar},
+    {"scalar 64x64x64", ISA_SCALAR, 64, small_64_scalar},
+    {"scalar any", ISA_SCALAR, 0, small_any_scalar},
+};
+
+#define SMALL_KERNEL_COUNT (int)(sizeof(small_kernels) / sizeof(small_kernels[0]))
+
+/**
+ * Returns the unpacked kernel for an M x N x K product, or NULL when
+ * it is too large for them.
+ */
+static const small_kernel_t* find_small_kernel(int M, int N, int K)
+{
+    int isa = detect_isa();
+
+    if (M > BATCH_SMALL_MAX || N > BATCH_SMALL_MAX || K > BATCH_SMALL_MAX) 
+    {
+        return NULL;
+    }
+
+    // Per instruction set, the specialized sizes come before the one for any size
+    for (int i = 0; i < SMALL_KERNEL_COUNT; i++) 
+    {
+        const small_kernel_t* k = &small_kernels[i];
+        if (k->isa <= isa && (k->size == 0 || (k->size == M && k->size == N && k->size == K))) 
+        {
+            return k;
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Runs a batch given either as pointer arrays (A_list not NULL) or as
+ * strided matrices from A, B and C.
+ */
+static void run_batch(int M, int N, int K, double alpha, 
+                      const double* const* A_list, const double* A, int lda, long stride_a,
+                      const double* const* B_list, const double* B, int ldb, long stride_b, double beta, 
+                      double* const* C_list, double* C, int ldc, long stride_c,
+                      int batch_count, int num_threads)
+{
+    if (batch_count <= 0 || M <= 0 || N <= 0) 
+    {
+        return;
+    }
+
+    int threads = (num_threads > 0) ? num_threads : omp_get_max_threads();
+    const small_kernel_t* small = find_small_kernel(M, N, K);
+    blocking_t b;
+    if (small == NULL) 
+    {
+        b = dgemm_get_blocking();
+    }
+
+    #pragma omp parallel for schedule(static) num_threads(threads) if(threads > 1 && batch_count > 1)
+    for (int i = 0; i < batch_count; i++) 
+    {
+        const double* a = A_list ? A_list[i] : A + i * stride_a;
+        const double* bm = B_list ? B_list[i] : B + i * stride_b;
+        double* c = C_list ? C_list[i] : C + i * stride_c;
+
+        if (small != NULL) 
+        {
+            small->kernel(M, N, K, alpha, a, lda, bm, ldb, beta, c, ldc);
+        }
+        else 
+        {
+            gebp(M, N, K, alpha, a, lda, bm, ldb, beta, c, ldc, NULL, b.m_c, b.k_c, b.n_c, b.n_r, b.m_r, b.prefetch, 1, NULL);
+        }
+    }
+}
+
+void dgemm_batch(int M, int N, int K, double alpha, const double* const* A, int lda, const double* const* B, int ldb,
+                 double beta, double* const* C, int ldc, int batch_count, int num_threads)
+{
+    run_batch(M, N, K, alpha, A, NULL, lda, 0, B, NULL, ldb, 0, beta, C, NULL, ldc, 0, batch_count, num_threads);
+}
+
+void dgemm_batch_strided(int M, int N, int K, double alpha, const double* A, int lda, long stride_a,
+                         const double* B, int ldb, long stride_b, double beta, double* C, int ldc, long stride_c,
+                         int batch_count, int num_threads)
+{
+    run_batch(M, N, K, alpha, NULL, A, lda, stride_a, NULL, B, ldb, stride_b, beta, NULL, C, ldc, stride_c, batch_count, num_threads);
+}
+
+const char* batch_kernel_name(int M, int N, int K)
+{
+    const small_kernel_t* small = find_small_kernel(M, N, K);
+    return (small != NULL) ? small->name : "gebp";
+}
@@ -0,0 +1,74 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#define BATCH_SMALL_MAX 64 // Largest M, N and K run by the unpacked kernels
+
+/**
+ * ## Batched GEMM
+ *
+ * Computes C[i] = alpha * A[i] * B[i] + beta * C[i] for every i < batch_count,
+ * all products with the same M, N, K and leading dimensions, column-major and
+ * untransposed. Meant for many tiny products, where packing and the buffers
+ * gebp allocates per call cost more than the arithmetic: when M, N and K are
+ * at most BATCH_SMALL_MAX, the operands are read in place by an unpacked
+ * kernel, specialized at compile time for the square sizes 4, 8, 16, 32 and
+ * 64 and for the widest instruction set the CPU supports (see detect_isa).
+ * Larger products fall back to one single-threaded gebp each, with the
+ * blocking dgemm uses (see dgemm_get_blocking). The products are divided
+ * among the threads; within a batch the C matrices must not overlap. C is
+ * not read when beta is zero.
+ *
+ * @param M Rows of every A and C
+ * @param N Columns of every B and C
+ * @param K Columns of every A and rows of every B
+ * @param alpha Scale applied to A * B
+ * @param A Array of batch_count pointers to the A matrices
+ * @param lda Leading dimension of the A matrices
+ * @param B Array of batch_count pointers to the B matrices
+ * @param ldb Leading dimension of the B matrices
+ * @param beta Scale applied to the existing C
+ * @param C Array of batch_count pointers to the C matrices
+ * @param ldc Leading dimension of the C matrices
+ * @param batch_count Number of products
+ * @param num_threads Number of OpenMP threads, 0 for omp_get_max_threads()
+ */
+void dgemm_batch(int M, int N, int K, double alpha, const double* const* A, int lda, const double* const* B, int ldb,
+                 double beta, double* const* C, int ldc, int batch_count, int num_threads);
+
+/**
+ * Strided form of dgemm_batch: the i-th matrices start at A + i * stride_a,
+ * B + i * stride_b and C + i * stride_c.
+ *
+ * @param M Rows of every A and C
+ * @param N Columns of every B and C
+ * @param K Columns of every A and rows of every B
+ * @param alpha Scale applied to A * B
+ * @param A First A matrix
+ * @param lda Leading dimension of the A matrices
+ * @param stride_a Distance in doubles between consecutive A matrices
+ * @param B First B matrix
+ * @param ldb Leading dimension of the B matrices
+ * @param stride_b Distance in doubles between consecutive B matrices
+ * @param beta Scale applied to the existing C
+ * @param C First C matrix
+ * @param ldc Leading dimension of the C matrices
+ * @param stride_c Distance in doubles between consecutive C matrices
+ * @param batch_count Number of products
+ * @param num_threads Number of OpenMP threads, 0 for omp_get_max_threads()
+ */
+void dgemm_batch_strided(int M, int N, int K, double alpha, const double* A, int lda, long stride_a,
+                         const double* B, int ldb, long stride_b, double beta, double* C, int ldc, long stride_c,
+                         int batch_count, int num_threads);
+
+/**
+ * This function returns the name of the kernel dgemm_batch uses for an
+ * M x N x K product, e.g. "avx512 16x16x16", "avx2 any" or "gebp".
+ *
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A and rows of B
+ * @return Pointer to a static string.
+ */
+const char* batch_kernel_name(int M, int N, int K);
+
+#endif
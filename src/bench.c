@@ -0,0 +1,253 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Benchmark harness shared by gotovan and matmulp: command
+ * line options, warmup and repeated runs, cache flushing,
+ * thread pinning and run time statistics.
+ */
+
+#include <getopt.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "bench.h"
+#include "gemm.h"
+#include "matrix_ops.h"
+#include "tune.h"
+
+#define FLUSH_MIN_BYTES (64L << 20) // Smallest flush buffer
+#define FLUSH_MAX_BYTES (512L << 20) // Largest flush buffer
+
+/**
+ * Prints the usage of the shared options.
+ */
+static void print_usage(const char* program, const char* default_output, int default_size)
+{
+    fprintf(stderr, "Usage: %s [options]\n", program);
+    fprintf(stderr, "  -n, --sizes N[,N...]  matrix dimensions (default %d)\n", default_size);
+    fprintf(stderr, "  -r, --reps R          timed repetitions (default 5)\n");
+    fprintf(stderr, "  -w, --warmup W        untimed warmup runs (default 1)\n");
+    fprintf(stderr, "  -t, --threads T       threads (default all CPUs)\n");
+    fprintf(stderr, "  -p, --pin, --no-pin   pin threads to distinct CPUs (default on)\n");
+    fprintf(stderr, "  -f, --flush           flush the caches before every run\n");
+    fprintf(stderr, "  -H, --huge-pages      back the operand matrices with 2 MB pages\n");
+    fprintf(stderr, "  -O, --overlap         pack the next panel of B while computing on this one\n");
+    fprintf(stderr, "  -M, --memory MB       memory for the out-of-core tiles (default 256)\n");
+    fprintf(stderr, "  -T, --tables LIST     comma separated tables to run (default all)\n");
+    fprintf(stderr, "  -W, --wisdom          use the wisdom file blockings instead of tuning\n");
+    fprintf(stderr, "  -o, --output PATH     CSV file (default %s)\n", default_output);
+    fprintf(stderr, "  -d, --debug           print matrices\n");
+    fprintf(stderr, "  -h, --help            show this help\n");
+}
+
+/**
+ * Parses a comma separated list of positive sizes. Returns 0 on success.
+ */
+static int parse_sizes(const char* text, bench_options_t* opts)
+{
+    char* end;
+    opts->num_sizes = 0;
+
+    while (*text != '\0') 
+    {
+        long value = strtol(text, &end, 10);
+        if (end == text || value <= 0 || opts->num_sizes == BENCH_MAX_SIZES) 
+        {
+            return 1;
+        }
+        opts->sizes[opts->num_sizes++] = (int)value;
+
+        text = end;
+        if (*text == ',') 
+        {
+            text++;
+        }
+        else if (*text != '\0') 
+        {
+            return 1;
+        }
+    }
+    return opts->num_sizes == 0;
+}
+
+int bench_parse_args(int argc, char* argv[], bench_options_t* opts, const char* default_output, int default_size)
+{
+    static const struct option long_options[] = {
+        {"sizes", required_argument, NULL, 'n'},
+        {"reps", required_argument, NULL, 'r'},
+        {"warmup", required_argument, NULL, 'w'},
+        {"threads", required_argument, NULL, 't'},
+        {"pin", no_argument, NULL, 'p'},
+        {"no-pin", no_argument, NULL, 'P'},
+        {"flush", no_argument, NULL, 'f'},
+        {"huge-pages", no_argument, NULL, 'H'},
+        {"overlap", no_argument, NULL, 'O'},
+        {"memory", required_argument, NULL, 'M'},
+        {"tables", required_argument, NULL, 'T'},
+        {"wisdom", no_argument, NULL, 'W'},
+        {"output", required_argument, NULL, 'o'},
+        {"debug", no_argument, NULL, 'd'},
+        {"help", no_argument, NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    opts->sizes[0] = default_size;
+    opts->num_sizes = 1;
+    opts->reps = 5;
+    opts->warmup = 1;
+    opts->threads = omp_get_num_procs();
+    opts->pin = 1;
+    opts->flush = 0;
+    opts->huge_pages = 0;
+    opts->overlap = 0;
+    opts->debug = 0;
+    opts->memory = 256;
+    opts->tables = NULL;
+    opts->use_wisdom = 0;
+    opts->output = default_output;
+
+    int c;
+    int bad = 0;
+    while (!bad && (c = getopt_long(argc, argv, "n:r:w:t:pfHOM:T:Wo:dh", long_options, NULL)) != -1) 
+    {
+        switch (c) 
+        {
+            case 'n': bad = parse_sizes(optarg, opts); break;
+            case 'r': opts->reps = atoi(optarg); bad = opts->reps <= 0; break;
+            case 'w': opts->warmup = atoi(optarg); bad = opts->warmup < 0; break;
+            case 't': opts->threads = atoi(optarg); bad = opts->threads <= 0; break;
+            case 'p': opts->pin = 1; break;
+            case 'P': opts->pin = 0; break;
+            case 'f': opts->flush = 1; break;
+            case 'H': opts->huge_pages = 1; break;
+            case 'O': opts->overlap = 1; break;
+            case 'M': opts->memory = atoi(optarg); bad = opts->memory <= 0; break;
+            case 'T': opts->tables = optarg; break;
+            case 'W': opts->use_wisdom = 1; break;
+            case 'o': opts->output = optarg; break;
+            case 'd': opts->debug = 1; break;
+            default: bad = 1; break;
+        }
+    }
+
+    if (bad || optind < argc) 
+    {
+        print_usage(argv[0], default_output, default_size);
+        return 1;
+    }
+    return 0;
+}
+
+void bench_flush_cache(void)
+{
+    static double* buffer = NULL;
+    static long count = 0;
+    static volatile double sink = 0.0;
+
+    if (buffer == NULL) 
+    {
+        cache_info_t info;
+        read_cache_info(&info);
+
+        long bytes = 2L * info.l3.size;
+        if (bytes < FLUSH_MIN_BYTES) { bytes = FLUSH_MIN_BYTES; }
+        if (bytes > FLUSH_MAX_BYTES) { bytes = FLUSH_MAX_BYTES; }
+        count = bytes / sizeof(double);
+
+        buffer = (double*)calloc(count, sizeof(double));
+        if (buffer == NULL) 
+        {
+            return;
+        }
+    }
+
+    // Touch one double per cache line, reading and writing so dirty lines are evicted too
+    double sum = 0.0;
+    for (long i = 0; i < count; i += 8) 
+    {
+        buffer[i] += 1.0;
+        sum += buffer[i];
+    }
+    sink += sum;
+}
+
+void bench_pin_threads(int num_threads)
+{
+    #pragma omp parallel num_threads(num_threads)
+    gebp_place_thread(omp_get_thread_num());
+}
+
+int bench_compare_doubles(const void* a, const void* b)
+{
+    double x = *(const double*)a, y = *(const double*)b;
+    return (x > y) - (x < y);
+}
+
+bench_stats_t bench_run(const bench_options_t* opts, bench_fn fn, bench_fn reset, void* ctx)
+{
+    bench_stats_t stats = {0};
+    double* times = (double*)malloc(opts->reps * sizeof(double));
+    if (times == NULL) 
+    {
+        return stats;
+    }
+
+    for (int run = 0; run < opts->warmup + opts->reps; run++) 
+    {
+        if (reset != NULL) { reset(ctx); }
+        if (opts->flush) { bench_flush_cache(); }
+
+        double t0 = wall_time();
+        fn(ctx);
+        double t = wall_time() - t0;
+
+        if (run >= opts->warmup) 
+        {
+            times[run - opts->warmup] = t;
+        }
+    }
+
+    qsort(times, opts->reps, sizeof(double), bench_compare_doubles);
+
+    int n = opts->reps;
+    double sum = 0.0;
+    for (int i = 0; i < n; i++) 
+    {
+        sum += times[i];
+    }
+
+    stats.reps = n;
+    stats.min = times[0];
+    stats.median = (n % 2) ? times[n / 2] : 0.5 * (times[n / 2 - 1] + times[n / 2]);
+    stats.p95 = times[(int)ceil(0.95 * n) - 1];
+    stats.mean = sum / n;
+
+    for (int i = 0; i < n; i++) 
+    {
+        stats.variance += (times[i] - stats.mean) * (times[i] - stats.mean);
+    }
+    stats.variance = (n > 1) ? stats.variance / (n - 1) : 0.0;
+
+    free(times);
+    return stats;
+}
+
+void bench_fprint_stats(FILE* fp, const bench_stats_t* stats)
+{
+    fprintf(fp, "%f,%f,%f,%e", stats->min, stats->median, stats->p95, stats->variance);
+}
+
+void bench_output_path(const char* output, const char* suffix, char* path, size_t size)
+{
+    size_t len = strlen(output);
+
+    if (len >= 4 && strcmp(output + len - 4, ".csv") == 0) 
+    {
+        snprintf(path, size, "%.*s%s.csv", (int)(len - 4), output, suffix);
+    }
+    else 
+    {
+        snprintf(path, size, "%s%s", output, suffix);
+    }
+}
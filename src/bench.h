@@ -0,0 +1,128 @@
+#ifndef BENCH_H
+#define BENCH_H
+#include <stdio.h>
+
+#define BENCH_MAX_SIZES 32 // Longest size list accepted by -n
+#define BENCH_STATS_HEADER "min (seconds),median (seconds),p95 (seconds),variance" // CSV columns of bench_fprint_stats
+
+/**
+ * Command line options shared by the benchmark programs.
+ */
+typedef struct
+{
+    int sizes[BENCH_MAX_SIZES]; // Matrix dimensions to run
+    int num_sizes; // Entries used in sizes
+    int reps; // Timed repetitions per configuration
+    int warmup; // Untimed runs before the timed ones
+    int threads; // Threads for the parallel runs
+    int pin; // 1 to pin threads to distinct CPUs
+    int flush; // 1 to flush the caches before every run
+    int huge_pages; // 1 to put the operand matrices on huge pages (gotovan only)
+    int overlap; // 1 to pack the next panel of B while computing (gotovan only)
+    int debug; // 1 to print matrices (gotovan only)
+    int memory; // Megabytes for the tiles of the out-of-core product (gotoooc only)
+    const char* tables; // Comma separated tables to run, NULL for all (gotovan only)
+    int use_wisdom; // 1 to take the blockings from the wisdom file instead of tuning (gotovan only)
+    const char* output; // Path of the main CSV file
+} bench_options_t;
+
+/**
+ * Statistics of the timed repetitions of one configuration, in seconds.
+ */
+typedef struct
+{
+    double min; // Fastest run
+    double median; // Median run
+    double p95; // 95th percentile (nearest rank)
+    double mean; // Mean run
+    double variance; // Sample variance, 0 with a single run
+    int reps; // Number of timed runs
+} bench_stats_t;
+
+/**
+ * A piece of work for bench_run to time or to run untimed between reps.
+ */
+typedef void (*bench_fn)(void* ctx);
+
+/**
+ * This function parses the shared options:
+ *   -n, --sizes N[,N...]   matrix dimensions (default default_size)
+ *   -r, --reps R           timed repetitions (default 5)
+ *   -w, --warmup W         untimed warmup runs (default 1)
+ *   -t, --threads T        threads (default: all CPUs the process may use)
+ *   -p, --pin / --no-pin   pin threads to distinct CPUs (default on)
+ *   -f, --flush            flush the caches before every run
+ *   -H, --huge-pages       back the operand matrices with 2 MB pages
+ *   -O, --overlap          pack the next panel of B while computing on this one
+ *   -M, --memory MB        memory for the out-of-core tiles (default 256)
+ *   -T, --tables LIST      comma separated tables to run (default all)
+ *   -W, --wisdom           use the wisdom file blockings instead of tuning
+ *   -o, --output PATH      CSV path (default default_output)
+ *   -d, --debug            print matrices
+ *   -h, --help             print the usage
+ * The usage is printed on stderr for -h or a bad option.
+ *
+ * @param argc Argument count from main
+ * @param argv Arguments from main
+ * @param opts Receives the options
+ * @param default_output CSV path used without -o
+ * @param default_size Matrix dimension used without -n
+ * @return 0 to go on, 1 if the program should exit.
+ */
+int bench_parse_args(int argc, char* argv[], bench_options_t* opts, const char* default_output, int default_size);
+
+/**
+ * This function orders doubles ascending, for qsort of run times and latencies.
+ */
+int bench_compare_doubles(const void* a, const void* b);
+
+/**
+ * This function runs fn opts->warmup times untimed and opts->reps times
+ * timed. Before every run, reset (if not NULL) is called untimed and, with
+ * --flush, a buffer larger than the last level cache is swept so that the
+ * run starts with cold caches.
+ *
+ * @param opts Parsed options
+ * @param fn Work to time
+ * @param reset If not NULL, called untimed before every run
+ * @param ctx Passed to fn and reset
+ * @return Statistics of the timed runs.
+ */
+bench_stats_t bench_run(const bench_options_t* opts, bench_fn fn, bench_fn reset, void* ctx);
+
+/**
+ * This function evicts the caches by sweeping a buffer twice the size
+ * of the last level cache (at least 64 MB and at most 512 MB).
+ */
+void bench_flush_cache(void);
+
+/**
+ * This function pins the threads of the OpenMP pool to distinct CPUs,
+ * thread i to the i-th CPU the process may run on (see gebp_place_thread).
+ * Later parallel regions with the same thread count reuse the pinned threads.
+ *
+ * @param num_threads Threads in the pool
+ */
+void bench_pin_threads(int num_threads);
+
+/**
+ * This function writes the statistics as the BENCH_STATS_HEADER columns,
+ * without a leading or trailing separator.
+ *
+ * @param fp CSV file
+ * @param stats Statistics from bench_run
+ */
+void bench_fprint_stats(FILE* fp, const bench_stats_t* stats);
+
+/**
+ * Derives the path of an extra CSV from the main one by inserting a
+ * suffix before ".csv", e.g. out.csv and "_fringe" give out_fringe.csv.
+ *
+ * @param output Main CSV path
+ * @param suffix Text to insert
+ * @param path Receives the new path
+ * @param size Size of path
+ */
+void bench_output_path(const char* output, const char* suffix, char* path, size_t size);
+
+#endif
@@ -0,0 +1,208 @@
+/**
+ * The GEBP driver for one element type. gemm.c includes this
+ * file once per type, with:
+ *   ELEM  the element type (float, double or double complex)
+ *   FN    a macro adding the BLAS prefix to a function name
+ * There is deliberately no include guard.
+ */
+
+/**
+ * Packs this thread's share, every nthreads-th micro-panel, of the
+ * micro-panels of a k_b x n_b panel of B whose first column lies in [from, to).
+ */
+static void FN(pack_B_share)(ELEM* B_packed, const ELEM* B, int rsb, int csb, int k_b, int n_b, int n_r, int j_block, int k_block, 
+                             int tid, int nthreads, int from, int to)
+{
+    int stride = nthreads * n_r;
+    int j = tid * n_r;
+
+    if (from > j) 
+    {
+        j += (from - j + stride - 1) / stride * stride;
+    }
+    for (; j < n_b && j < to; j += stride) 
+    {
+        int n = (n_b - j < n_r) ? n_b - j : n_r;
+        FN(pack_B)(&B_packed[j * k_b], B, rsb, csb, k_b, n, n_r, j_block + j, k_block);
+    }
+}
+
+void FN(gebp_strided)(int M, int N, int K, ELEM alpha, const ELEM* A, int rsa, int csa, const ELEM* B, int rsb, int csb, ELEM beta, ELEM* C, int ldc, const epilogue_t* ep, int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time) 
+{
+    int m_c_used = (M < m_c) ? M : m_c; // blocks never exceed the matrices
+    int n_c_used = (N < n_c) ? N : n_c;
+    int k_c_used = (K < k_c) ? K : k_c;
+    int m_c_padded = (m_c_used + m_r - 1) / m_r * m_r; // A block rounded up to whole micro-panels
+    int n_c_padded = (n_c_used + n_r - 1) / n_r * n_r; // B panel rounded up to whole micro-panels
+    double t_pack = 0.0;
+
+    // With no k slices to apply beta on, C = beta * C
+    if (K <= 0) 
+    {
+        for (int j = 0; j < N; j++) 
+        {
+            for (int i = 0; i < M; i++) 
+            {
+                C[(size_t)j * ldc + i] = (beta == 0) ? 0 : beta * C[(size_t)j * ldc + i];
+            }
+        }
+        FN(apply_epilogue)(C, ldc, M, N, ep);
+        if (pack_time != NULL) { *pack_time = 0.0; }
+        return;
+    }
+
+    // With overlap, the next panel of B is packed into the second buffer while the first is in use
+    int overlap = gebp_overlap;
+    size_t panel = ((size_t)k_c_used * n_c_padded * sizeof(ELEM) + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+    char* B_buffers = (char*)arena_get(ARENA_PACK_B, overlap ? 2 * panel : panel); // Panels of B: k_c x n_c, shared
+    int pin = gebp_pinning && num_threads > 1 && !omp_in_parallel(); // single threaded calls are left where they are
+    int i_blocks = (M + m_c - 1) / m_c;
+
+    #pragma omp parallel num_threads(num_threads)
+    {
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+        if (pin) { gebp_place_thread(tid); }
+
+        ELEM* A_packed = (ELEM*)arena_get(ARENA_PACK_A, (size_t)m_c_padded * k_c_used * sizeof(ELEM)); // Block of A: m_c x k_c, per thread
+
+        // Each thread counts its own events, the totals are merged at the end
+        perf_counters_t pc = {.leader = -1};
+        long long last[PERF_EVENTS], pack[PERF_EVENTS] = {0}, compute[PERF_EVENTS] = {0};
+        if (gebp_counters != NULL && perf_counters_open(&pc) > 0) 
+        {
+            perf_counters_read(&pc, last);
+        }
+
+        // The i blocks are divided into contiguous ranges, as schedule(static) would
+        int first = (int)((long)i_blocks * tid / nthreads);
+        int last_block = (int)((long)i_blocks * (tid + 1) / nthreads);
+        int panel_index = 0;
+
+        // Loop over the panels of B: j in steps of n_c, and within them k in steps of k_c
+        for (int j_block = 0; j_block < N; j_block += n_c) 
+        {
+            int n_b = (N - j_block < n_c) ? N - j_block : n_c; // columns in this panel
+
+            for (int k_block = 0; k_block < K; k_block += k_c, panel_index++) 
+            {
+                int k_b = (K - k_block < k_c) ? K - k_block : k_c; // rows in this slice of B
+                ELEM beta_k = (k_block == 0) ? beta : 1; // later slices accumulate
+                int last_slice = (k_block + k_b >= K); // the epilogue goes with the final write of C
+                ELEM* B_packed = (ELEM*)(B_buffers + (overlap ? (size_t)(panel_index & 1) * panel : 0));
+
+                // The next panel, packed between this one's blocks of A when overlapping
+                int j_next = j_block, k_next = k_block + k_c;
+                if (k_next >= K) 
+                {
+                    j_next += n_c;
+                    k_next = 0;
+                }
+                int n_next = (j_next < N) ? ((N - j_next < n_c) ? N - j_next : n_c) : 0;
+                int k_b_next = (K - k_next < k_c) ? K - k_next : k_c;
+                ELEM* B_next = (ELEM*)(B_buffers + (size_t)((panel_index + 1) & 1) * panel);
+
+                // Each thread packs every nthreads-th micro-panel of the shared B panel;
+                // with overlap only the first panel is packed here, the others ahead of time
+                count_phase(&pc, last, compute);
+                double t0 = wall_time();
+                if (!overlap || panel_index == 0) 
+                {
+                    FN(pack_B_share)(B_packed, B, rsb, csb, k_b, n_b, n_r, j_block, k_block, tid, nthreads, 0, n_b);
+                }
+                if (tid == 0) { t_pack += wall_time() - t0; }
+                count_phase(&pc, last, pack);
+
+                if (!overlap || panel_index == 0) 
+                {
+                    #pragma omp barrier
+                }
+
+                // Loop over this thread's blocks of A (rows of A and C)
+                int packed_up_to = 0; // columns of the next panel this thread has packed
+                for (int ib = first; ib < last_block; ib++) 
+                {
+                    int i_block = ib * m_c;
+                    int m_b = (M - i_block < m_c) ? M - i_block : m_c; // rows in this block of A
+
+                    count_phase(&pc, last, compute);
+                    t0 = wall_time();
+                    FN(pack_A)(A_packed, A, rsa, csa, m_b, k_b, m_r, i_block, k_block);
+                    if (tid == 0) { t_pack += wall_time() - t0; }
+                    count_phase(&pc, last, pack);
+
+                    // Loop over the micro-panels of the packed B panel
+                    for (int j = 0; j < n_b; j += n_r) 
+                    {
+                        int n = (n_b - j < n_r) ? n_b - j : n_r;
+                        ELEM* C_block = &C[(size_t)(j_block + j) * ldc + i_block];
+                        epilogue_t block_ep; // ep with the biases offset to C_block
+
+                        if (ep != NULL && last_slice) 
+                        {
+                            block_ep = *ep;
+                            block_ep.row_bias = (ep->row_bias != NULL) ? (const ELEM*)ep->row_bias + i_block : NULL;
+                            block_ep.col_bias = (ep->col_bias != NULL) ? (const ELEM*)ep->col_bias + j_block + j : NULL;
+                        }
+                        FN(multiply_blocks_avx)(A_packed, &B_packed[j * k_b], C_block, ldc, m_b, n, k_b, n_r, m_r, alpha, beta_k, prefetch, 
+                                                (ep != NULL && last_slice) ? &block_ep : NULL);
+                    }
+
+                    // Spread this thread's share of the next panel over its blocks of A
+                    if (overlap && n_next > 0) 
+                    {
+                        int blocks_left = last_block - ib;
+                        int upto = packed_up_to + (n_next - packed_up_to + blocks_left - 1) / blocks_left;
+                        upto = (upto + n_r - 1) / n_r * n_r;
+
+                        count_phase(&pc, last, compute);
+                        t0 = wall_time();
+                        FN(pack_B_share)(B_next, B, rsb, csb, k_b_next, n_next, n_r, j_next, k_next, tid, nthreads, packed_up_to, upto);
+                        if (tid == 0) { t_pack += wall_time() - t0; }
+                        count_phase(&pc, last, pack);
+                        packed_up_to = upto;
+                    }
+                }
+
+                // Threads without blocks of A still pack their share
+                if (overlap && n_next > 0 && packed_up_to < n_next) 
+                {
+                    count_phase(&pc, last, compute);
+                    t0 = wall_time();
+                    FN(pack_B_share)(B_next, B, rsb, csb, k_b_next, n_next, n_r, j_next, k_next, tid, nthreads, packed_up_to, n_next);
+                    if (tid == 0) { t_pack += wall_time() - t0; }
+                    count_phase(&pc, last, pack);
+                }
+
+                // Nobody may overwrite a panel until every thread is done with it
+                #pragma omp barrier
+            }
+        }
+
+        if (pc.leader >= 0) 
+        {
+            count_phase(&pc, last, compute);
+
+            #pragma omp critical(gebp_counters)
+            for (int e = 0; e < PERF_EVENTS; e++) 
+            {
+                if (pc.slot[e] >= 0) 
+                {
+                    gebp_counters->pack[e] = (gebp_counters->pack[e] < 0 ? 0 : gebp_counters->pack[e]) + pack[e];
+                    gebp_counters->compute[e] = (gebp_counters->compute[e] < 0 ? 0 : gebp_counters->compute[e]) + compute[e];
+                }
+            }
+            perf_counters_close(&pc);
+        }
+    }
+
+    if (pack_time != NULL) 
+    {
+        *pack_time = t_pack;
+    }
+}
+
+void FN(gebp)(int M, int N, int K, ELEM alpha, const ELEM* A, int lda, const ELEM* B, int ldb, ELEM beta, ELEM* C, int ldc, const epilogue_t* ep, int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time) 
+{
+    FN(gebp_strided)(M, N, K, alpha, A, 1, lda, B, 1, ldb, beta, C, ldc, ep, m_c, k_c, n_c, n_r, m_r, prefetch, num_threads, pack_time);
+}
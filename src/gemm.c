@@ -0,0 +1,252 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * The GEBP driver for every element type and the
+ * dgemm library entry point built on it. Everything is accessed and stored in
+ * column major order.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <omp.h>
+#include "arena.h"
+#include "matrix_ops.h"
+#include "perf_counters.h"
+#include "gemm.h"
+#include "tune.h"
+
+static blocking_t dgemm_blocking; // Set on first use by dgemm_init_blocking
+static pthread_once_t dgemm_blocking_once = PTHREAD_ONCE_INIT;
+static int dgemm_threads = 0; // 0 uses omp_get_max_threads()
+static gebp_counters_t* gebp_counters = NULL; // Phase counters of gebp, NULL when off
+static int gebp_pinning = 0; // 1 pins gebp threads to distinct CPUs, off so library callers keep their affinity
+static int gebp_overlap = 0; // 1 packs the next panel of B while computing on the current one
+static cpu_set_t gebp_allowed; // CPUs the process could run on before gebp pinned anything
+static int gebp_allowed_count = 0; // Number of CPUs in gebp_allowed, 0 if unknown
+static pthread_once_t gebp_allowed_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Picks the blocking dgemm starts with: the wisdom file entry for this
+ * CPU model and microkernel if there is one, else the analytical
+ * blocking for the cache geometry in sysfs.
+ */
+static void dgemm_init_blocking(void)
+{
+    const microkernel_t* kernel = select_microkernel(DTYPE_DOUBLE);
+
+    if (!wisdom_load(wisdom_path(), cpu_model_name(), kernel->name, dtype_name(DTYPE_DOUBLE), &dgemm_blocking) 
+        || find_microkernel(DTYPE_DOUBLE, dgemm_blocking.m_r, dgemm_blocking.n_r) == NULL) 
+    {
+        cache_info_t info;
+        read_cache_info(&info);
+        dgemm_blocking = analytical_blocking(&info, kernel, sizeof(double));
+    }
+}
+
+/**
+ * Adds the counts since the last call to the phase totals and
+ * moves last to now. Does nothing when counters are off.
+ */
+static void count_phase(const perf_counters_t* pc, long long last[PERF_EVENTS], long long total[PERF_EVENTS])
+{
+    long long now[PERF_EVENTS];
+
+    if (pc->leader < 0) 
+    {
+        return;
+    }
+
+    perf_counters_read(pc, now);
+    for (int e = 0; e < PERF_EVENTS; e++) 
+    {
+        if (now[e] >= 0) 
+        {
+            total[e] += now[e] - last[e];
+        }
+        last[e] = now[e];
+    }
+}
+
+/**
+ * Records the CPUs the process may run on, once, before any thread is pinned.
+ */
+static void gebp_init_allowed(void)
+{
+    CPU_ZERO(&gebp_allowed);
+    if (sched_getaffinity(0, sizeof(gebp_allowed), &gebp_allowed) == 0) 
+    {
+        gebp_allowed_count = CPU_COUNT(&gebp_allowed);
+    }
+}
+
+int gebp_cpu_count(void)
+{
+    pthread_once(&gebp_allowed_once, gebp_init_allowed);
+    return gebp_allowed_count;
+}
+
+void gebp_place_thread(int index)
+{
+    pthread_once(&gebp_allowed_once, gebp_init_allowed);
+    if (gebp_allowed_count <= 0) 
+    {
+        return;
+    }
+    if (index < 0) 
+    {
+        sched_setaffinity(0, sizeof(gebp_allowed), &gebp_allowed);
+        return;
+    }
+
+    // Find the (index mod gebp_allowed_count)-th allowed CPU
+    int target = index % gebp_allowed_count;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) 
+    {
+        if (CPU_ISSET(cpu, &gebp_allowed) && target-- == 0) 
+        {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cpu, &set);
+            sched_setaffinity(0, sizeof(set), &set);
+            return;
+        }
+    }
+}
+
+// The driver, once per element type
+#define ELEM float
+#define FN(name) s##name
+#include "gebp_template.h"
+#undef ELEM
+#undef FN
+
+#define ELEM double
+#define FN(name) name
+#include "gebp_template.h"
+#undef ELEM
+#undef FN
+
+#define ELEM double complex
+#define FN(name) z##name
+#include "gebp_template.h"
+#undef ELEM
+#undef FN
+
+void gebp_typed(int dtype, int M, int N, int K, const void* A, int lda, const void* B, int ldb, void* C, int ldc,
+                int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time)
+{
+    switch (dtype) 
+    {
+        case DTYPE_FLOAT:
+            sgebp(M, N, K, 1.0f, (const float*)A, lda, (const float*)B, ldb, 0.0f, (float*)C, ldc, NULL, m_c, k_c, n_c, n_r, m_r, prefetch, num_threads, pack_time);
+            break;
+        case DTYPE_DOUBLE:
+            gebp(M, N, K, 1.0, (const double*)A, lda, (const double*)B, ldb, 0.0, (double*)C, ldc, NULL, m_c, k_c, n_c, n_r, m_r, prefetch, num_threads, pack_time);
+            break;
+        case DTYPE_COMPLEX:
+            zgebp(M, N, K, 1.0, (const double complex*)A, lda, (const double complex*)B, ldb, 0.0, (double complex*)C, ldc, NULL, 
+                  m_c, k_c, n_c, n_r, m_r, prefetch, num_threads, pack_time);
+            break;
+    }
+}
+
+void gebp_set_counters(gebp_counters_t* counters)
+{
+    gebp_counters = counters;
+}
+
+void gebp_set_pinning(int enable)
+{
+    gebp_pinning = enable;
+}
+
+void gebp_set_overlap(int enable)
+{
+    gebp_overlap = enable;
+}
+
+void dgemm_set_blocking(int m_c, int k_c, int n_c, int n_r, int m_r)
+{
+    pthread_once(&dgemm_blocking_once, dgemm_init_blocking);
+
+    if (m_c <= 0 || k_c <= 0 || n_c <= 0 || n_r <= 0 || m_r <= 0 || n_r > NR_MAX || m_r > MR_MAX) 
+    {
+        fprintf(stderr, "dgemm_set_blocking: invalid blocking %d %d %d %d %d\n", m_c, k_c, n_c, n_r, m_r);
+        return;
+    }
+
+    dgemm_blocking.m_c = m_c;
+    dgemm_blocking.k_c = k_c;
+    dgemm_blocking.n_c = n_c;
+    dgemm_blocking.n_r = n_r;
+    dgemm_blocking.m_r = m_r;
+}
+
+blocking_t dgemm_get_blocking(void)
+{
+    pthread_once(&dgemm_blocking_once, dgemm_init_blocking);
+    return dgemm_blocking;
+}
+
+void dgemm_set_num_threads(int num_threads)
+{
+    dgemm_threads = (num_threads > 0) ? num_threads : 0;
+}
+
+void dgemm(char transA, char transB, int M, int N, int K,
+           double alpha, const double* A, int lda, const double* B, int ldb,
+           double beta, double* C, int ldc)
+{
+    dgemm_epilogue(transA, transB, M, N, K, alpha, A, lda, B, ldb, beta, C, ldc, NULL);
+}
+
+void dgemm_epilogue(char transA, char transB, int M, int N, int K,
+                    double alpha, const double* A, int lda, const double* B, int ldb,
+                    double beta, double* C, int ldc, const epilogue_t* ep)
+{
+    int ta = (transA == 'T' || transA == 't' || transA == 'C' || transA == 'c');
+    int tb = (transB == 'T' || transB == 't' || transB == 'C' || transB == 'c');
+    int info = 0;
+
+    // Argument checks in the order of the reference BLAS
+    if (!ta && transA != 'N' && transA != 'n') { info = 1; }
+    else if (!tb && transB != 'N' && transB != 'n') { info = 2; }
+    else if (M < 0) { info = 3; }
+    else if (N < 0) { info = 4; }
+    else if (K < 0) { info = 5; }
+    else if (lda < ((ta ? K : M) > 1 ? (ta ? K : M) : 1)) { info = 8; }
+    else if (ldb < ((tb ? N : K) > 1 ? (tb ? N : K) : 1)) { info = 10; }
+    else if (ldc < (M > 1 ? M : 1)) { info = 13; }
+
+    if (info != 0) 
+    {
+        fprintf(stderr, "%s: parameter %d had an illegal value\n", ep ? "dgemm_epilogue" : "dgemm", info);
+        return;
+    }
+
+    if (M == 0 || N == 0) 
+    {
+        return;
+    }
+
+    int num_threads = (dgemm_threads > 0) ? dgemm_threads : omp_get_max_threads();
+
+    // With alpha = 0 only C = beta * C is left, which gebp does for K = 0
+    if (alpha == 0.0) 
+    {
+        K = 0;
+    }
+
+    pthread_once(&dgemm_blocking_once, dgemm_init_blocking);
+    blocking_t b = dgemm_blocking;
+
+    // Transposed operands are packed in place, by swapping their strides
+    gebp_strided(M, N, K, alpha,
+                 A, ta ? lda : 1, ta ? 1 : lda,
+                 B, tb ? ldb : 1, tb ? 1 : ldb,
+                 beta, C, ldc, ep,
+                 b.m_c, b.k_c, b.n_c, b.n_r, b.m_r, b.prefetch,
+                 num_threads, NULL);
+}
@@ -0,0 +1,265 @@
+#ifndef GEMM_H
+#define GEMM_H
+#include <complex.h>
+#include "matrix_ops.h"
+#include "perf_counters.h"
+#include "tune.h"
+
+/**
+ * ## GEBP Algorithm
+ * 
+ * Performs a blocked matrix multiplication using the Generalized Blocked Panel algorithm,
+ * C = alpha * A * B + beta * C where A is M x K, B is K x N and C is M x N, all stored
+ * in column-major order with leading dimensions lda, ldb and ldc. The function uses the five
+ * loop nest of Goto and van de Geijn: a k_c x n_c panel of B is packed once and stays
+ * in the L3 cache while every m_c x k_c block of A is multiplied with it, and each
+ * packed block of A stays in the L2 cache while it is reused across all n_r wide
+ * micro-panels of the B panel. The microkernel merges its results straight into C
+ * as C = alpha * A * B + beta * C, with beta applied on the first k_c slice only.
+ *
+ * With more than one thread, the panel of B is packed cooperatively and shared by all
+ * threads, each thread packs its own blocks of A, and the m_c blocks (the i loop) are
+ * divided among the threads. Threads are pinned to distinct CPUs, the calling thread
+ * included, only after gebp_set_pinning(1), with more than one thread and outside a
+ * parallel region.
+ * The packing buffers are 64-byte aligned and come from the threads' arenas (see
+ * arena.h), so repeated calls with the same blocking allocate nothing. With
+ * gebp_set_overlap(1) the panel of B is double buffered and each thread packs its
+ * share of the next panel between its blocks of A, instead of all threads packing
+ * it at once after a barrier.
+ *
+ * An epilogue (see epilogue_t) is applied by the microkernel in the same store that
+ * merges the last k_c slice into C, so C = act(alpha * A * B + beta * C + bias) costs
+ * no extra pass over C; the biases are indexed by the rows and columns of C.
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A and rows of B
+ * @param alpha Scale applied to A * B
+ * @param A Matrix A
+ * @param lda Leading dimension (column stride) of A, at least M
+ * @param B Matrix B
+ * @param ldb Leading dimension (column stride) of B, at least K
+ * @param beta Scale applied to the existing C
+ * @param C Matrix C
+ * @param ldc Leading dimension (column stride) of C, at least M
+ * @param ep Epilogue applied to C as it is finished, or NULL
+ * @param m_c Number of rows of A and C to process at one time
+ * @param k_c How many columns of A and rows of B to process at a time.
+ * @param n_c Number of columns of B and C in a packed panel of B.
+ * @param n_r Number of columns of B and C to process at a time (register tile width).
+ * @param m_r Number of rows within A and C that fits into registers.
+ * @param prefetch Prefetch distance of the microkernel in k iterations, 0 for none.
+ * @param num_threads Number of OpenMP threads to use.
+ * @param pack_time If not NULL, receives the seconds thread 0 spent packing A and B.
+ */
+void gebp(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc, const epilogue_t* ep,
+          int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time);
+
+/**
+ * gebp for float and double complex. The register tile must be one of a
+ * microkernel of that element type (see select_microkernel) for full speed;
+ * other shapes fall back to a portable loop.
+ */
+void sgebp(int M, int N, int K, float alpha, const float* A, int lda, const float* B, int ldb, float beta, float* C, int ldc, const epilogue_t* ep,
+           int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time);
+void zgebp(int M, int N, int K, double complex alpha, const double complex* A, int lda, const double complex* B, int ldb, 
+           double complex beta, double complex* C, int ldc, const epilogue_t* ep,
+           int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time);
+
+/**
+ * gebp on operands with arbitrary strides: element (i, k) of A is
+ * A[i * rsa + k * csa] and element (k, j) of B is B[k * rsb + j * csb]. The
+ * packing routines read the operands in place, so a transposed or row-major
+ * operand (row stride = its leading dimension, column stride 1) costs no
+ * transposed copy. gebp is gebp_strided with unit row strides. C stays
+ * column-major; for a row-major C, compute C^T = B^T * A^T instead.
+ *
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A and rows of B
+ * @param alpha Scale applied to A * B
+ * @param A Matrix A
+ * @param rsa Distance in elements between rows of A
+ * @param csa Distance in elements between columns of A
+ * @param B Matrix B
+ * @param rsb Distance in elements between rows of B
+ * @param csb Distance in elements between columns of B
+ * @param beta Scale applied to the existing C
+ * @param C Matrix C
+ * @param ldc Leading dimension (column stride) of C, at least M
+ * @param ep Epilogue applied to C as it is finished, or NULL
+ * @param m_c Rows of A per packed block
+ * @param k_c Columns of A and rows of B per packed block
+ * @param n_c Columns of B per packed panel
+ * @param n_r Register tile width
+ * @param m_r Register tile height
+ * @param prefetch Prefetch distance of the microkernel in k iterations
+ * @param num_threads Number of OpenMP threads to use
+ * @param pack_time If not NULL, receives the seconds thread 0 spent packing
+ */
+void gebp_strided(int M, int N, int K, double alpha, const double* A, int rsa, int csa, const double* B, int rsb, int csb, 
+                  double beta, double* C, int ldc, const epilogue_t* ep,
+                  int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time);
+void sgebp_strided(int M, int N, int K, float alpha, const float* A, int rsa, int csa, const float* B, int rsb, int csb, 
+                   float beta, float* C, int ldc, const epilogue_t* ep,
+                   int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time);
+void zgebp_strided(int M, int N, int K, double complex alpha, const double complex* A, int rsa, int csa, const double complex* B, int rsb, int csb, 
+                   double complex beta, double complex* C, int ldc, const epilogue_t* ep,
+                   int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time);
+
+/**
+ * Runs sgebp, gebp or zgebp on untyped buffers with alpha = 1 and beta = 0,
+ * for code such as the auto-tuner that handles every element type alike.
+ *
+ * @param dtype One of the DTYPE_* values, the element type of A, B and C
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A and rows of B
+ * @param A Matrix A
+ * @param lda Leading dimension of A
+ * @param B Matrix B
+ * @param ldb Leading dimension of B
+ * @param C Matrix C, overwritten with A * B
+ * @param ldc Leading dimension of C
+ * @param m_c Rows of A per packed block
+ * @param k_c Columns of A and rows of B per packed block
+ * @param n_c Columns of B per packed panel
+ * @param n_r Register tile width
+ * @param m_r Register tile height
+ * @param prefetch Prefetch distance of the microkernel in k iterations
+ * @param num_threads Number of OpenMP threads to use
+ * @param pack_time If not NULL, receives the seconds thread 0 spent packing
+ */
+void gebp_typed(int dtype, int M, int N, int K, const void* A, int lda, const void* B, int ldb, void* C, int ldc,
+                int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch, int num_threads, double* pack_time);
+
+/**
+ * Turns on hardware counters for gebp. While counters is not NULL, every
+ * thread of each gebp call opens its own counters (see perf_counters.h) and
+ * the counts of its packing and compute phases are added to counters. Events
+ * that cannot be counted stay -1. Pass NULL to turn counting off again.
+ *
+ * @param counters Totals to add to, cleared by the caller with gebp_counters_clear
+ */
+void gebp_set_counters(gebp_counters_t* counters);
+
+/**
+ * Turns the pinning of gebp threads to distinct CPUs on or off (the
+ * default). Pinning moves the calling thread too, and it stays on its CPU
+ * after gebp returns, so it is meant for benchmarks that own the process.
+ *
+ * @param enable 1 to pin, 0 to leave placement to the OS
+ */
+void gebp_set_pinning(int enable);
+
+/**
+ * Turns the overlap of packing the next panel of B with the multiplications on
+ * the current one on or off (the default). It costs a second panel buffer and
+ * saves one barrier per panel; the packing then runs while the other threads
+ * compute, hiding its memory traffic behind their FMAs.
+ *
+ * @param enable 1 to overlap, 0 to pack each panel before using it
+ */
+void gebp_set_overlap(int enable);
+
+/**
+ * Returns the number of CPUs the process could run on when gebp first
+ * looked, which is before it pinned any thread, or 0 if unknown.
+ */
+int gebp_cpu_count(void);
+
+/**
+ * Places the calling thread on the index-th of the CPUs counted by
+ * gebp_cpu_count (modulo their number), or on all of them when index is
+ * negative, which undoes an affinity inherited from a pinned thread.
+ * gebp uses it to pin its threads; the worker pool and the out-of-core
+ * reader use it for their own threads.
+ *
+ * @param index CPU to pin to, or -1 for all of them
+ */
+void gebp_place_thread(int index);
+
+/**
+ * BLAS compatible double precision matrix multiply,
+ * C = alpha * op(A) * op(B) + beta * C, where op(X) is X or its transpose.
+ * op(A) is M x K, op(B) is K x N and C is M x N, all column-major. The
+ * matrices may be sub-views of larger buffers through their leading
+ * dimensions. A row-major operand is passed as the transpose of its
+ * column-major view; transposed operands are packed in place (see
+ * gebp_strided), with no scratch copy. Runs gebp with the blocking from
+ * dgemm_set_blocking and the thread count from dgemm_set_num_threads. On first use the blocking
+ * is loaded from the wisdom file (see tune.h) for this CPU model and the
+ * microkernel chosen at run time, or derived from the cache geometry if
+ * the file has no entry. Invalid arguments are
+ * reported on stderr with their position, as the reference BLAS does,
+ * and leave C untouched.
+ *
+ * @param transA 'N' for op(A) = A, 'T' or 'C' for op(A) = A^T
+ * @param transB 'N' for op(B) = B, 'T' or 'C' for op(B) = B^T
+ * @param M Rows of op(A) and C
+ * @param N Columns of op(B) and C
+ * @param K Columns of op(A) and rows of op(B)
+ * @param alpha Scale applied to op(A) * op(B)
+ * @param A Matrix A, M x K (or K x M when transposed)
+ * @param lda Leading dimension of A
+ * @param B Matrix B, K x N (or N x K when transposed)
+ * @param ldb Leading dimension of B
+ * @param beta Scale applied to the existing C; C is not read when it is 0
+ * @param C Matrix C
+ * @param ldc Leading dimension of C
+ */
+void dgemm(char transA, char transB, int M, int N, int K,
+           double alpha, const double* A, int lda, const double* B, int ldb,
+           double beta, double* C, int ldc);
+
+/**
+ * dgemm followed by an epilogue, fused into the final store of C:
+ * C = act(alpha * op(A) * op(B) + beta * C + row_bias + col_bias), with
+ * row_bias indexed by the M rows and col_bias by the N columns of C.
+ *
+ * @param transA 'N' for op(A) = A, 'T' or 'C' for op(A) = A^T
+ * @param transB 'N' for op(B) = B, 'T' or 'C' for op(B) = B^T
+ * @param M Rows of op(A) and C
+ * @param N Columns of op(B) and C
+ * @param K Columns of op(A) and rows of op(B)
+ * @param alpha Scale applied to op(A) * op(B)
+ * @param A Matrix A, M x K (or K x M when transposed)
+ * @param lda Leading dimension of A
+ * @param B Matrix B, K x N (or N x K when transposed)
+ * @param ldb Leading dimension of B
+ * @param beta Scale applied to the existing C; C is not read when it is 0
+ * @param C Matrix C
+ * @param ldc Leading dimension of C
+ * @param ep Biases (arrays of double) and activation, or NULL for plain dgemm
+ */
+void dgemm_epilogue(char transA, char transB, int M, int N, int K,
+                    double alpha, const double* A, int lda, const double* B, int ldb,
+                    double beta, double* C, int ldc, const epilogue_t* ep);
+
+/**
+ * Sets the cache and register blocking used by dgemm. The register tile
+ * must be at most MR_MAX x NR_MAX; invalid values are ignored.
+ *
+ * @param m_c Rows of A per packed block (sized for L2)
+ * @param k_c Columns of A and rows of B per packed block (sized for L1)
+ * @param n_c Columns of B per packed panel (sized for L3)
+ * @param n_r Register tile width
+ * @param m_r Register tile height
+ */
+void dgemm_set_blocking(int m_c, int k_c, int n_c, int n_r, int m_r);
+
+/**
+ * Returns the blocking dgemm runs with: the one set by dgemm_set_blocking,
+ * or on first use the wisdom file entry or the analytical blocking.
+ */
+blocking_t dgemm_get_blocking(void);
+
+/**
+ * Sets the number of threads used by dgemm. 0 (the default) uses
+ * omp_get_max_threads().
+ *
+ * @param num_threads Number of OpenMP threads
+ */
+void dgemm_set_num_threads(int num_threads);
+
+#endif
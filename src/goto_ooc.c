@@ -0,0 +1,251 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Multiplies matrices stored in files, larger than the
+ * memory it is allowed to use, with the out-of-core GEMM
+ * and compares the GFLOPS with what the disk bandwidth
+ * allows. Everything is column major.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "matrix_ops.h"
+#include "gemm.h"
+#include "tune.h"
+#include "bench.h"
+#include "arena.h"
+#include "ooc.h"
+
+#define DEFAULT_N 8192 // Default dims of matricies, 512 MB per matrix
+#define CHECK_SAMPLES 16 // Entries of C checked against a dot product
+
+/**
+ * Element (i, k) of A and (k, j) of B. Small integers, so the dot
+ * products used for checking are exact and need no reads.
+ */
+static double a_entry(int i, int k)
+{
+    return (double)((i * 7 + k * 3) % 11 - 5);
+}
+
+static double b_entry(int k, int j)
+{
+    return (double)((k * 5 + j * 2) % 13 - 6);
+}
+
+/**
+ * The files of one product and the stats of its last run.
+ */
+typedef struct
+{
+    matrix_file_t A, B, C; // Matrix files
+    size_t memory; // Bytes for the tiles
+    blocking_t blocking; // Blocking for gebp
+    int threads; // Threads for gebp
+    int status; // Result of the last ooc_dgemm
+    ooc_stats_t stats; // Stats of the last run
+} ooc_job_t;
+
+/**
+ * Runs one out-of-core product.
+ */
+static void run_ooc(void* ctx)
+{
+    ooc_job_t* job = (ooc_job_t*)ctx;
+    job->status = ooc_dgemm(&job->A, &job->B, &job->C, job->memory, &job->blocking, job->threads, &job->stats);
+}
+
+/**
+ * Drops the files from the page cache, so every run reads from the disk.
+ */
+static void evict_files(void* ctx)
+{
+    ooc_job_t* job = (ooc_job_t*)ctx;
+    matrix_file_evict(&job->A);
+    matrix_file_evict(&job->B);
+    matrix_file_evict(&job->C);
+}
+
+/**
+ * Writes an n x n matrix with entries from entry to a new file, a few
+ * columns at a time. Returns 0, or -1 with errno set.
+ */
+static int write_matrix(const char* path, int n, double (*entry)(int, int), double* buffer, int cols, matrix_file_t* f)
+{
+    if (matrix_file_create(path, DTYPE_DOUBLE, n, n, f) != 0) 
+    {
+        return -1;
+    }
+
+    for (int j0 = 0; j0 < n; j0 += cols) 
+    {
+        int w = (n - j0 < cols) ? n - j0 : cols;
+        for (int j = 0; j < w; j++) 
+        {
+            for (int i = 0; i < n; i++) 
+            {
+                buffer[(size_t)j * n + i] = entry(i, j0 + j);
+            }
+        }
+        if (matrix_file_write_block(f, 0, j0, n, w, buffer, n) != 0) 
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns the sequential read bandwidth of a file in bytes per second,
+ * reading it from the disk in chunks of cols columns.
+ */
+static double read_bandwidth(const matrix_file_t* f, double* buffer, int cols)
+{
+    matrix_file_evict(f);
+    double start = wall_time();
+    for (int j0 = 0; j0 < f->cols; j0 += cols) 
+    {
+        int w = (f->cols - j0 < cols) ? f->cols - j0 : cols;
+        if (matrix_file_read_block(f, 0, j0, f->rows, w, buffer, f->rows) != 0) 
+        {
+            return 0.0;
+        }
+    }
+    double seconds = wall_time() - start;
+
+    return (double)f->rows * f->cols * sizeof(double) / seconds;
+}
+
+/**
+ * Returns the largest error of CHECK_SAMPLES entries of the C file
+ * against dot products, relative to the largest possible entry, or -1
+ * if C could not be read.
+ */
+static double check_result(const matrix_file_t* C, int n)
+{
+    double err = 0.0;
+
+    for (int s = 0; s < CHECK_SAMPLES; s++) 
+    {
+        int i = (int)(((long)s * 7919) % n);
+        int j = (int)(((long)s * 104729) % n);
+        double c, dot = 0.0;
+
+        if (matrix_file_read_block(C, i, j, 1, 1, &c, 1) != 0) 
+        {
+            return -1.0;
+        }
+        for (int k = 0; k < n; k++) 
+        {
+            dot += a_entry(i, k) * b_entry(k, j);
+        }
+
+        double d = fabs(c - dot) / (30.0 * n);
+        err = (d > err) ? d : err;
+    }
+    return err;
+}
+
+int main(int argc, char* argv[])
+{
+    bench_options_t opts;
+
+    if (bench_parse_args(argc, argv, &opts, "../output/gotoooc.csv", DEFAULT_N) != 0) 
+    {
+        return 1;
+    }
+    gebp_set_pinning(opts.pin);
+
+    // The matrix files go to MAXGFLOPS_OOC_DIR, on the disk to measure
+    const char* dir = getenv("MAXGFLOPS_OOC_DIR");
+    dir = (dir != NULL && dir[0] != '\0') ? dir : ".";
+
+    blocking_t blocking = dgemm_get_blocking();
+
+    FILE* fp = fopen(opts.output, "w");
+    if (fp == NULL) 
+    {
+        fprintf(stderr, "Unable to open %s for writing: ", opts.output);
+        perror(NULL);
+        return 1;
+    }
+
+    size_t memory = (size_t)opts.memory << 20;
+    printf("Matrix files in %s, tile memory: %d MB, threads: %d, repetitions: %d (+%d warmup)\n",
+           dir, opts.memory, opts.threads, opts.reps, opts.warmup);
+    printf("Blocking: m_c = %d, k_c = %d, n_c = %d, n_r = %d, m_r = %d, prefetch = %d\n",
+           blocking.m_c, blocking.k_c, blocking.n_c, blocking.n_r, blocking.m_r, blocking.prefetch);
+    printf("%6s %9s %6s %10s %10s %10s %11s %10s %9s %10s\n",
+           "N", "file (MB)", "tile", "gflops", "flop/byte", "disk MB/s", "I/O gflops", "vs I/O", "io wait", "max error");
+    fprintf(fp, "N,file (MB),memory (MB),tile,gflops,time (seconds),read (MB),written (MB),intensity (flop/byte),"
+                "disk bandwidth (MB/s),io bound gflops,vs io bound,io wait (seconds),compute (seconds),max error," BENCH_STATS_HEADER "\n");
+
+    for (int s = 0; s < opts.num_sizes; s++) 
+    {
+        int n = opts.sizes[s];
+        double file_mb = (double)n * n * sizeof(double) / (1 << 20);
+        char a_path[1024], b_path[1024], c_path[1024];
+        snprintf(a_path, sizeof(a_path), "%s/gotoooc_A.mat", dir);
+        snprintf(b_path, sizeof(b_path), "%s/gotoooc_B.mat", dir);
+        snprintf(c_path, sizeof(c_path), "%s/gotoooc_C.mat", dir);
+
+        // Staging buffer for writing and timing the files, within the memory budget
+        int cols = (int)(memory / ((size_t)n * sizeof(double)));
+        cols = (cols < 1) ? 1 : ((cols > n) ? n : cols);
+        double* buffer = (double*)alloc_matrix((size_t)n * cols, sizeof(double), 0);
+
+        ooc_job_t job;
+        memset(&job, 0, sizeof(job));
+        job.memory = memory;
+        job.blocking = blocking;
+        job.threads = opts.threads;
+
+        if (buffer == NULL
+            || write_matrix(a_path, n, a_entry, buffer, cols, &job.A) != 0
+            || write_matrix(b_path, n, b_entry, buffer, cols, &job.B) != 0
+            || matrix_file_create(c_path, DTYPE_DOUBLE, n, n, &job.C) != 0)
+        {
+            fprintf(stderr, "Unable to write the %d x %d matrix files in %s: %s\n", n, n, dir, strerror(errno));
+            fclose(fp);
+            return 1;
+        }
+
+        double bandwidth = read_bandwidth(&job.A, buffer, cols); // bytes per second
+        free(buffer);
+
+        bench_stats_t stats = bench_run(&opts, run_ooc, evict_files, &job);
+        if (job.status != 0) 
+        {
+            fprintf(stderr, "Out-of-core product of N = %d failed: %s\n", n, strerror(errno));
+            fclose(fp);
+            return 1;
+        }
+
+        double g_flops = (2.0 * n * n * n / stats.median) / 1e9; // gigflops of algorithm
+        double intensity = 2.0 * n * n * n / (double)job.stats.bytes_read; // flops per byte read
+        double io_gflops = intensity * bandwidth / 1e9; // ceiling set by the disk
+        double err = check_result(&job.C, n);
+
+        printf("%6d %9.0f %6d %10.3f %10.2f %10.1f %11.3f %10.3f %8.1f%% %10.2e\n", n, file_mb, job.stats.tile_m,
+               g_flops, intensity, bandwidth / (1 << 20), io_gflops, g_flops / io_gflops, 100.0 * job.stats.io_wait / job.stats.seconds, err);
+        fprintf(fp, "%d,%lf,%d,%d,%lf,%f,%lf,%lf,%lf,%lf,%lf,%lf,%f,%f,%e,", n, file_mb, opts.memory, job.stats.tile_m, g_flops, stats.median,
+                (double)job.stats.bytes_read / (1 << 20), (double)job.stats.bytes_written / (1 << 20), intensity,
+                bandwidth / (1 << 20), io_gflops, g_flops / io_gflops, job.stats.io_wait, job.stats.compute, err);
+        bench_fprint_stats(fp, &stats);
+        fprintf(fp, "\n");
+
+        matrix_file_close(&job.A);
+        matrix_file_close(&job.B);
+        matrix_file_close(&job.C);
+        unlink(a_path);
+        unlink(b_path);
+        unlink(c_path);
+    }
+
+    fclose(fp);
+    printf("Results written to %s\n", opts.output);
+    return 0;
+}
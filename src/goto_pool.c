@@ -0,0 +1,277 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Replays a synthetic stream of independent GEMM requests of
+ * mixed sizes, arriving at random times, once through gebp one
+ * request at a time and once through the worker pool, and
+ * compares their throughput and latency. Everything is column major.
+ */
+
+#include <errno.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "matrix_ops.h"
+#include "gemm.h"
+#include "tune.h"
+#include "bench.h"
+#include "arena.h"
+#include "pool.h"
+
+#define DEFAULT_N 512 // Largest request of the default mix: N/8, N/4, N/2 and N
+#define NUM_REQUESTS 256 // Requests replayed per load and mode
+#define CHECK_SAMPLES 4 // Entries of each C checked against a dot product
+
+static const double loads[] = {0.5, 0.8, 0.95}; // Arrival rate as a fraction of what serial gebp sustains
+#define LOAD_COUNT (int)(sizeof(loads) / sizeof(loads[0]))
+
+/**
+ * Sleeps until the monotonic clock reads t seconds.
+ */
+static void sleep_until(double t)
+{
+    struct timespec ts;
+    ts.tv_sec = (time_t)t;
+    ts.tv_nsec = (long)((t - (double)ts.tv_sec) * 1e9);
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) 
+    {
+        // Interrupted by a signal, sleep again
+    }
+}
+
+/**
+ * A square gebp call for bench_run, to measure the service time of a size.
+ */
+typedef struct
+{
+    int N; // Problem size
+    const double* A; // N x N, leading dimension lda
+    const double* B; // N x N, leading dimension lda
+    double* C; // N x N
+    int lda; // Leading dimension of A and B
+    blocking_t blocking; // Blocking for gebp
+    int threads; // Threads for gebp
+} service_job_t;
+
+/**
+ * Runs a service_job_t.
+ */
+static void run_service(void* ctx)
+{
+    service_job_t* job = (service_job_t*)ctx;
+    const blocking_t* b = &job->blocking;
+    int n = job->N;
+
+    gebp(n, n, n, 1.0, job->A, job->lda, job->B, job->lda, 0.0, job->C, n, NULL,
+         b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, job->threads, NULL);
+}
+
+/**
+ * Returns the largest error of CHECK_SAMPLES entries of each request's C
+ * against dot products, relative to the size of the product.
+ */
+static double check_requests(const gemm_request_t* requests, int count)
+{
+    double err = 0.0;
+
+    for (int r = 0; r < count; r++) 
+    {
+        const gemm_request_t* q = &requests[r];
+        for (int s = 0; s < CHECK_SAMPLES; s++) 
+        {
+            int i = (int)(((long)(r + 1) * (s + 1) * 7919) % q->M);
+            int j = (int)(((long)(r + 1) * (s + 1) * 104729) % q->N);
+            double dot = 0.0;
+
+            for (int k = 0; k < q->K; k++) 
+            {
+                dot += q->A[(size_t)k * q->lda + i] * q->B[(size_t)j * q->ldb + k];
+            }
+            double d = fabs(q->C[(size_t)j * q->ldc + i] - dot) / q->K;
+            err = (d > err) ? d : err;
+        }
+    }
+    return err;
+}
+
+int main(int argc, char* argv[])
+{
+    bench_options_t opts;
+
+    if (bench_parse_args(argc, argv, &opts, "../output/gotopool.csv", DEFAULT_N) != 0) 
+    {
+        return 1;
+    }
+    gebp_set_pinning(opts.pin);
+
+    blocking_t blocking = dgemm_get_blocking();
+
+    // The sizes of the mix: the ones given, or N/8, N/4, N/2 and N for a single N
+    int mix[BENCH_MAX_SIZES], mix_count = 0, largest = 0;
+    if (opts.num_sizes == 1) 
+    {
+        for (int d = 8; d >= 1; d /= 2) 
+        {
+            mix[mix_count++] = (opts.sizes[0] / d > 0) ? opts.sizes[0] / d : 1;
+        }
+    }
+    else 
+    {
+        for (int s = 0; s < opts.num_sizes; s++) 
+        {
+            mix[mix_count++] = opts.sizes[s];
+        }
+    }
+    for (int s = 0; s < mix_count; s++) 
+    {
+        largest = (mix[s] > largest) ? mix[s] : largest;
+    }
+
+    FILE* fp = fopen(opts.output, "w");
+    if (fp == NULL) 
+    {
+        fprintf(stderr, "Unable to open %s for writing: ", opts.output);
+        perror(NULL);
+        return 1;
+    }
+
+    // Operands shared by all requests, each uses the top left corner
+    size_t count = (size_t)largest * largest;
+    double* A = (double*)alloc_matrix(count, sizeof(double), opts.huge_pages);
+    double* B = (double*)alloc_matrix(count, sizeof(double), opts.huge_pages);
+    for (size_t i = 0; i < count; i++) 
+    {
+        A[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        B[i] = 2.0 * rand() / RAND_MAX - 1.0;
+    }
+
+    // Service time of each size with all threads, for the capacity of the serial server
+    double mean_service = 0.0;
+    double* scratch = (double*)alloc_matrix(count, sizeof(double), opts.huge_pages);
+    printf("Request mix with %d threads:", opts.threads);
+    for (int s = 0; s < mix_count; s++) 
+    {
+        service_job_t job = {mix[s], A, B, scratch, largest, blocking, opts.threads};
+        double t = bench_run(&opts, run_service, NULL, &job).median;
+        mean_service += t / mix_count;
+        printf(" %d (%.3f ms)", mix[s], 1e3 * t);
+    }
+    printf("\n");
+    free(scratch);
+
+    gemm_pool_t* pool = gemm_pool_create(opts.threads, opts.pin, &blocking);
+    if (pool == NULL) 
+    {
+        fprintf(stderr, "Unable to start the worker pool\n");
+        fclose(fp);
+        return 1;
+    }
+
+    printf("%6s %7s %12s %12s %10s %10s %10s %10s %10s\n",
+           "load", "mode", "offered/s", "served/s", "gflops", "p50 (ms)", "p99 (ms)", "max (ms)", "max error");
+    fprintf(fp, "load,mode,requests,workers,offered (requests/s),throughput (requests/s),gflops,"
+                "p50 latency (ms),p99 latency (ms),max latency (ms),max error\n");
+
+    gemm_request_t* requests = (gemm_request_t*)calloc(NUM_REQUESTS, sizeof(gemm_request_t));
+    double* arrival = (double*)malloc(NUM_REQUESTS * sizeof(double));
+    double* latency = (double*)malloc(NUM_REQUESTS * sizeof(double));
+    double** C = (double**)calloc(NUM_REQUESTS, sizeof(double*));
+
+    for (int l = 0; l < LOAD_COUNT; l++) 
+    {
+        // Poisson arrivals of uniformly mixed sizes, the same stream for both modes
+        double rate = loads[l] / mean_service; // requests per second
+        double t = 0.0, total_flops = 0.0;
+        srand(1234 + l);
+        for (int r = 0; r < NUM_REQUESTS; r++) 
+        {
+            int n = mix[rand() % mix_count];
+            t += -log((rand() + 1.0) / ((double)RAND_MAX + 2.0)) / rate;
+            arrival[r] = t;
+            total_flops += 2.0 * n * n * n;
+
+            free(C[r]);
+            C[r] = (double*)malloc((size_t)n * n * sizeof(double));
+            memset(&requests[r], 0, sizeof(gemm_request_t));
+            requests[r].M = requests[r].N = requests[r].K = n;
+            requests[r].alpha = 1.0;
+            requests[r].A = A;
+            requests[r].lda = largest;
+            requests[r].B = B;
+            requests[r].ldb = largest;
+            requests[r].beta = 0.0;
+            requests[r].C = C[r];
+            requests[r].ldc = n;
+        }
+
+        for (int mode = 0; mode < 2; mode++) 
+        {
+            double start = wall_time() + 0.01, end = start;
+
+            if (mode == 0) 
+            {
+                // One server: each request waits for the ones before it, then gets every thread
+                for (int r = 0; r < NUM_REQUESTS; r++) 
+                {
+                    gemm_request_t* q = &requests[r];
+                    sleep_until(start + arrival[r]);
+                    gebp(q->M, q->N, q->K, q->alpha, q->A, q->lda, q->B, q->ldb, q->beta, q->C, q->ldc, NULL,
+                         blocking.m_c, blocking.k_c, blocking.n_c, blocking.n_r, blocking.m_r, blocking.prefetch, opts.threads, NULL);
+                    q->completed = wall_time();
+                }
+            }
+            else 
+            {
+                // The pool: requests are submitted as they arrive and share the workers
+                for (int r = 0; r < NUM_REQUESTS; r++) 
+                {
+                    sleep_until(start + arrival[r]);
+                    if (gemm_pool_submit(pool, &requests[r]) != 0) 
+                    {
+                        fprintf(stderr, "Unable to submit request %d\n", r);
+                        return 1;
+                    }
+                }
+                for (int r = 0; r < NUM_REQUESTS; r++) 
+                {
+                    gemm_pool_wait(pool, &requests[r]);
+                }
+            }
+
+            for (int r = 0; r < NUM_REQUESTS; r++) 
+            {
+                latency[r] = requests[r].completed - (start + arrival[r]);
+                end = (requests[r].completed > end) ? requests[r].completed : end;
+            }
+            qsort(latency, NUM_REQUESTS, sizeof(double), bench_compare_doubles);
+
+            const char* name = (mode == 0) ? "serial" : "pool";
+            double makespan = end - start;
+            double p50 = 1e3 * latency[(int)ceil(0.50 * NUM_REQUESTS) - 1];
+            double p99 = 1e3 * latency[(int)ceil(0.99 * NUM_REQUESTS) - 1];
+            double worst = 1e3 * latency[NUM_REQUESTS - 1];
+            double err = check_requests(requests, NUM_REQUESTS);
+
+            printf("%6.2f %7s %12.1f %12.1f %10.3f %10.3f %10.3f %10.3f %10.2e\n", loads[l], name, rate, NUM_REQUESTS / makespan,
+                   total_flops / makespan / 1e9, p50, p99, worst, err);
+            fprintf(fp, "%lf,%s,%d,%d,%lf,%lf,%lf,%lf,%lf,%lf,%e\n", loads[l], name, NUM_REQUESTS, (mode == 0) ? opts.threads : gemm_pool_workers(pool),
+                    rate, NUM_REQUESTS / makespan, total_flops / makespan / 1e9, p50, p99, worst, err);
+        }
+    }
+
+    gemm_pool_destroy(pool);
+    for (int r = 0; r < NUM_REQUESTS; r++) 
+    {
+        free(C[r]);
+    }
+    free(C);
+    free(requests);
+    free(arrival);
+    free(latency);
+    free(A);
+    free(B);
+    fclose(fp);
+    printf("Results written to %s\n", opts.output);
+    return 0;
+}
@@ -0,0 +1,336 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Times SUMMA over MPI on 1 to P processes, where P is the
+ * size of MPI_COMM_WORLD, for strong scaling (fixed N) and weak
+ * scaling (fixed memory per process). Run it with mpirun, e.g.
+ * mpirun -np 4 ./gotosumma. Everything is column major.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include <mpi.h>
+#include "matrix_ops.h"
+#include "gemm.h"
+#include "tune.h"
+#include "bench.h"
+#include "summa.h"
+
+#define DEFAULT_N 2048 // Default dims of matricies
+#define CHECK_SAMPLES 16 // Entries of C each process checks against a dot product
+
+/**
+ * Element (i, k) of the global A and (k, j) of the global B. Small
+ * integers, so every process can regenerate any entry and the dot
+ * products used for checking are exact.
+ */
+static double a_entry(int i, int k)
+{
+    return (double)((i * 7 + k * 3) % 11 - 5);
+}
+
+static double b_entry(int k, int j)
+{
+    return (double)((k * 5 + j * 2) % 13 - 6);
+}
+
+/**
+ * The blocks of one process and everything summa needs to run on them.
+ */
+typedef struct
+{
+    int N; // Length and width of the global matrices
+    double* A; // My block of A
+    double* B; // My block of B
+    double* C; // My block of C
+    int m_loc, n_loc, k_a, k_b; // Rows of my blocks of A and C, columns of B and C, columns of A, rows of B
+    const summa_grid_t* grid; // Process grid
+    blocking_t blocking; // Blocking for the local gebp
+    int threads; // Threads per process
+} summa_job_t;
+
+/**
+ * Runs one SUMMA product between two barriers, so the time is that of
+ * the slowest process.
+ */
+static void run_summa(void* ctx)
+{
+    summa_job_t* job = (summa_job_t*)ctx;
+
+    MPI_Barrier(job->grid->comm);
+    summa(job->N, job->N, job->N, 1.0, job->A, job->m_loc, job->B, job->k_b, 0.0, job->C, job->m_loc,
+          SUMMA_PANEL, job->grid, &job->blocking, job->threads);
+    MPI_Barrier(job->grid->comm);
+}
+
+/**
+ * Fills my blocks of A and B from a_entry and b_entry. Returns 0, or
+ * 1 if they could not be allocated.
+ */
+static int setup_job(summa_job_t* job)
+{
+    const summa_grid_t* g = job->grid;
+    int N = job->N;
+    int row0, col0, ka0, kb0;
+
+    job->m_loc = summa_block(N, g->rows, g->my_row, &row0);
+    job->n_loc = summa_block(N, g->cols, g->my_col, &col0);
+    job->k_a = summa_block(N, g->cols, g->my_col, &ka0);
+    job->k_b = summa_block(N, g->rows, g->my_row, &kb0);
+
+    // One extra element keeps malloc from returning NULL for empty blocks
+    job->A = (double*)malloc(((size_t)job->m_loc * job->k_a + 1) * sizeof(double));
+    job->B = (double*)malloc(((size_t)job->k_b * job->n_loc + 1) * sizeof(double));
+    job->C = (double*)malloc(((size_t)job->m_loc * job->n_loc + 1) * sizeof(double));
+    if (job->A == NULL || job->B == NULL || job->C == NULL) 
+    {
+        return 1;
+    }
+
+    for (int k = 0; k < job->k_a; k++) 
+    {
+        for (int i = 0; i < job->m_loc; i++) 
+        {
+            job->A[(size_t)k * job->m_loc + i] = a_entry(row0 + i, ka0 + k);
+        }
+    }
+    for (int j = 0; j < job->n_loc; j++) 
+    {
+        for (int k = 0; k < job->k_b; k++) 
+        {
+            job->B[(size_t)j * job->k_b + k] = b_entry(kb0 + k, col0 + j);
+        }
+    }
+    return 0;
+}
+
+/**
+ * Returns the largest error of CHECK_SAMPLES entries of my block of C
+ * against dot products of the global A and B, relative to the largest
+ * possible entry, over all processes.
+ */
+static double check_job(const summa_job_t* job)
+{
+    const summa_grid_t* g = job->grid;
+    int row0, col0;
+    double err = 0.0, max_err;
+
+    summa_block(job->N, g->rows, g->my_row, &row0);
+    summa_block(job->N, g->cols, g->my_col, &col0);
+
+    for (int s = 0; s < CHECK_SAMPLES && job->m_loc > 0 && job->n_loc > 0; s++) 
+    {
+        int i = (int)(((long)s * 7919) % job->m_loc);
+        int j = (int)(((long)s * 104729) % job->n_loc);
+        double dot = 0.0;
+
+        for (int k = 0; k < job->N; k++) 
+        {
+            dot += a_entry(row0 + i, k) * b_entry(k, col0 + j);
+        }
+
+        double d = fabs(job->C[(size_t)j * job->m_loc + i] - dot) / (30.0 * job->N);
+        err = (d > err) ? d : err;
+    }
+
+    MPI_Allreduce(&err, &max_err, 1, MPI_DOUBLE, MPI_MAX, g->comm);
+    return max_err;
+}
+
+/**
+ * Opens a CSV file for writing, printing why if it cannot.
+ */
+static FILE* open_csv(const char* path)
+{
+    FILE* fp = fopen(path, "w");
+    if (fp == NULL) 
+    {
+        fprintf(stderr, "Unable to open %s for writing: ", path);
+        perror(NULL);
+    }
+    return fp;
+}
+
+/**
+ * Times an N x N x N product on the first ranks processes of
+ * MPI_COMM_WORLD; the others only wait. Returns the statistics on
+ * world rank 0 and sets *grid_rows, *grid_cols and *err there.
+ */
+static bench_stats_t time_summa(const bench_options_t* opts, int N, int ranks, const blocking_t* blocking, int threads,
+                                int* grid_rows, int* grid_cols, double* err)
+{
+    int rank;
+    MPI_Comm comm;
+    bench_stats_t stats;
+
+    memset(&stats, 0, sizeof(stats));
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_split(MPI_COMM_WORLD, (rank < ranks) ? 0 : MPI_UNDEFINED, rank, &comm);
+
+    if (comm != MPI_COMM_NULL) 
+    {
+        summa_grid_t grid;
+        summa_grid_create(comm, &grid);
+
+        summa_job_t job = {N, NULL, NULL, NULL, 0, 0, 0, 0, &grid, *blocking, threads};
+        int failed = setup_job(&job), any_failed;
+        MPI_Allreduce(&failed, &any_failed, 1, MPI_INT, MPI_MAX, comm);
+
+        if (any_failed) 
+        {
+            if (rank == 0) 
+            {
+                fprintf(stderr, "Unable to allocate the blocks of N = %d on %d processes\n", N, ranks);
+            }
+            *err = -1.0;
+        }
+        else 
+        {
+            stats = bench_run(opts, run_summa, NULL, &job);
+            *err = check_job(&job);
+        }
+        *grid_rows = grid.rows;
+        *grid_cols = grid.cols;
+
+        free(job.A);
+        free(job.B);
+        free(job.C);
+        summa_grid_free(&grid);
+        MPI_Comm_free(&comm);
+    }
+
+    MPI_Barrier(MPI_COMM_WORLD);
+    return stats;
+}
+
+int main(int argc, char* argv[])
+{
+    bench_options_t opts;
+    int rank, size;
+
+    MPI_Init(&argc, &argv);
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &size);
+
+    if (bench_parse_args(argc, argv, &opts, "../output/gotosumma.csv", DEFAULT_N) != 0) 
+    {
+        MPI_Finalize();
+        return 1;
+    }
+
+    // mpirun places the processes; pinning every process's threads to the first CPUs would stack them
+    gebp_set_pinning(0);
+    int threads = opts.threads / size; // threads per process, so all processes together use opts.threads
+    threads = (threads > 0) ? threads : 1;
+
+    // Every process uses rank 0's blocking, so they all do the same work
+    blocking_t blocking;
+    if (rank == 0) 
+    {
+        blocking = dgemm_get_blocking();
+    }
+    MPI_Bcast(&blocking, sizeof(blocking), MPI_BYTE, 0, MPI_COMM_WORLD);
+
+    char weak_path[1024];
+    bench_output_path(opts.output, "_weak", weak_path, sizeof(weak_path));
+
+    FILE* fp_strong = NULL;
+    FILE* fp_weak = NULL;
+    int failed = 0;
+    if (rank == 0) 
+    {
+        fp_strong = open_csv(opts.output);
+        fp_weak = (fp_strong != NULL) ? open_csv(weak_path) : NULL;
+        failed = (fp_weak == NULL);
+    }
+    MPI_Bcast(&failed, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (failed) 
+    {
+        if (fp_strong != NULL) { fclose(fp_strong); }
+        MPI_Finalize();
+        return 1;
+    }
+
+    if (rank == 0) 
+    {
+        printf("Processes: %d, threads per process: %d, panel width: %d, repetitions: %d (+%d warmup)\n",
+               size, threads, SUMMA_PANEL, opts.reps, opts.warmup);
+        printf("Blocking: m_c = %d, k_c = %d, n_c = %d, n_r = %d, m_r = %d, prefetch = %d\n",
+               blocking.m_c, blocking.k_c, blocking.n_c, blocking.n_r, blocking.m_r, blocking.prefetch);
+        fprintf(fp_strong, "N,processes,grid,gflops,gflops per process,speedup,efficiency,max error," BENCH_STATS_HEADER "\n");
+        fprintf(fp_weak, "N,processes,grid,gflops,gflops per process,efficiency,max error," BENCH_STATS_HEADER "\n");
+    }
+
+    for (int s = 0; s < opts.num_sizes; s++) 
+    {
+        int n = opts.sizes[s];
+        double base_time = 0.0, base_rate = 0.0;
+
+        // Strong scaling: the same N x N x N product on more processes
+        if (rank == 0) 
+        {
+            printf("=======================================\n");
+            printf("Strong scaling, N = %d\n", n);
+            printf("%6s %10s %6s %10s %12s %8s %10s %10s\n", "procs", "grid", "N", "gflops", "gflops/proc", "speedup", "efficiency", "max error");
+        }
+        for (int p = 1; p <= size; p++) 
+        {
+            int rows = 0, cols = 0;
+            double err = 0.0;
+            bench_stats_t stats = time_summa(&opts, n, p, &blocking, threads, &rows, &cols, &err);
+
+            if (rank == 0) 
+            {
+                double g_flops = (2.0 * n * n * n / stats.median) / 1e9; // gigflops of algorithm
+                base_time = (p == 1) ? stats.median : base_time;
+                double speedup = base_time / stats.median;
+                char grid[32];
+                snprintf(grid, sizeof(grid), "%dx%d", rows, cols);
+
+                printf("%6d %10s %6d %10.3f %12.3f %8.3f %10.3f %10.2e\n", p, grid, n, g_flops, g_flops / p, speedup, speedup / p, err);
+                fprintf(fp_strong, "%d,%d,%s,%lf,%lf,%lf,%lf,%e,", n, p, grid, g_flops, g_flops / p, speedup, speedup / p, err);
+                bench_fprint_stats(fp_strong, &stats);
+                fprintf(fp_strong, "\n");
+            }
+        }
+
+        // Weak scaling: N grows with sqrt(processes), so each process holds the same amount of A, B and C
+        if (rank == 0) 
+        {
+            printf("Weak scaling, N = %d per process\n", n);
+            printf("%6s %10s %6s %10s %12s %10s %10s\n", "procs", "grid", "N", "gflops", "gflops/proc", "efficiency", "max error");
+        }
+        for (int p = 1; p <= size; p++) 
+        {
+            int rows = 0, cols = 0;
+            double err = 0.0;
+            int n_p = (int)lround(n * sqrt((double)p));
+            bench_stats_t stats = time_summa(&opts, n_p, p, &blocking, threads, &rows, &cols, &err);
+
+            if (rank == 0) 
+            {
+                double g_flops = (2.0 * n_p * n_p * n_p / stats.median) / 1e9; // gigflops of algorithm
+                base_rate = (p == 1) ? g_flops : base_rate;
+                char grid[32];
+                snprintf(grid, sizeof(grid), "%dx%d", rows, cols);
+
+                printf("%6d %10s %6d %10.3f %12.3f %10.3f %10.2e\n", p, grid, n_p, g_flops, g_flops / p, g_flops / p / base_rate, err);
+                fprintf(fp_weak, "%d,%d,%s,%lf,%lf,%lf,%e,", n_p, p, grid, g_flops, g_flops / p, g_flops / p / base_rate, err);
+                bench_fprint_stats(fp_weak, &stats);
+                fprintf(fp_weak, "\n");
+            }
+        }
+    }
+
+    if (rank == 0) 
+    {
+        fclose(fp_strong);
+        fclose(fp_weak);
+        printf("Results written to %s and %s\n", opts.output, weak_path);
+    }
+
+    MPI_Finalize();
+    return 0;
+}
@@ -16,163 +16,1255 @@
 #include <math.h>
 #include <immintrin.h>
 #include <string.h>
+#include <omp.h>
 #include "matrix_ops.h"
+#include "gemm.h"
+#include "tune.h"
+#include "roofline.h"
+#include "bench.h"
+#include "strassen.h"
+#include "batch.h"
+#include "arena.h"
+#include "igemm.h"
+#include "level3.h"
 
-#define CACHE_L1_SIZE (32 * 1024)  // L1 cache size 
-#define CACHE_L2_SIZE (double)(256 * 1024)  // L2 cache size
-#define ELEMENT_SIZE sizeof(double)  // Size of each matrix element
-#define MAX_FREQ (3.97) // Max Clock Frequency of CPU core
-#define L1_SIZE_KB (CACHE_L1_SIZE / 1024.00) // L1 cache size kb
-#define L2_SIZE_KB (CACHE_L2_SIZE / 1024.00) // L2 cache size kb
 #define DEFAULT_N (1024 * 3) // Default dims of matricies
+#define TUNE_TRIALS 16 // Most blockings the auto-tuner times
+#define STRASSEN_MIN_CROSSOVER 128 // Smallest crossover tried
+#define BATCH_FLOPS (1L << 27) // Flops per batched run, the batch count is set from it
+#define INT_SAMPLES 64 // Entries of each integer product checked against exact dot products
+
+static const int batch_sizes[] = {4, 8, 12, 16, 24, 32, 48, 64}; // M = N = K of the batched runs
+#define BATCH_SIZE_COUNT (int)(sizeof(batch_sizes) / sizeof(batch_sizes[0]))
+
+static const int activations[] = {ACTIVATION_NONE, ACTIVATION_RELU, ACTIVATION_GELU}; // Epilogues compared, all with both biases
+static const char* activation_names[] = {"bias", "bias+relu", "bias+gelu"};
+
+static const int precisions[] = {DTYPE_DOUBLE, DTYPE_FLOAT, DTYPE_COMPLEX}; // Element types tuned and scaled
+#define PRECISION_COUNT (int)(sizeof(precisions) / sizeof(precisions[0]))
+
+/**
+ * Context handed to report_candidate by the auto-tuner.
+ */
+typedef struct
+{
+    FILE* fp; // CSV of every candidate timed
+    const cache_info_t* cache; // Cache geometry for the footprint columns
+    const microkernel_t* kernel; // Microkernel being tuned
+    const roofline_t* roof; // Measured ceilings for the utilization columns
+    int N; // Dimension of the tuning problem
+} tune_log_t;
+
+/**
+ * Prints the measured roofline.
+ */
+static void print_roofline(const roofline_t* roof)
+{
+    printf("Measured roofline (%s peak, STREAM triad bandwidth):\n", 
+           roof->isa == ISA_AVX512 ? "AVX-512 FMA" : roof->isa == ISA_AVX2 ? "AVX2 FMA" : "SSE2 mul/add");
+    printf("  %4d thread(s): %8.2f GFLOPS %8.2f GB/s, ridge %.2f flop/byte\n", 1,
+           roof->peak_core, roof->bandwidth_core, roof->peak_core / roof->bandwidth_core);
+    if (roof->threads > 1) 
+    {
+        printf("  %4d thread(s): %8.2f GFLOPS %8.2f GB/s, ridge %.2f flop/byte\n", roof->threads,
+               roof->peak_all, roof->bandwidth_all, roof->peak_all / roof->bandwidth_all);
+    }
+}
+
+/**
+ * Returns the compute ceiling of an element type relative to the double
+ * precision one the roofline measures. A vector holds twice as many floats;
+ * a complex multiply-add is 8 flops done with 4 double FMAs.
+ */
+static double peak_scale(int dtype)
+{
+    return (dtype == DTYPE_FLOAT) ? 2.0 : 1.0;
+}
+
+/**
+ * Prints and logs one blocking timed by the auto-tuner.
+ */
+static void report_candidate(const blocking_t* b, double seconds, double pack_seconds, 
+                             const gebp_counters_t* counters, double gflops, void* ctx)
+{
+    tune_log_t* log = (tune_log_t*)ctx;
+    int dtype = log->kernel->dtype;
+    int size = (int)dtype_size(dtype); // bytes per element
+    double util = gflops / (log->roof->peak_core * peak_scale(dtype)); // share of the compute ceiling
+    double intensity = (double)dtype_flops(dtype) * log->N * log->N * log->N / gemm_traffic_bytes(log->N, log->N, log->N, b->k_c, b->n_c, size);
+    double bw_util = gflops / intensity / log->roof->bandwidth_core; // share of the bandwidth ceiling
+    double roof_util = gflops / roofline_bound(log->roof->peak_core * peak_scale(dtype), log->roof->bandwidth_core, intensity); // share of the roofline at this intensity
+
+    int l1_used = (b->n_r * b->k_c * size) /1024; // space taken in l1 cache kb
+    int l2_used = (b->k_c * b->m_c * size) /1024; // space taken in l2 cache kb
+
+    printf("---------------------------------------\n");
+    printf("Block Sizes: m_c = %d, k_c = %d, n_c = %d, n_r = %d, m_r = %d, prefetch = %d (%s %s)\n", b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, 
+           b->prefetch, dtype_name(dtype), log->kernel->name);
+    print_performance_info(seconds, pack_seconds, gflops, util, intensity, bw_util, roof_util, l1_used, l2_used,
+                           log->cache->l1.size / 1024.0, log->cache->l2.size / 1024.0,
+                           b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, dtype_name(dtype), log->kernel->name, counters, log->fp);
+}
+
+/**
+ * One gebp call for bench_run.
+ */
+typedef struct
+{
+    int dtype; // Element type of A, B and C
+    int M, N, K; // Problem shape
+    const void* A; // M x K, leading dimension M
+    const void* B; // K x N, leading dimension K
+    void* C; // M x N, leading dimension M
+    blocking_t blocking; // Blocking to run with
+    int threads; // Threads for gebp
+} gebp_job_t;
+
+/**
+ * Runs the gebp call described by a gebp_job_t.
+ */
+static void run_gebp(void* ctx)
+{
+    gebp_job_t* job = (gebp_job_t*)ctx;
+    const blocking_t* b = &job->blocking;
+    gebp_typed(job->dtype, job->M, job->N, job->K, job->A, job->M, job->B, job->K, job->C, job->M, 
+               b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, job->threads, NULL);
+}
+
+/**
+ * One strassen call for bench_run.
+ */
+typedef struct
+{
+    int N; // Problem size
+    const double* A; // N x N
+    const double* B; // N x N
+    double* C; // N x N
+    blocking_t blocking; // Blocking for gebp
+    int crossover; // Size at or below which gebp is called
+    int threads; // Threads for gebp
+    double* work; // Preallocated workspace
+} strassen_job_t;
+
+/**
+ * Runs the strassen call described by a strassen_job_t.
+ */
+static void run_strassen(void* ctx)
+{
+    strassen_job_t* job = (strassen_job_t*)ctx;
+    strassen(job->N, job->N, job->N, job->A, job->N, job->B, job->N, job->C, job->N, 
+             job->crossover, &job->blocking, job->threads, job->work);
+}
+
+/**
+ * A batch of small square products for bench_run, stored back to back.
+ */
+typedef struct
+{
+    int n; // M = N = K of every product
+    int count; // Number of products
+    const double* A; // count n x n matrices
+    const double* B; // count n x n matrices
+    double* C; // count n x n matrices
+    blocking_t blocking; // Blocking of the gebp loop
+    int threads; // Threads of both dgemm_batch and the gebp loop
+} batch_job_t;
+
+/**
+ * Runs a batch_job_t through dgemm_batch_strided.
+ */
+static void run_batch(void* ctx)
+{
+    batch_job_t* job = (batch_job_t*)ctx;
+    long stride = (long)job->n * job->n;
+    dgemm_batch_strided(job->n, job->n, job->n, 1.0, job->A, job->n, stride, job->B, job->n, stride, 
+                        0.0, job->C, job->n, stride, job->count, job->threads);
+}
+
+/**
+ * Runs a batch_job_t as a loop of single-threaded gebp calls, split
+ * across the same threads as dgemm_batch so only the kernels differ.
+ */
+static void run_gebp_loop(void* ctx)
+{
+    batch_job_t* job = (batch_job_t*)ctx;
+    const blocking_t* b = &job->blocking;
+    size_t stride = (size_t)job->n * job->n;
+
+    #pragma omp parallel for schedule(static) num_threads(job->threads) if(job->threads > 1)
+    for (int i = 0; i < job->count; i++) 
+    {
+        gebp(job->n, job->n, job->n, 1.0, job->A + i * stride, job->n, job->B + i * stride, job->n, 0.0, job->C + i * stride, job->n, NULL, 
+             b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, 1, NULL);
+    }
+}
+
+/**
+ * A gebp call followed by an epilogue for bench_run, fused into the
+ * kernels or as a separate pass over C.
+ */
+typedef struct
+{
+    int N; // Problem size
+    const double* A; // N x N
+    const double* B; // N x N
+    double* C; // N x N
+    const epilogue_t* ep; // Biases and activation
+    int fused; // 1 passes ep to gebp, 0 applies it to C afterwards
+    blocking_t blocking; // Blocking for gebp
+    int threads; // Threads for gebp and the separate pass
+} epilogue_job_t;
+
+/**
+ * Runs an epilogue_t job. The separate pass splits the columns among the
+ * threads, as a pipeline would.
+ */
+static void run_epilogue(void* ctx)
+{
+    epilogue_job_t* job = (epilogue_job_t*)ctx;
+    const blocking_t* b = &job->blocking;
+    int n = job->N;
+
+    gebp(n, n, n, 1.0, job->A, n, job->B, n, 0.0, job->C, n, job->fused ? job->ep : NULL, 
+         b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, job->threads, NULL);
+
+    if (!job->fused) 
+    {
+        #pragma omp parallel num_threads(job->threads)
+        {
+            int tid = omp_get_thread_num(), nthreads = omp_get_num_threads();
+            int first = (int)((long)n * tid / nthreads), last = (int)((long)n * (tid + 1) / nthreads);
+            epilogue_t part = *job->ep;
+            part.col_bias = (job->ep->col_bias != NULL) ? (const double*)job->ep->col_bias + first : NULL;
+            apply_epilogue(job->C + (size_t)first * n, n, n, last - first, &part);
+        }
+    }
+}
+
+/**
+ * A square product with transposed operands for bench_run, packed in place
+ * or, as dgemm used to, after copying the transposed operands.
+ */
+typedef struct
+{
+    int N; // Problem size
+    const double* A; // N x N, stored transposed when transA
+    const double* B; // N x N, stored transposed when transB
+    double* C; // N x N
+    int transA; // 1 when A holds op(A)^T
+    int transB; // 1 when B holds op(B)^T
+    int copy; // 1 transposes into scratch matrices before calling gebp
+    blocking_t blocking; // Blocking for gebp
+    int threads; // Threads for gebp
+} layout_job_t;
+
+/**
+ * Returns a new n x n matrix holding the transpose of X.
+ */
+static double* transpose_copy(const double* X, int n)
+{
+    double* T = (double*)malloc((size_t)n * n * sizeof(double));
+
+    for (int i = 0; i < n; i++) 
+    {
+        for (int j = 0; j < n; j++) 
+        {
+            T[(size_t)j * n + i] = X[(size_t)i * n + j];
+        }
+    }
+    return T;
+}
+
+/**
+ * Runs a layout_job_t.
+ */
+static void run_layout(void* ctx)
+{
+    layout_job_t* job = (layout_job_t*)ctx;
+    const blocking_t* b = &job->blocking;
+    int n = job->N;
+
+    if (job->copy) 
+    {
+        double* A_t = job->transA ? transpose_copy(job->A, n) : NULL;
+        double* B_t = job->transB ? transpose_copy(job->B, n) : NULL;
+        gebp(n, n, n, 1.0, A_t ? A_t : job->A, n, B_t ? B_t : job->B, n, 0.0, job->C, n, NULL, 
+             b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, job->threads, NULL);
+        free(A_t);
+        free(B_t);
+        return;
+    }
+
+    gebp_strided(n, n, n, 1.0, job->A, job->transA ? n : 1, job->transA ? 1 : n, job->B, job->transB ? n : 1, job->transB ? 1 : n, 
+                 0.0, job->C, n, NULL, b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, job->threads, NULL);
+}
+
+/**
+ * An integer product for bench_run, dequantized to Y when q is not NULL.
+ */
+typedef struct
+{
+    int itype; // ITYPE_INT8 or ITYPE_INT16
+    int N; // Problem size
+    const void* A; // N x N of the operand type
+    const void* B; // N x N of the operand type
+    int32_t* C; // N x N
+    const quant_epilogue_t* q; // Scales, zero points and Y, or NULL
+    const ikernel_t* kernel; // Microkernel
+    int threads; // Threads for the product
+} int_job_t;
+
+/**
+ * Runs an int_job_t.
+ */
+static void run_int(void* ctx)
+{
+    int_job_t* job = (int_job_t*)ctx;
+    int n = job->N;
+
+    if (job->itype == ITYPE_INT8) 
+    {
+        gemm_s8s8s32(n, n, n, (const int8_t*)job->A, n, (const int8_t*)job->B, n, job->C, n, job->q, job->kernel, NULL, job->threads);
+    }
+    else 
+    {
+        gemm_s16s16s32(n, n, n, (const int16_t*)job->A, n, (const int16_t*)job->B, n, job->C, n, job->q, job->kernel, NULL, job->threads);
+    }
+}
+
+/**
+ * One syrk, symm or trmm call for bench_run.
+ */
+typedef struct
+{
+    const char* routine; // "syrk", "symm" or "trmm"
+    int N; // Problem size
+    const double* A; // N x N; symm and trmm read its lower triangle only
+    const double* B; // N x N operand of symm, or the B trmm starts from
+    double* C; // N x N result: C of syrk and symm, B of trmm
+    blocking_t blocking; // Blocking to run with
+    int threads; // Threads for the routine
+} level3_job_t;
 
 /**
- * Max Clock Frequency of CPU core.
- *  (Frequency in GHz) x (# doubles in AVX size)
- *  x (2 for FMA instruction) x (# of AVX units)
+ * Runs a level3_job_t: C = A * A^T (lower triangle), C = A * B with A
+ * symmetric, or C = A * C with A lower triangular.
  */
-#define MAX_FLOPS (MAX_FREQ * 4 * 2 * 2) // Max Gflops per core of CPU
+static void run_level3(void* ctx)
+{
+    level3_job_t* job = (level3_job_t*)ctx;
+    int n = job->N;
+
+    if (strcmp(job->routine, "syrk") == 0) 
+    {
+        syrk('L', 'N', n, n, 1.0, job->A, n, 0.0, job->C, n, &job->blocking, job->threads);
+    }
+    else if (strcmp(job->routine, "symm") == 0) 
+    {
+        symm('L', 'L', n, n, 1.0, job->A, n, job->B, n, 0.0, job->C, n, &job->blocking, job->threads);
+    }
+    else 
+    {
+        trmm('L', 'L', 'N', 'N', n, n, 1.0, job->A, n, job->C, n, &job->blocking, job->threads);
+    }
+}
 
 /**
- * ## GEBP Algorithm
- * 
- * Performs a blocked matrix multiplication using the Generalized Blocked Panel algorithm. 
- * Matrices A, B, and C are stored in column-major order. The function breaks the 
- * matrices into smaller blocks that fit into the L1 and L2 caches.
- * @param N The dimension of A,B,C
- * @param A Matrix A
- * @param B Matrix B
- * @param C Matrix C
- * @param m_c Number of rows of A and C to process at one time
- * @param k_c How many columns of A and rows of B to process at a time.
- * @param n_r Number of columns of B and C to process at a time.
- * @param m_r Number of rows within A and C that fits into registers.
+ * Restores the operand trmm overwrites, untimed.
  */
-void gebp(int N, double* A, double* B, double* C, int m_c, int k_c, int n_r, int m_r) 
+static void reset_level3(void* ctx)
 {
-    
-    double* A_block = (double*)malloc(m_c * k_c * sizeof(double)); // Block of A: m_c x k_c
-    double* B_sliver = (double*)malloc(k_c * n_r * sizeof(double)); // Block of B: k_c x n_r
-    double* C_block = (double*)malloc(m_c * n_r * sizeof(double)); // Block of C: m_c x n_r 
+    level3_job_t* job = (level3_job_t*)ctx;
 
-    // Loop over the i dimension (rows of A and C)
-    for (int i_block = 0; i_block < N; i_block += m_c) 
+    if (strcmp(job->routine, "trmm") == 0) 
     {
-        // Loop over the k dimension (columns of A and rows of B)
-        for (int k_block = 0; k_block < N; k_block += k_c) 
+        memcpy(job->C, job->B, (size_t)job->N * job->N * sizeof(double));
+    }
+}
+
+/**
+ * Returns element i of an int8 or int16 matrix.
+ */
+static int int_entry(int itype, const void* X, size_t i)
+{
+    return (itype == ITYPE_INT8) ? ((const int8_t*)X)[i] : ((const int16_t*)X)[i];
+}
+
+/**
+ * Returns max |X - Y| / max |Y| over n elements.
+ */
+static double relative_error(const double* X, const double* Y, size_t n)
+{
+    double diff = 0.0, norm = 0.0;
+
+    for (size_t i = 0; i < n; i++) 
+    {
+        double d = fabs(X[i] - Y[i]);
+        diff = (d > diff) ? d : diff;
+        norm = (fabs(Y[i]) > norm) ? fabs(Y[i]) : norm;
+    }
+    return (norm > 0.0) ? diff / norm : diff;
+}
+
+/**
+ * Opens a CSV file for writing, printing why if it cannot.
+ */
+static FILE* open_csv(const char* path)
+{
+    FILE* fp = fopen(path, "w"); 
+    if (fp == NULL) 
+    {
+        fprintf(stderr, "Unable to open %s for writing: ", path);
+        perror(NULL);
+    }
+    return fp;
+}
+
+/**
+ * What every table is run with.
+ */
+typedef struct
+{
+    const bench_options_t* opts; // Parsed options
+    const roofline_t* roof; // Measured ceilings for the utilization columns
+    const blocking_t* tuned; // Blocking of every precision, indexed by DTYPE_*
+} table_env_t;
+
+/**
+ * Awkward shapes with the best double blocking, to show the cost of the fringe tiles.
+ */
+static void run_fringe_table(const table_env_t* env, FILE* fp)
+{
+    const bench_options_t* opts = env->opts;
+    const roofline_t* roof = env->roof;
+    blocking_t best = env->tuned[DTYPE_DOUBLE];
+
+    int shapes[][3] = {
+        {1024, 1024, 1024}, // round reference
+        {1021, 1021, 1021}, // prime
+        {1023, 1023, 1023}, // odd, one short of round
+        {1025, 1025, 1025}, // odd, one past round
+        {1009, 1013, 1019}, // distinct primes
+        {8191, 37, 1024},   // tall-skinny C
+        {37, 8191, 1024},   // short-wide C
+        {1024, 1024, 37},   // thin inner dimension
+    };
+    int m_r = best.m_r, n_r = best.n_r;
+    double round_gflops = 0.0;
+
+    printf("Fringe sweep with m_c = %d, k_c = %d, n_c = %d, n_r = %d, m_r = %d\n", best.m_c, best.k_c, best.n_c, n_r, m_r);
+    printf("%6s %6s %6s %10s %10s %8s %10s %12s %10s\n", "M", "N", "K", "gflops", "p95 gflops", "util", "flop/byte", "edge tiles", "vs round");
+    fprintf(fp, "M,N,K,gflops,time (seconds),util,intensity (flop/byte),bw util,roof util,edge tiles (%%),vs round," BENCH_STATS_HEADER "\n");
+
+    for (int s = 0; s < sizeof(shapes)/sizeof(shapes[0]); s++) 
+    {
+        int sm = shapes[s][0], sn = shapes[s][1], sk = shapes[s][2];
+        double* As = (double*)malloc((size_t)sm * sk * sizeof(double));
+        double* Bs = (double*)malloc((size_t)sk * sn * sizeof(double));
+        double* Cs = (double*)calloc((size_t)sm * sn, sizeof(double));
+
+        for (size_t i = 0; i < (size_t)sm * sk; i++) { As[i] = rand() % 10; }
+        for (size_t i = 0; i < (size_t)sk * sn; i++) { Bs[i] = rand() % 10; }
+
+        gebp_job_t job = {DTYPE_DOUBLE, sm, sn, sk, As, Bs, Cs, best, 1};
+        bench_stats_t stats = bench_run(opts, run_gebp, NULL, &job);
+
+        double delta_t = stats.median; // runtime of algo
+        double g_flops = ((double) sm * sn * sk * 2 / delta_t) / 1e9; // gigflops of algorithm
+        double util = g_flops / roof->peak_core; // share of the compute ceiling
+        double intensity = 2.0 * sm * sn * sk / gemm_traffic_bytes(sm, sn, sk, best.k_c, best.n_c, sizeof(double));
+        double bw_util = g_flops / intensity / roof->bandwidth_core; // share of the bandwidth ceiling
+        double roof_util = g_flops / roofline_bound(roof->peak_core, roof->bandwidth_core, intensity); // share of the roofline at this intensity
+
+        // Share of register tiles that are cut by the edges of C (counts m_c block edges too)
+        long tiles_m = 0, full_m = 0;
+        for (int i = 0; i < sm; i += best.m_c) 
+        {
+            int m_b = (sm - i < best.m_c) ? sm - i : best.m_c;
+            tiles_m += (m_b + m_r - 1) / m_r;
+            full_m += m_b / m_r;
+        }
+        long tiles_n = (sn + n_r - 1) / n_r, full_n = sn / n_r;
+        double edge = 100.0 * (1.0 - (double)(full_m * full_n) / (double)(tiles_m * tiles_n));
+
+        if (s == 0) { round_gflops = g_flops; }
+
+        printf("%6d %6d %6d %10.3f %10.3f %8.4f %10.2f %11.2f%% %10.3f\n", sm, sn, sk, g_flops, 
+               ((double) sm * sn * sk * 2 / stats.p95) / 1e9, util, intensity, edge, g_flops / round_gflops);
+        fprintf(fp, "%d,%d,%d,%lf,%f,%lf,%lf,%lf,%lf,%lf,%lf,", sm, sn, sk, g_flops, delta_t, util, intensity, bw_util, roof_util, edge, g_flops / round_gflops);
+        bench_fprint_stats(fp, &stats);
+        fprintf(fp, "\n");
+
+        free(As);
+        free(Bs);
+        free(Cs);
+    }
+}
+
+/**
+ * Strong scaling of the tuned blockings from 1 to opts->threads cores, for
+ * every precision and size.
+ */
+static void run_scaling_table(const table_env_t* env, FILE* fp)
+{
+    const bench_options_t* opts = env->opts;
+    const roofline_t* roof = env->roof;
+
+    int max_n = 0;
+    for (int s = 0; s < opts->num_sizes; s++) 
+    {
+        max_n = (opts->sizes[s] > max_n) ? opts->sizes[s] : max_n;
+    }
+
+    // Sized for the widest element type, refilled for each precision
+    double* A = (double*)alloc_matrix((size_t)max_n * max_n, sizeof(double complex), opts->huge_pages); // A matrix
+    double* B = (double*)alloc_matrix((size_t)max_n * max_n, sizeof(double complex), opts->huge_pages); // B matrix
+    double* C = (double*)alloc_matrix((size_t)max_n * max_n, sizeof(double complex), opts->huge_pages); // C matrix
+
+    fprintf(fp, "precision,N,threads,gflops,gflops per core,time (seconds),util,intensity (flop/byte),bw util,roof util," BENCH_STATS_HEADER "\n");
+
+    for (int p = 0; p < PRECISION_COUNT; p++) 
+    {
+        int dtype = precisions[p];
+        const blocking_t* t = &env->tuned[dtype];
+        random_fill(dtype, A, (size_t)max_n * max_n);
+        random_fill(dtype, B, (size_t)max_n * max_n);
+
+        printf("Strong scaling in %s with m_c = %d, k_c = %d, n_c = %d, n_r = %d, m_r = %d\n", dtype_name(dtype), t->m_c, t->k_c, t->n_c, t->n_r, t->m_r);
+        printf("%6s %8s %10s %12s %10s %10s %8s %8s\n", "N", "threads", "gflops", "gflops/core", "time", "p95 time", "util", "bw util");
+
+        for (int s = 0; s < opts->num_sizes; s++) 
         {
-            load_A(A_block, A, N, m_c, k_c, i_block, k_block);
+            int n = opts->sizes[s];
+            double flops = (double)dtype_flops(dtype) * n * n * n;
 
-            // Loop over the j dimension (columns of B and C)
-            for (int j_block = 0; j_block < N; j_block += n_r) 
+            for (int threads = 1; threads <= opts->threads; threads++) 
             {
-                load_B(B_sliver, B, N, k_c, n_r, j_block, k_block);
-                load_C(C_block, C, N, m_c, n_r, i_block, j_block);
-                multiply_blocks_avx(A_block, B_sliver, C_block, m_c, k_c, n_r, m_r);
-                store_C(C_block, C, N, m_c, n_r, i_block, j_block);
+                gebp_job_t job = {dtype, n, n, n, A, B, C, *t, threads};
+                bench_stats_t stats = bench_run(opts, run_gebp, NULL, &job);
+
+                double delta_t = stats.median; // runtime of algo
+                double g_flops = (flops / delta_t) / 1e9; // gigflops of algorithm
+                double intensity = flops / gemm_traffic_bytes(n, n, n, t->k_c, t->n_c, (int)dtype_size(dtype));
+
+                // Ceilings of the cores used: one core times threads, capped by the all core measurement
+                double peak = (roof->peak_core * threads < roof->peak_all) ? roof->peak_core * threads : roof->peak_all;
+                double bandwidth = (roof->bandwidth_core * threads < roof->bandwidth_all) ? roof->bandwidth_core * threads : roof->bandwidth_all;
+                double util = g_flops / (peak * peak_scale(dtype)); // share of the compute ceiling of all cores used
+                double bw_util = g_flops / intensity / bandwidth; // share of their bandwidth ceiling
+                double roof_util = g_flops / roofline_bound(peak * peak_scale(dtype), bandwidth, intensity); // share of their roofline at this intensity
+
+                printf("%6d %8d %10.3f %12.3f %10.4f %10.4f %8.4f %8.4f\n", n, threads, g_flops, g_flops / threads, delta_t, stats.p95, util, bw_util);
+                fprintf(fp, "%s,%d,%d,%lf,%lf,%f,%lf,%lf,%lf,%lf,", dtype_name(dtype), n, threads, g_flops, g_flops / threads, delta_t, util, intensity, bw_util, roof_util);
+                bench_fprint_stats(fp, &stats);
+                fprintf(fp, "\n");
             }
         }
     }
 
-    free(A_block);
-    free(B_sliver);
-    free(C_block);
+    free(A);
+    free(B);
+    free(C);
 }
 
+/**
+ * Strassen-Winograd against the classic path, for every size and a range
+ * of crossovers.
+ */
+static void run_strassen_table(const table_env_t* env, FILE* fp)
+{
+    const bench_options_t* opts = env->opts;
+    blocking_t best = env->tuned[DTYPE_DOUBLE];
 
-int main(int argc, char* argv[]) 
+    printf("Strassen-Winograd with %d threads\n", opts->threads);
+    printf("%6s %10s %6s %10s %10s %8s %12s\n", "N", "crossover", "depth", "eff gflops", "time", "speedup", "rel error");
+    fprintf(fp, "N,crossover,depth,effective gflops,time (seconds),speedup,max rel error," BENCH_STATS_HEADER "\n");
+
+    for (int s = 0; s < opts->num_sizes; s++) 
+    {
+        int n = opts->sizes[s];
+        size_t count = (size_t)n * n;
+
+        // Values in [-1, 1) so that rounding errors show (small integers multiply exactly)
+        double* As = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Bs = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Cs = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* C_ref = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        for (size_t i = 0; i < count; i++) 
+        {
+            As[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            Bs[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+
+        gebp_job_t classic = {DTYPE_DOUBLE, n, n, n, As, Bs, C_ref, best, opts->threads};
+        bench_stats_t classic_stats = bench_run(opts, run_gebp, NULL, &classic);
+        double flops = 2.0 * n * n * n;
+
+        printf("%6d %10s %6d %10.3f %10.4f %8.3f %12.3e\n", n, "classic", 0, flops / classic_stats.median / 1e9, classic_stats.median, 1.0, 0.0);
+        fprintf(fp, "%d,0,0,%lf,%f,%lf,%e,", n, flops / classic_stats.median / 1e9, classic_stats.median, 1.0, 0.0);
+        bench_fprint_stats(fp, &classic_stats);
+        fprintf(fp, "\n");
+
+        for (int crossover = n / 2; crossover >= STRASSEN_MIN_CROSSOVER; crossover /= 2) 
+        {
+            double* work = (double*)malloc((strassen_workspace(n, n, n, crossover) + 1) * sizeof(double));
+            strassen_job_t job = {n, As, Bs, Cs, best, crossover, opts->threads, work};
+            bench_stats_t stats = bench_run(opts, run_strassen, NULL, &job);
+
+            double error = relative_error(Cs, C_ref, count);
+            double gflops = flops / stats.median / 1e9; // effective, counted as 2 N^3
+            int depth = strassen_depth(n, n, n, crossover);
+
+            printf("%6d %10d %6d %10.3f %10.4f %8.3f %12.3e\n", n, crossover, depth, gflops, stats.median, classic_stats.median / stats.median, error);
+            fprintf(fp, "%d,%d,%d,%lf,%f,%lf,%e,", n, crossover, depth, gflops, stats.median, classic_stats.median / stats.median, error);
+            bench_fprint_stats(fp, &stats);
+            fprintf(fp, "\n");
+            free(work);
+        }
+
+        free(As);
+        free(Bs);
+        free(Cs);
+        free(C_ref);
+    }
+}
+
+/**
+ * Batched small products against a loop of gebp calls on the same matrices.
+ */
+static void run_batch_table(const table_env_t* env, FILE* fp)
 {
-    int debug = 0;
-    int N = DEFAULT_N;
+    const bench_options_t* opts = env->opts;
+    blocking_t best = env->tuned[DTYPE_DOUBLE];
 
-    double* A = (double*)malloc(N * N * sizeof(double)); // A matrix
-    double* B = (double*)malloc(N * N * sizeof(double)); // B matrix
-    double* C = (double*)malloc(N * N * sizeof(double)); // C matrix
+    printf("Batched GEMM against a loop of single-threaded gebp calls, both on %d threads\n", opts->threads);
+    printf("%4s %8s %18s %12s %12s %8s %12s\n", "n", "batch", "kernel", "batch gflops", "loop gflops", "speedup", "rel error");
+    fprintf(fp, "n,batch,kernel,batch gflops,loop gflops,speedup,max rel error," BENCH_STATS_HEADER "\n");
 
-    // Initialize Matricies
-    for (int i = 0; i < N * N; i++) 
+    for (int s = 0; s < BATCH_SIZE_COUNT; s++) 
     {
-        A[i] = rand() % 10;
-        B[i] = rand() % 10;
-        C[i] = rand() % 10;
+        int n = batch_sizes[s];
+        int count = (int)(BATCH_FLOPS / (2L * n * n * n));
+        size_t total = (size_t)count * n * n;
+
+        double* Ab = (double*)malloc(total * sizeof(double));
+        double* Bb = (double*)malloc(total * sizeof(double));
+        double* Cb = (double*)malloc(total * sizeof(double));
+        double* C_ref = (double*)malloc(total * sizeof(double));
+        for (size_t i = 0; i < total; i++) 
+        {
+            Ab[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            Bb[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+
+        batch_job_t loop = {n, count, Ab, Bb, C_ref, best, opts->threads};
+        bench_stats_t loop_stats = bench_run(opts, run_gebp_loop, NULL, &loop);
+        batch_job_t job = {n, count, Ab, Bb, Cb, best, opts->threads};
+        bench_stats_t stats = bench_run(opts, run_batch, NULL, &job);
+
+        double flops = 2.0 * n * n * n * count;
+        double gflops = flops / stats.median / 1e9;
+        double loop_gflops = flops / loop_stats.median / 1e9;
+        double error = relative_error(Cb, C_ref, total);
+        const char* kernel = batch_kernel_name(n, n, n);
+
+        printf("%4d %8d %18s %12.3f %12.3f %8.2f %12.3e\n", n, count, kernel, gflops, loop_gflops, loop_stats.median / stats.median, error);
+        fprintf(fp, "%d,%d,%s,%lf,%lf,%lf,%e,", n, count, kernel, gflops, loop_gflops, loop_stats.median / stats.median, error);
+        bench_fprint_stats(fp, &stats);
+        fprintf(fp, "\n");
+
+        free(Ab);
+        free(Bb);
+        free(Cb);
+        free(C_ref);
     }
+}
 
-    // Create csv file for table
-    FILE* fp = fopen("../output/gotovan.csv", "w"); 
-    if (fp == NULL)
+/**
+ * Bias and activation fused into the kernels against gebp and then a
+ * separate pass over C.
+ */
+static void run_epilogue_table(const table_env_t* env, FILE* fp)
+{
+    const bench_options_t* opts = env->opts;
+    blocking_t best = env->tuned[DTYPE_DOUBLE];
+
+    printf("Epilogues with %d threads: fused into the microkernel against gebp and a separate pass\n", opts->threads);
+    printf("%6s %10s %12s %12s %12s %8s %12s\n", "N", "epilogue", "gemm gflops", "fused", "separate", "speedup", "rel error");
+    fprintf(fp, "N,epilogue,gemm gflops,fused gflops,separate gflops,speedup,max rel error," BENCH_STATS_HEADER "\n");
+
+    for (int s = 0; s < opts->num_sizes; s++) 
     {
-        perror("Unable to open file for writing.");
-        return 1;
+        int n = opts->sizes[s];
+        size_t count = (size_t)n * n;
+
+        double* Ae = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Be = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Ce = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* C_ref = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* row_bias = (double*)malloc(n * sizeof(double));
+        double* col_bias = (double*)malloc(n * sizeof(double));
+        for (size_t i = 0; i < count; i++) 
+        {
+            Ae[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            Be[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+        for (int i = 0; i < n; i++) 
+        {
+            row_bias[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            col_bias[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+
+        gebp_job_t plain = {DTYPE_DOUBLE, n, n, n, Ae, Be, Ce, best, opts->threads};
+        bench_stats_t plain_stats = bench_run(opts, run_gebp, NULL, &plain);
+        double flops = 2.0 * n * n * n;
+
+        for (int a = 0; a < 3; a++) 
+        {
+            epilogue_t ep = {row_bias, col_bias, activations[a]};
+            epilogue_job_t separate = {n, Ae, Be, C_ref, &ep, 0, best, opts->threads};
+            bench_stats_t separate_stats = bench_run(opts, run_epilogue, NULL, &separate);
+            epilogue_job_t fused = {n, Ae, Be, Ce, &ep, 1, best, opts->threads};
+            bench_stats_t stats = bench_run(opts, run_epilogue, NULL, &fused);
+
+            double error = relative_error(Ce, C_ref, count);
+            double speedup = separate_stats.median / stats.median;
+
+            printf("%6d %10s %12.3f %12.3f %12.3f %8.3f %12.3e\n", n, activation_names[a], flops / plain_stats.median / 1e9, 
+                   flops / stats.median / 1e9, flops / separate_stats.median / 1e9, speedup, error);
+            fprintf(fp, "%d,%s,%lf,%lf,%lf,%lf,%e,", n, activation_names[a], flops / plain_stats.median / 1e9, 
+                    flops / stats.median / 1e9, flops / separate_stats.median / 1e9, speedup, error);
+            bench_fprint_stats(fp, &stats);
+            fprintf(fp, "\n");
+        }
+
+        free(Ae);
+        free(Be);
+        free(Ce);
+        free(C_ref);
+        free(row_bias);
+        free(col_bias);
     }
+}
+
+/**
+ * Transposed operands packed in place against transposing them into
+ * scratch first.
+ */
+static void run_layout_table(const table_env_t* env, FILE* fp)
+{
+    const bench_options_t* opts = env->opts;
+    blocking_t best = env->tuned[DTYPE_DOUBLE];
+
+    printf("Operand layouts with %d threads: packed in place against a transposed copy\n", opts->threads);
+    printf("%6s %7s %12s %12s %8s %12s\n", "N", "layout", "in place", "copy", "speedup", "rel error");
+    fprintf(fp, "N,layout,in place gflops,copy gflops,speedup,max rel error," BENCH_STATS_HEADER "\n");
+
+    for (int s = 0; s < opts->num_sizes; s++) 
+    {
+        int n = opts->sizes[s];
+        size_t count = (size_t)n * n;
+
+        double* Al = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Bl = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Cl = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* C_ref = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        for (size_t i = 0; i < count; i++) 
+        {
+            Al[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            Bl[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+        double* Al_t = transpose_copy(Al, n);
+        double* Bl_t = transpose_copy(Bl, n);
+
+        gebp(n, n, n, 1.0, Al, n, Bl, n, 0.0, C_ref, n, NULL, best.m_c, best.k_c, best.n_c, best.n_r, best.m_r, best.prefetch, opts->threads, NULL);
+        double flops = 2.0 * n * n * n;
+
+        // transA and transB from the bits of the combination: NN, TN, NT, TT
+        for (int c = 0; c < 4; c++) 
+        {
+            int ta = c & 1, tb = c >> 1;
+            char layout[3] = {ta ? 'T' : 'N', tb ? 'T' : 'N', '\0'};
+
+            layout_job_t copy = {n, ta ? Al_t : Al, tb ? Bl_t : Bl, Cl, ta, tb, 1, best, opts->threads};
+            bench_stats_t copy_stats = bench_run(opts, run_layout, NULL, &copy);
+            layout_job_t job = {n, ta ? Al_t : Al, tb ? Bl_t : Bl, Cl, ta, tb, 0, best, opts->threads};
+            bench_stats_t stats = bench_run(opts, run_layout, NULL, &job);
 
-    // Check if in debug mode or not
-    if (argc > 1)
-    { 
-        debug = atoi(argv[1]);
+            double error = relative_error(Cl, C_ref, count);
+            double speedup = copy_stats.median / stats.median;
+
+            printf("%6d %7s %12.3f %12.3f %8.3f %12.3e\n", n, layout, flops / stats.median / 1e9, flops / copy_stats.median / 1e9, speedup, error);
+            fprintf(fp, "%d,%s,%lf,%lf,%lf,%e,", n, layout, flops / stats.median / 1e9, flops / copy_stats.median / 1e9, speedup, error);
+            bench_fprint_stats(fp, &stats);
+            fprintf(fp, "\n");
+        }
+
+        free(Al);
+        free(Bl);
+        free(Cl);
+        free(C_ref);
+        free(Al_t);
+        free(Bl_t);
     }
+}
 
-    int kc_sizes[] = {N/32, N/30, N/28, N/24, N/20}; // Different sizes of columns of block A
-    int mr_sizes[] = {4, 8, 16, 32, 96}; // Different sizes of register blocking batches
-    int nr_sizes[] = {4, 8, 16};  // Different sizes of number of rows in Block B
+/**
+ * int8 and int16 products with int32 sums, plain and dequantized, against
+ * double precision gebp.
+ */
+static void run_int_table(const table_env_t* env, FILE* fp)
+{
+    const bench_options_t* opts = env->opts;
+    blocking_t best = env->tuned[DTYPE_DOUBLE];
 
-    printf("Debug mode: %s\n", debug ? "ON" : "OFF");
-    fprintf(fp, "kc/mc,nr,mr,gflops,time (seconds),util, A block (KB), B Sliver (KB)\n");
+    printf("Integer GEMM with %d threads: GOPS of each kernel, plain and dequantized, against double gebp GFLOPS\n", opts->threads);
+    printf("%6s %6s %16s %10s %10s %12s %8s %10s %12s\n", "N", "type", "kernel", "gops", "quantized", "gebp gflops", "vs gebp", "mismatches", "Y rel error");
+    fprintf(fp, "N,type,kernel,gops,quantized gops,gebp gflops,vs gebp,mismatches,max Y rel error," BENCH_STATS_HEADER "\n");
 
-    // Loop over different k_c, n_r, and m_r sizes
-    for (int kc_index = 0; kc_index < sizeof(kc_sizes)/sizeof(kc_sizes[0]); kc_index++)
+    for (int s = 0; s < opts->num_sizes; s++) 
     {
-        for (int mr_index = 0; mr_index < sizeof(mr_sizes)/sizeof(mr_sizes[0]); mr_index++)
+        int n = opts->sizes[s];
+        size_t count = (size_t)n * n;
+        double ops = 2.0 * n * n * n;
+
+        double* Ad = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Bd = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Cd = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        for (size_t i = 0; i < count; i++) 
+        {
+            Ad[i] = 2.0 * rand() / RAND_MAX - 1.0;
+            Bd[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
+        gebp_job_t plain = {DTYPE_DOUBLE, n, n, n, Ad, Bd, Cd, best, opts->threads};
+        double gebp_gflops = ops / bench_run(opts, run_gebp, NULL, &plain).median / 1e9;
+        free(Ad);
+        free(Bd);
+        free(Cd);
+
+        // Per-row and per-column scales and zero points, as from asymmetric quantization
+        float* row_scale = (float*)malloc(n * sizeof(float));
+        float* col_scale = (float*)malloc(n * sizeof(float));
+        int32_t* row_zero = (int32_t*)malloc(n * sizeof(int32_t));
+        int32_t* col_zero = (int32_t*)malloc(n * sizeof(int32_t));
+        for (int i = 0; i < n; i++) 
         {
-            for (int nr_index = 0; nr_index < sizeof(nr_sizes)/sizeof(nr_sizes[0]); nr_index++)
+            row_scale[i] = (float)(0.5 + rand() % 100 / 100.0) / 127.0f;
+            col_scale[i] = (float)(0.5 + rand() % 100 / 100.0) / 127.0f;
+            row_zero[i] = rand() % 7 - 3;
+            col_zero[i] = rand() % 7 - 3;
+        }
+
+        for (int t = 0; t < ITYPE_COUNT; t++) 
+        {
+            // int8 covers its full range, -128 to 127; int16 stays within +-100 so that n products sum within int32
+            int size = (t == ITYPE_INT8) ? 1 : 2, low = (t == ITYPE_INT8) ? -128 : -100, span = (t == ITYPE_INT8) ? 256 : 201;
+            void* Ai = alloc_matrix(count, size, opts->huge_pages);
+            void* Bi = alloc_matrix(count, size, opts->huge_pages);
+            int32_t* Ci = (int32_t*)alloc_matrix(count, sizeof(int32_t), opts->huge_pages);
+            float* Y = (float*)alloc_matrix(count, sizeof(float), opts->huge_pages);
+            for (size_t i = 0; i < count; i++) 
             {
-                
-                printf("---------------------------------------\n");
-                int k_c = kc_sizes[kc_index]; // columns in block a 
-                int m_c = k_c; // of rows in block A and C
-                int m_r = mr_sizes[mr_index]; // of registers for register blocking
-                int n_r = nr_sizes[nr_index]; // of columns in block B and C
-
-                if (m_r > k_c || m_r == m_c/2) 
-                { 
-                    printf("m_r cannot exceed the size of k_c.");
-                    printf("Nor can m_r = k_c/2. Choose a different size of N or change size of m_r.\n");
-                    return 1;
+                int a = rand() % span + low, b = rand() % span + low;
+                if (t == ITYPE_INT8) 
+                {
+                    ((int8_t*)Ai)[i] = (int8_t)a;
+                    ((int8_t*)Bi)[i] = (int8_t)b;
+                }
+                else 
+                {
+                    ((int16_t*)Ai)[i] = (int16_t)a;
+                    ((int16_t*)Bi)[i] = (int16_t)b;
                 }
+            }
+            quant_epilogue_t q = {row_scale, col_scale, row_zero, col_zero, Y, n};
+
+            const ikernel_t* kernels[8];
+            int num_kernels = supported_ikernels(t, kernels, 8);
+            for (int k = 0; k < num_kernels; k++) 
+            {
+                int_job_t job = {t, n, Ai, Bi, Ci, NULL, kernels[k], opts->threads};
+                bench_stats_t stats = bench_run(opts, run_int, NULL, &job);
+                int_job_t quantized = {t, n, Ai, Bi, Ci, &q, kernels[k], opts->threads};
+                bench_stats_t q_stats = bench_run(opts, run_int, NULL, &quantized);
 
-                // Reset C matrix to 0 before each run
-                for (int i = 0; i < N * N; i++) 
+                // C must be exact, Y as close as float allows
+                int mismatches = 0;
+                double diff = 0.0, norm = 0.0;
+                for (int c = 0; c < INT_SAMPLES; c++) 
                 {
-                    C[i] = 0.0;
+                    int i = (int)(((long)c * 7919) % n), j = (int)(((long)c * 104729 + c) % n);
+                    long long dot = 0, shifted = 0;
+                    for (int p = 0; p < n; p++) 
+                    {
+                        long long a = int_entry(t, Ai, (size_t)p * n + i), b = int_entry(t, Bi, (size_t)j * n + p);
+                        dot += a * b;
+                        shifted += (a - row_zero[i]) * (b - col_zero[j]);
+                    }
+                    double y = (double)shifted * row_scale[i] * col_scale[j];
+                    mismatches += (Ci[(size_t)j * n + i] != (int32_t)dot);
+                    diff = (fabs(Y[(size_t)j * n + i] - y) > diff) ? fabs(Y[(size_t)j * n + i] - y) : diff;
+                    norm = (fabs(y) > norm) ? fabs(y) : norm;
                 }
+                double error = (norm > 0.0) ? diff / norm : diff;
+                double gops = ops / stats.median / 1e9;
+
+                printf("%6d %6s %16s %10.3f %10.3f %12.3f %8.3f %10d %12.3e\n", n, itype_name(t), kernels[k]->name, gops, 
+                       ops / q_stats.median / 1e9, gebp_gflops, gops / gebp_gflops, mismatches, error);
+                fprintf(fp, "%d,%s,%s,%lf,%lf,%lf,%lf,%d,%e,", n, itype_name(t), kernels[k]->name, gops, 
+                        ops / q_stats.median / 1e9, gebp_gflops, gops / gebp_gflops, mismatches, error);
+                bench_fprint_stats(fp, &stats);
+                fprintf(fp, "\n");
+            }
+
+            free(Ai);
+            free(Bi);
+            free(Ci);
+            free(Y);
+        }
+
+        free(row_scale);
+        free(col_scale);
+        free(row_zero);
+        free(col_zero);
+    }
+}
 
-                if (debug == 1) {print_matrix(A, N,N, "A");}
-                if (debug == 1) {print_matrix(B, N,N, "B");}
+/**
+ * SYRK, SYMM and TRMM against gebp on the full n x n x n product, counting
+ * only the flops they need.
+ */
+static void run_level3_table(const table_env_t* env, FILE* fp)
+{
+    const bench_options_t* opts = env->opts;
+    blocking_t best = env->tuned[DTYPE_DOUBLE];
 
-                printf("Matrix Sizes: %dx%d\n", N,N);
-                printf("Block Sizes: m_c = %d, k_c = %d, n_r = %d, m_r = %d\n", m_c, k_c, n_r, m_r);
+    const char* routines[] = {"syrk", "symm", "trmm"};
+    printf("Symmetric and triangular routines with %d threads, effective GFLOPS against the full gebp\n", opts->threads);
+    printf("%6s %8s %10s %10s %10s %8s %12s\n", "N", "routine", "eff gflops", "time", "gebp time", "speedup", "rel error");
+    fprintf(fp, "N,routine,flops,effective gflops,time (seconds),gebp time (seconds),speedup,max rel error," BENCH_STATS_HEADER "\n");
 
-                struct timespec start, end;
-                clock_gettime(CLOCK_MONOTONIC, &start);
-                gebp(N, A, B, C, m_c, k_c, n_r, m_r);
-                clock_gettime(CLOCK_MONOTONIC, &end);
+    for (int s = 0; s < opts->num_sizes; s++) 
+    {
+        int n = opts->sizes[s];
+        size_t count = (size_t)n * n;
 
-                double delta_t = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9; // runtime of algo
-                double g_flops = ((double) N * N * N * 2 / delta_t) / 1e9; // gigflops of algorithm
-                double util = g_flops / MAX_FLOPS; // utilization of algo
+        // A symmetric A, its lower triangle with zeros above for the triangular reference, and B
+        double* As = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* At = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Bs = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* Cs = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        double* C_ref = (double*)alloc_matrix(count, sizeof(double), opts->huge_pages);
+        for (int j = 0; j < n; j++) 
+        {
+            for (int i = j; i < n; i++) 
+            {
+                As[(size_t)j * n + i] = As[(size_t)i * n + j] = 2.0 * rand() / RAND_MAX - 1.0;
+                At[(size_t)j * n + i] = As[(size_t)j * n + i];
+                At[(size_t)i * n + j] = (i == j) ? At[(size_t)j * n + i] : 0.0;
+            }
+        }
+        for (size_t i = 0; i < count; i++) 
+        {
+            Bs[i] = 2.0 * rand() / RAND_MAX - 1.0;
+        }
 
-                int l1_used = (n_r * m_c * 2 * 8) /1024; // space taken in l1 cache kb
-                int l2_used = (k_c * m_c * 8) /1024; // space taken in l2 cache kb
+        gebp_job_t general = {DTYPE_DOUBLE, n, n, n, As, Bs, C_ref, best, opts->threads};
+        bench_stats_t gebp_stats = bench_run(opts, run_gebp, NULL, &general);
+        double gebp_flops = 2.0 * n * n * n;
 
-                print_performance_info(delta_t,g_flops,util,l1_used,l2_used,L1_SIZE_KB,L2_SIZE_KB,k_c,n_r,m_r,fp);
+        printf("%6d %8s %10.3f %10.4f %10.4f %8.3f %12.3e\n", n, "gebp", gebp_flops / gebp_stats.median / 1e9, gebp_stats.median, 
+               gebp_stats.median, 1.0, 0.0);
+        fprintf(fp, "%d,gebp,%e,%lf,%f,%f,%lf,%e,", n, gebp_flops, gebp_flops / gebp_stats.median / 1e9, gebp_stats.median, 
+                gebp_stats.median, 1.0, 0.0);
+        bench_fprint_stats(fp, &gebp_stats);
+        fprintf(fp, "\n");
 
-                if (debug == 1) {print_matrix(C, N,N, "C");}
+        for (int r = 0; r < 3; r++) 
+        {
+            double flops; // Needed flops: half of the product for syrk and trmm, all of it for symm
+
+            // The reference is what gebp computes for the same product today
+            if (r == 0) 
+            {
+                gebp_strided(n, n, n, 1.0, As, 1, n, As, n, 1, 0.0, C_ref, n, NULL,
+                             best.m_c, best.k_c, best.n_c, best.n_r, best.m_r, best.prefetch, opts->threads, NULL);
+                for (int j = 0; j < n; j++) 
+                {
+                    memset(&C_ref[(size_t)j * n], 0, (size_t)j * sizeof(double)); // syrk leaves the upper triangle alone
+                }
+                memset(Cs, 0, count * sizeof(double));
+                flops = (double)n * (n + 1) * n;
+            }
+            else 
+            {
+                gebp(n, n, n, 1.0, (r == 1) ? As : At, n, Bs, n, 0.0, C_ref, n, NULL,
+                     best.m_c, best.k_c, best.n_c, best.n_r, best.m_r, best.prefetch, opts->threads, NULL);
+                flops = (r == 1) ? 2.0 * n * n * n : (double)n * n * (n + 1);
             }
+
+            level3_job_t job = {routines[r], n, As, Bs, Cs, best, opts->threads};
+            bench_stats_t stats = bench_run(opts, run_level3, reset_level3, &job);
+            double error = relative_error(Cs, C_ref, count);
+            double speedup = gebp_stats.median / stats.median;
+
+            printf("%6d %8s %10.3f %10.4f %10.4f %8.3f %12.3e\n", n, routines[r], flops / stats.median / 1e9, stats.median, 
+                   gebp_stats.median, speedup, error);
+            fprintf(fp, "%d,%s,%e,%lf,%f,%f,%lf,%e,", n, routines[r], flops, flops / stats.median / 1e9, stats.median, 
+                    gebp_stats.median, speedup, error);
+            bench_fprint_stats(fp, &stats);
+            fprintf(fp, "\n");
         }
+
+        free(As);
+        free(At);
+        free(Bs);
+        free(Cs);
+        free(C_ref);
     }
+}
 
-    free(A);
-    free(B);
-    free(C);
+/**
+ * A table of gotovan: its name for --tables, also the suffix of its CSV
+ * (PATH_name.csv), and the function that fills it.
+ */
+typedef struct
+{
+    const char* name;
+    void (*run)(const table_env_t* env, FILE* fp);
+} table_t;
+
+static const table_t tables[] = {
+    {"fringe", run_fringe_table},
+    {"scaling", run_scaling_table},
+    {"strassen", run_strassen_table},
+    {"batch", run_batch_table},
+    {"epilogue", run_epilogue_table},
+    {"layout", run_layout_table},
+    {"int", run_int_table},
+    {"level3", run_level3_table},
+};
+#define TABLE_COUNT (int)(sizeof(tables) / sizeof(tables[0]))
+
+/**
+ * Returns 1 if name is in the comma separated list, or if list is NULL.
+ */
+static int table_selected(const char* list, const char* name)
+{
+    if (list == NULL) 
+    {
+        return 1;
+    }
+
+    size_t length = strlen(name);
+    for (const char* p = list; *p != '\0'; ) 
+    {
+        const char* end = strchr(p, ',');
+        size_t n = (end != NULL) ? (size_t)(end - p) : strlen(p);
+        if (n == length && strncmp(p, name, n) == 0) 
+        {
+            return 1;
+        }
+        p += (end != NULL) ? n + 1 : n;
+    }
+    return 0;
+}
+
+/**
+ * Returns 0 if every entry of the comma separated list names a table,
+ * or prints the first one that does not and the table names and returns 1.
+ */
+static int check_tables(const char* list)
+{
+    if (list == NULL) 
+    {
+        return 0;
+    }
+
+    for (const char* p = list; *p != '\0'; ) 
+    {
+        const char* end = strchr(p, ',');
+        int n = (end != NULL) ? (int)(end - p) : (int)strlen(p);
+        int known = 0;
+        for (int t = 0; t < TABLE_COUNT; t++) 
+        {
+            known |= ((int)strlen(tables[t].name) == n && strncmp(p, tables[t].name, n) == 0);
+        }
+        if (!known) 
+        {
+            fprintf(stderr, "Unknown table '%.*s', the tables are:", n, p);
+            for (int t = 0; t < TABLE_COUNT; t++) 
+            {
+                fprintf(stderr, " %s", tables[t].name);
+            }
+            fprintf(stderr, "\n");
+            return 1;
+        }
+        p += (end != NULL) ? n + 1 : n;
+    }
+    return 0;
+}
+
+/**
+ * Picks the blocking of every precision: the wisdom file entry when
+ * opts->use_wisdom is set and it has one for this CPU and microkernel,
+ * otherwise the analytical blocking refined by a short search on N x N,
+ * which is logged to fp and saved to the wisdom file.
+ */
+static void tune_blockings(const bench_options_t* opts, const cache_info_t* cache, const roofline_t* roof, FILE* fp, 
+                           blocking_t tuned[DTYPE_COUNT])
+{
+    int N = opts->sizes[0]; // size the blocking is tuned on
+
+    for (int p = 0; p < PRECISION_COUNT; p++) 
+    {
+        int dtype = precisions[p];
+        const microkernel_t* kernel = select_microkernel(dtype);
+        blocking_t start = analytical_blocking(cache, kernel, (int)dtype_size(dtype));
+        blocking_t stored;
+        int have_wisdom = wisdom_load(wisdom_path(), cpu_model_name(), kernel->name, dtype_name(dtype), &stored)
+                          && find_microkernel(dtype, stored.m_r, stored.n_r) != NULL;
+
+        printf("=======================================\n");
+        printf("Precision: %s, selected microkernel: %s\n", dtype_name(dtype), kernel->name);
+        printf("Analytical blocking: m_c = %d, k_c = %d, n_c = %d\n", start.m_c, start.k_c, start.n_c);
+        if (have_wisdom) 
+        {
+            printf("Current wisdom: m_c = %d, k_c = %d, n_c = %d, prefetch = %d\n", stored.m_c, stored.k_c, stored.n_c, stored.prefetch);
+        }
+
+        // --wisdom runs the tables with the stored blocking instead of tuning again
+        if (opts->use_wisdom && have_wisdom) 
+        {
+            tuned[dtype] = stored;
+            printf("Using the wisdom blocking, not tuning\n");
+            continue;
+        }
+
+        tune_log_t log = {fp, cache, kernel, roof, N};
+        double best_gflops = 0.0;
+        tuned[dtype] = autotune_blocking(kernel, N, 1, TUNE_TRIALS, report_candidate, &log, &best_gflops);
+
+        blocking_t* t = &tuned[dtype];
+        printf("=======================================\n");
+        printf("Tuned %s blocking: m_c = %d, k_c = %d, n_c = %d, n_r = %d, m_r = %d, prefetch = %d, %.3f GFLOPS\n", 
+               dtype_name(dtype), t->m_c, t->k_c, t->n_c, t->n_r, t->m_r, t->prefetch, best_gflops);
+        if (wisdom_save(wisdom_path(), cpu_model_name(), kernel->name, dtype_name(dtype), t, best_gflops) == 0) 
+        {
+            printf("Saved to wisdom file %s\n", wisdom_path());
+        }
+        else 
+        {
+            printf("Unable to write wisdom file %s\n", wisdom_path());
+        }
+    }
+}
+
+int main(int argc, char* argv[]) 
+{
+    bench_options_t opts;
+
+    // Calibration mode only measures and prints the roofline
+    if (argc > 1 && strcmp(argv[1], "calibrate") == 0) 
+    {
+        roofline_t roof = measure_roofline(omp_get_num_procs());
+        print_roofline(&roof);
+        return 0;
+    }
+
+    if (bench_parse_args(argc, argv, &opts, "../output/gotovan.csv", DEFAULT_N) != 0 || check_tables(opts.tables) != 0) 
+    {
+        return 1;
+    }
+    gebp_set_pinning(opts.pin);
+    gebp_set_overlap(opts.overlap);
+
+    FILE* fp = open_csv(opts.output);
+    if (fp == NULL) 
+    {
+        return 1;
+    }
+
+    cache_info_t cache;
+    if (read_cache_info(&cache) != 0) 
+    {
+        printf("Some cache levels are missing from sysfs, using defaults for them.\n");
+    }
+
+    roofline_t roof = measure_roofline(opts.threads);
+
+    printf("Debug mode: %s\n", opts.debug ? "ON" : "OFF");
+    printf("Repetitions: %d (+%d warmup), threads: %d, pinning: %s, cache flush: %s, huge pages: %s, pack overlap: %s\n", 
+           opts.reps, opts.warmup, opts.threads, opts.pin ? "on" : "off", opts.flush ? "on" : "off", opts.huge_pages ? "on" : "off",
+           opts.overlap ? "on" : "off");
+    printf("CPU: %s\n", cpu_model_name());
+    printf("L1d: %d KB %d-way, L2: %d KB %d-way, L3: %d KB %d-way, %d byte lines\n",
+           cache.l1.size / 1024, cache.l1.ways, cache.l2.size / 1024, cache.l2.ways, 
+           cache.l3.size / 1024, cache.l3.ways, cache.l1.line);
+    print_roofline(&roof);
+    if (perf_counters_requested()) 
+    {
+        perf_counters_t pc;
+        printf("Hardware counters: %d of %d events available\n", perf_counters_open(&pc), PERF_EVENTS);
+        perf_counters_close(&pc);
+    }
+
+    fprintf(fp, "kc,mc,nc,nr,mr,prefetch,gflops,time (seconds),pack (seconds),util,intensity (flop/byte),bw util,roof util, A block (KB), B Sliver (KB),precision,kernel");
+    for (int e = 0; e < 2 * PERF_EVENTS; e++) 
+    {
+        fprintf(fp, ",%s %s", (e < PERF_EVENTS) ? "pack" : "compute", perf_event_name(e % PERF_EVENTS));
+    }
+    fprintf(fp, "\n");
+
+    blocking_t tuned[DTYPE_COUNT];
+    tune_blockings(&opts, &cache, &roof, fp, tuned);
     fclose(fp);
+
+    if (opts.debug) 
+    {
+        int N = opts.sizes[0];
+        blocking_t best = tuned[DTYPE_DOUBLE];
+        double* A = (double*)alloc_matrix((size_t)N * N, sizeof(double), opts.huge_pages); // A matrix
+        double* B = (double*)alloc_matrix((size_t)N * N, sizeof(double), opts.huge_pages); // B matrix
+        double* C = (double*)alloc_matrix((size_t)N * N, sizeof(double), opts.huge_pages); // C matrix
+
+        for (size_t i = 0; i < (size_t)N * N; i++) 
+        {
+            A[i] = rand() % 10;
+            B[i] = rand() % 10;
+        }
+
+        gebp(N, N, N, 1.0, A, N, B, N, 0.0, C, N, NULL, best.m_c, best.k_c, best.n_c, best.n_r, best.m_r, best.prefetch, 1, NULL);
+        print_matrix(A, N,N, "A");
+        print_matrix(B, N,N, "B");
+        print_matrix(C, N,N, "C");
+
+        free(A);
+        free(B);
+        free(C);
+    }
+
+    // Every selected table writes its own CSV next to the main one
+    table_env_t env = {&opts, &roof, tuned};
+    for (int t = 0; t < TABLE_COUNT; t++) 
+    {
+        if (!table_selected(opts.tables, tables[t].name)) 
+        {
+            continue;
+        }
+
+        char suffix[32], path[1024];
+        snprintf(suffix, sizeof(suffix), "_%s", tables[t].name);
+        bench_output_path(opts.output, suffix, path, sizeof(path));
+
+        FILE* fp_table = open_csv(path);
+        if (fp_table == NULL) 
+        {
+            return 1;
+        }
+        tables[t].run(&env, fp_table);
+        fclose(fp_table);
+    }
+
     return 0;
-}
\ No newline at end of file
+}
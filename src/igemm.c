@@ -0,0 +1,495 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Integer GEMM for quantized workloads: int8 or int16
+ * operands multiplied with int32 accumulation on the GEBP
+ * blocking of gebp, with per-row and per-column scales and
+ * zero points applied as the tiles are stored.
+ * Everything is column major.
+ */
+
+#include <immintrin.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <omp.h>
+#include "igemm.h"
+#include "arena.h"
+#include "matrix_ops.h"
+#include "tune.h"
+
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_VNNI __attribute__((target("avx512f,avx512bw,avx512vl,avx512vnni")))
+
+static cache_info_t igemm_cache_info; // Cache geometry for ikernel_blocking
+static pthread_once_t igemm_cache_once = PTHREAD_ONCE_INIT;
+
+/**
+ * Reads the cache geometry once.
+ */
+static void igemm_init_cache_info(void)
+{
+    read_cache_info(&igemm_cache_info);
+}
+
+/**
+ * Returns 1 if the AVX512-VNNI kernels can run: the instruction set is
+ * not capped below AVX-512 and the CPU has VNNI and the BW and VL
+ * extensions its 256-bit forms need.
+ */
+static int has_vnni(void)
+{
+    return detect_isa() == ISA_AVX512 && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512vl")
+           && __builtin_cpu_supports("avx512vnni");
+}
+
+/**
+ * Returns element (i, j) of a tile's int32 product after dequantization.
+ */
+static inline float dequantize(int32_t c, const quant_tile_t* q, int i, int j)
+{
+    long long v = c;
+
+    if (q->col_zero != NULL) 
+    {
+        v -= (long long)q->col_zero[j] * q->row_sum[i];
+    }
+    if (q->row_zero != NULL) 
+    {
+        v -= (long long)q->row_zero[i] * q->col_sum[j];
+    }
+
+    double y = (double)v;
+    if (q->row_scale != NULL) { y *= q->row_scale[i]; }
+    if (q->col_scale != NULL) { y *= q->col_scale[j]; }
+    return (float)y;
+}
+
+/**
+ * Stores the m x n corner of an m_r x n_r tile of sums (ab, column by
+ * column) to C, added to C when accumulate is 1, and its dequantized
+ * values to Y when q is not NULL. The kernels use it for edge tiles and
+ * for the last k_c slice of a quantized product.
+ */
+static void store_tile(const int32_t* ab, int m_r, int32_t* C, int ldc, int m, int n, int accumulate, const quant_tile_t* q)
+{
+    for (int j = 0; j < n; j++) 
+    {
+        for (int i = 0; i < m; i++) 
+        {
+            int32_t* c = &C[(size_t)j * ldc + i];
+            uint32_t sum = (uint32_t)ab[j * m_r + i] + (accumulate ? (uint32_t)*c : 0u); // wraps like the kernels
+            *c = (int32_t)sum;
+            if (q != NULL) 
+            {
+                q->Y[(size_t)j * q->ldy + i] = dequantize(*c, q, i, j);
+            }
+        }
+    }
+}
+
+// Packing, the scalar kernel and the driver, once per operand type
+#define ELEM int8_t
+#define KG 4
+#define FN(name) name##_s8
+#include "igemm_template.h"
+#undef ELEM
+#undef KG
+#undef FN
+
+#define ELEM int16_t
+#define KG 2
+#define FN(name) name##_s16
+#include "igemm_template.h"
+#undef ELEM
+#undef KG
+#undef FN
+
+/**
+ * Returns the k_group bytes (four int8 or two int16) at p as one int32,
+ * for broadcasting.
+ */
+static inline int32_t load_group(const void* p)
+{
+    int32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+/**
+ * Writes eight int32 sums to C, added to C when accumulate is 1.
+ */
+TARGET_AVX2 static inline void store_avx2(int32_t* C, __m256i v, int accumulate)
+{
+    if (accumulate) 
+    {
+        v = _mm256_add_epi32(v, _mm256_loadu_si256((const __m256i*)C));
+    }
+    _mm256_storeu_si256((__m256i*)C, v);
+}
+
+/**
+ * Writes sixteen int32 sums to C, added to C when accumulate is 1.
+ */
+TARGET_VNNI static inline void store_avx512(int32_t* C, __m512i v, int accumulate)
+{
+    if (accumulate) 
+    {
+        v = _mm512_add_epi32(v, _mm512_loadu_si512(C));
+    }
+    _mm512_storeu_si512(C, v);
+}
+
+/**
+ * 8x6 int8 register block for AVX2. The bytes are sign extended to int16
+ * (vpmovsxbw) and multiplied by vpmaddwd, which is exact for every int8
+ * value; vpmaddubsw is not, since it needs one operand unsigned. Each
+ * accumulator holds four rows' pair sums, which are added once per tile.
+ */
+TARGET_AVX2 static void ikernel_8x6_avx2_s8(int groups, const void* A_packed, const void* B_packed, int32_t* C, int ldc, int m, int n,
+                                            int accumulate, const quant_tile_t* q)
+{
+    const int8_t* A = (const int8_t*)A_packed;
+    const int8_t* B = (const int8_t*)B_packed;
+    __m256i c0[6], c1[6]; // Pair sums of rows 0-3 and 4-7
+
+    #pragma GCC unroll 6
+    for (int j = 0; j < 6; j++) 
+    {
+        c0[j] = _mm256_setzero_si256();
+        c1[j] = _mm256_setzero_si256();
+    }
+
+    for (int g = 0; g < groups; g++) 
+    {
+        __m256i a0 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)&A[0]));
+        __m256i a1 = _mm256_cvtepi8_epi16(_mm_loadu_si128((const __m128i*)&A[16]));
+
+        #pragma GCC unroll 6
+        for (int j = 0; j < 6; j++) 
+        {
+            // The column's four k, sign extended and repeated for every row
+            __m256i b = _mm256_cvtepi8_epi16(_mm_set1_epi32(load_group(&B[j * 4])));
+            c0[j] = _mm256_add_epi32(c0[j], _mm256_madd_epi16(a0, b));
+            c1[j] = _mm256_add_epi32(c1[j], _mm256_madd_epi16(a1, b));
+        }
+
+        A += 8 * 4;
+        B += 6 * 4;
+    }
+
+    // Add the pairs of each row and put the rows back in order
+    __m256i c[6];
+    #pragma GCC unroll 6
+    for (int j = 0; j < 6; j++) 
+    {
+        c[j] = _mm256_permute4x64_epi64(_mm256_hadd_epi32(c0[j], c1[j]), 0xD8);
+    }
+
+    if (m < 8 || n < 6 || q != NULL) 
+    {
+        int32_t ab[8 * 6];
+        for (int j = 0; j < 6; j++) 
+        {
+            _mm256_storeu_si256((__m256i*)&ab[j * 8], c[j]);
+        }
+        store_tile(ab, 8, C, ldc, m, n, accumulate, q);
+        return;
+    }
+
+    #pragma GCC unroll 6
+    for (int j = 0; j < 6; j++) 
+    {
+        store_avx2(&C[(size_t)j * ldc], c[j], accumulate);
+    }
+}
+
+/**
+ * 16x6 int16 register block for AVX2: vpmaddwd multiplies the two k of
+ * a row of A with the broadcast pair of a column of B and sums them to
+ * int32, twelve accumulators for the tile.
+ */
+TARGET_AVX2 static void ikernel_16x6_avx2_s16(int groups, const void* A_packed, const void* B_packed, int32_t* C, int ldc, int m, int n,
+                                              int accumulate, const quant_tile_t* q)
+{
+    const int16_t* A = (const int16_t*)A_packed;
+    const int16_t* B = (const int16_t*)B_packed;
+    __m256i c0[6], c1[6];
+
+    #pragma GCC unroll 6
+    for (int j = 0; j < 6; j++) 
+    {
+        c0[j] = _mm256_setzero_si256();
+        c1[j] = _mm256_setzero_si256();
+    }
+
+    for (int g = 0; g < groups; g++) 
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i*)&A[0]);
+        __m256i a1 = _mm256_loadu_si256((const __m256i*)&A[16]);
+
+        #pragma GCC unroll 6
+        for (int j = 0; j < 6; j++) 
+        {
+            __m256i b = _mm256_set1_epi32(load_group(&B[j * 2]));
+            c0[j] = _mm256_add_epi32(c0[j], _mm256_madd_epi16(a0, b));
+            c1[j] = _mm256_add_epi32(c1[j], _mm256_madd_epi16(a1, b));
+        }
+
+        A += 16 * 2;
+        B += 6 * 2;
+    }
+
+    if (m < 16 || n < 6 || q != NULL) 
+    {
+        int32_t ab[16 * 6];
+        for (int j = 0; j < 6; j++) 
+        {
+            _mm256_storeu_si256((__m256i*)&ab[j * 16], c0[j]);
+            _mm256_storeu_si256((__m256i*)&ab[j * 16 + 8], c1[j]);
+        }
+        store_tile(ab, 16, C, ldc, m, n, accumulate, q);
+        return;
+    }
+
+    #pragma GCC unroll 6
+    for (int j = 0; j < 6; j++) 
+    {
+        store_avx2(&C[(size_t)j * ldc], c0[j], accumulate);
+        store_avx2(&C[(size_t)j * ldc + 8], c1[j], accumulate);
+    }
+}
+
+/**
+ * 48x8 int8 register block for AVX512-VNNI. vpdpbusd multiplies unsigned
+ * by signed bytes and sums each four into int32 in one instruction, so A
+ * is read as unsigned A + 128 (its sign bit flipped) and 128 times the
+ * column sums of B, gathered with one more vpdpbusd per group, are
+ * subtracted at the end. Exact for all values.
+ */
+TARGET_VNNI static void ikernel_48x8_vnni_s8(int groups, const void* A_packed, const void* B_packed, int32_t* C, int ldc, int m, int n,
+                                             int accumulate, const quant_tile_t* q)
+{
+    const int8_t* A = (const int8_t*)A_packed;
+    const int8_t* B = (const int8_t*)B_packed;
+    const __m512i flip = _mm512_set1_epi8((char)0x80);
+    const __m256i offset = _mm256_set1_epi8((char)0x80);
+    __m256i comp = _mm256_setzero_si256(); // 128 times the sum of each column of B
+    __m512i c0[8], c1[8], c2[8];
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) 
+    {
+        c0[j] = _mm512_setzero_si512();
+        c1[j] = _mm512_setzero_si512();
+        c2[j] = _mm512_setzero_si512();
+    }
+
+    for (int g = 0; g < groups; g++) 
+    {
+        __m512i a0 = _mm512_xor_si512(_mm512_loadu_si512(&A[0]), flip);
+        __m512i a1 = _mm512_xor_si512(_mm512_loadu_si512(&A[64]), flip);
+        __m512i a2 = _mm512_xor_si512(_mm512_loadu_si512(&A[128]), flip);
+
+        comp = _mm256_dpbusd_epi32(comp, offset, _mm256_loadu_si256((const __m256i*)B));
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < 8; j++) 
+        {
+            __m512i b = _mm512_set1_epi32(load_group(&B[j * 4]));
+            c0[j] = _mm512_dpbusd_epi32(c0[j], a0, b);
+            c1[j] = _mm512_dpbusd_epi32(c1[j], a1, b);
+            c2[j] = _mm512_dpbusd_epi32(c2[j], a2, b);
+        }
+
+        A += 48 * 4;
+        B += 8 * 4;
+    }
+
+    int32_t col_comp[8];
+    _mm256_storeu_si256((__m256i*)col_comp, comp);
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) 
+    {
+        __m512i s = _mm512_set1_epi32(col_comp[j]);
+        c0[j] = _mm512_sub_epi32(c0[j], s);
+        c1[j] = _mm512_sub_epi32(c1[j], s);
+        c2[j] = _mm512_sub_epi32(c2[j], s);
+    }
+
+    if (m < 48 || n < 8 || q != NULL) 
+    {
+        int32_t ab[48 * 8];
+        for (int j = 0; j < 8; j++) 
+        {
+            _mm512_storeu_si512(&ab[j * 48], c0[j]);
+            _mm512_storeu_si512(&ab[j * 48 + 16], c1[j]);
+            _mm512_storeu_si512(&ab[j * 48 + 32], c2[j]);
+        }
+        store_tile(ab, 48, C, ldc, m, n, accumulate, q);
+        return;
+    }
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) 
+    {
+        store_avx512(&C[(size_t)j * ldc], c0[j], accumulate);
+        store_avx512(&C[(size_t)j * ldc + 16], c1[j], accumulate);
+        store_avx512(&C[(size_t)j * ldc + 32], c2[j], accumulate);
+    }
+}
+
+/**
+ * 48x8 int16 register block for AVX512-VNNI: vpdpwssd multiplies the two
+ * k of a row of A with the broadcast pair of B and adds them to the
+ * accumulator in one instruction.
+ */
+TARGET_VNNI static void ikernel_48x8_vnni_s16(int groups, const void* A_packed, const void* B_packed, int32_t* C, int ldc, int m, int n,
+                                              int accumulate, const quant_tile_t* q)
+{
+    const int16_t* A = (const int16_t*)A_packed;
+    const int16_t* B = (const int16_t*)B_packed;
+    __m512i c0[8], c1[8], c2[8];
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) 
+    {
+        c0[j] = _mm512_setzero_si512();
+        c1[j] = _mm512_setzero_si512();
+        c2[j] = _mm512_setzero_si512();
+    }
+
+    for (int g = 0; g < groups; g++) 
+    {
+        __m512i a0 = _mm512_loadu_si512(&A[0]);
+        __m512i a1 = _mm512_loadu_si512(&A[32]);
+        __m512i a2 = _mm512_loadu_si512(&A[64]);
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < 8; j++) 
+        {
+            __m512i b = _mm512_set1_epi32(load_group(&B[j * 2]));
+            c0[j] = _mm512_dpwssd_epi32(c0[j], a0, b);
+            c1[j] = _mm512_dpwssd_epi32(c1[j], a1, b);
+            c2[j] = _mm512_dpwssd_epi32(c2[j], a2, b);
+        }
+
+        A += 48 * 2;
+        B += 8 * 2;
+    }
+
+    if (m < 48 || n < 8 || q != NULL) 
+    {
+        int32_t ab[48 * 8];
+        for (int j = 0; j < 8; j++) 
+        {
+            _mm512_storeu_si512(&ab[j * 48], c0[j]);
+            _mm512_storeu_si512(&ab[j * 48 + 16], c1[j]);
+            _mm512_storeu_si512(&ab[j * 48 + 32], c2[j]);
+        }
+        store_tile(ab, 48, C, ldc, m, n, accumulate, q);
+        return;
+    }
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) 
+    {
+        store_avx512(&C[(size_t)j * ldc], c0[j], accumulate);
+        store_avx512(&C[(size_t)j * ldc + 16], c1[j], accumulate);
+        store_avx512(&C[(size_t)j * ldc + 32], c2[j], accumulate);
+    }
+}
+
+// Ordered by operand type and, within one, from the widest instruction set down
+static const ikernel_t ikernels[] = {
+    {"avx512vnni 48x8", ITYPE_INT8, ISA_AVX512, 1, 48, 8, 4, ikernel_48x8_vnni_s8},
+    {"avx2 8x6", ITYPE_INT8, ISA_AVX2, 0, 8, 6, 4, ikernel_8x6_avx2_s8},
+    {"scalar 8x4", ITYPE_INT8, ISA_SCALAR, 0, 8, 4, 4, ikernel_8x4_scalar_s8},
+    {"avx512vnni 48x8", ITYPE_INT16, ISA_AVX512, 1, 48, 8, 2, ikernel_48x8_vnni_s16},
+    {"avx2 16x6", ITYPE_INT16, ISA_AVX2, 0, 16, 6, 2, ikernel_16x6_avx2_s16},
+    {"scalar 8x4", ITYPE_INT16, ISA_SCALAR, 0, 8, 4, 2, ikernel_8x4_scalar_s16},
+};
+
+#define IKERNEL_COUNT (int)(sizeof(ikernels) / sizeof(ikernels[0]))
+
+/**
+ * Returns 1 if the CPU can run an integer kernel.
+ */
+static int ikernel_supported(const ikernel_t* k)
+{
+    return k->isa <= detect_isa() && (!k->vnni || has_vnni());
+}
+
+const char* itype_name(int itype)
+{
+    return (itype == ITYPE_INT16) ? "int16" : "int8";
+}
+
+const ikernel_t* select_ikernel(int itype)
+{
+    const ikernel_t* fallback = NULL;
+
+    for (int i = 0; i < IKERNEL_COUNT; i++) 
+    {
+        if (ikernels[i].itype != itype) 
+        {
+            continue;
+        }
+        if (ikernel_supported(&ikernels[i])) 
+        {
+            return &ikernels[i];
+        }
+        fallback = &ikernels[i];
+    }
+    return fallback;
+}
+
+int supported_ikernels(int itype, const ikernel_t** kernels, int max_kernels)
+{
+    int count = 0;
+
+    for (int i = 0; i < IKERNEL_COUNT && count < max_kernels; i++) 
+    {
+        if (ikernels[i].itype == itype && ikernel_supported(&ikernels[i])) 
+        {
+            kernels[count++] = &ikernels[i];
+        }
+    }
+    return count;
+}
+
+blocking_t ikernel_blocking(const ikernel_t* kernel)
+{
+    microkernel_t shape; // analytical_blocking only needs the tile
+    memset(&shape, 0, sizeof(shape));
+    shape.m_r = kernel->m_r;
+    shape.n_r = kernel->n_r;
+
+    pthread_once(&igemm_cache_once, igemm_init_cache_info);
+    blocking_t b = analytical_blocking(&igemm_cache_info, &shape, (kernel->itype == ITYPE_INT16) ? 2 : 1);
+    b.k_c = b.k_c / kernel->k_group * kernel->k_group;
+    b.prefetch = 0; // the integer kernels do not prefetch
+    return b;
+}
+
+void gemm_s8s8s32(int M, int N, int K, const int8_t* A, int lda, const int8_t* B, int ldb, int32_t* C, int ldc,
+                  const quant_epilogue_t* q, const ikernel_t* kernel, const blocking_t* blocking, int num_threads)
+{
+    if (kernel == NULL || kernel->itype != ITYPE_INT8) 
+    {
+        kernel = select_ikernel(ITYPE_INT8);
+    }
+    igemm_s8(M, N, K, A, lda, B, ldb, C, ldc, q, kernel, blocking, num_threads);
+}
+
+void gemm_s16s16s32(int M, int N, int K, const int16_t* A, int lda, const int16_t* B, int ldb, int32_t* C, int ldc,
+                    const quant_epilogue_t* q, const ikernel_t* kernel, const blocking_t* blocking, int num_threads)
+{
+    if (kernel == NULL || kernel->itype != ITYPE_INT16) 
+    {
+        kernel = select_ikernel(ITYPE_INT16);
+    }
+    igemm_s16(M, N, K, A, lda, B, ldb, C, ldc, q, kernel, blocking, num_threads);
+}
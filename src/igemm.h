@@ -0,0 +1,144 @@
+#ifndef IGEMM_H
+#define IGEMM_H
+#include <stdint.h>
+#include "tune.h"
+
+#define ITYPE_INT8 0 // int8_t operands
+#define ITYPE_INT16 1 // int16_t operands
+#define ITYPE_COUNT 2 // Number of integer operand types
+
+/**
+ * Dequantization of an integer product. Row i of A is the real row
+ * row_scale[i] * (A(i, :) - row_zero[i]) and column j of B the real column
+ * col_scale[j] * (B(:, j) - col_zero[j]), so the real product is
+ * Y(i, j) = row_scale[i] * col_scale[j] * sum_k (A(i, k) - row_zero[i]) * (B(k, j) - col_zero[j]).
+ * A per-tensor scale or zero point is an array of equal values. Any of the
+ * arrays may be NULL, for scales of 1 and zero points of 0.
+ */
+typedef struct
+{
+    const float* row_scale; // Scale of each row of A, or NULL
+    const float* col_scale; // Scale of each column of B, or NULL
+    const int32_t* row_zero; // Zero point of each row of A, or NULL
+    const int32_t* col_zero; // Zero point of each column of B, or NULL
+    float* Y; // Receives the M x N real product, column-major
+    int ldy; // Leading dimension of Y
+} quant_epilogue_t;
+
+/**
+ * quant_epilogue_t as a kernel gets it: every array offset to the top left
+ * element of its register tile, with the sums the zero points need.
+ */
+typedef struct
+{
+    const float* row_scale; // Scale of each row, or NULL
+    const float* col_scale; // Scale of each column, or NULL
+    const int32_t* row_zero; // Zero point of each row of A, or NULL
+    const int32_t* col_zero; // Zero point of each column of B, or NULL
+    const int32_t* row_sum; // sum_k (A(i, k) - row_zero[i]), set when col_zero is
+    const int32_t* col_sum; // sum_k B(k, j), set when row_zero is
+    float* Y; // Top left element of the tile in Y
+    int ldy; // Leading dimension of Y
+} quant_tile_t;
+
+/**
+ * An integer microkernel. It multiplies an m_r x k packed micro-panel of A
+ * with a k x n_r packed micro-panel of B, k = groups * k_group, and stores
+ * the top left m x n corner of the int32 product in C, added to C when
+ * accumulate is 1. Within a micro-panel the k_group consecutive k of one row
+ * of A (or column of B) are adjacent, as the multiply-add instructions want
+ * them. When q is not NULL, the dequantized tile is written to Y as well.
+ */
+typedef struct
+{
+    const char* name; // Instruction set and tile shape, e.g. "avx2 8x6"
+    int itype; // ITYPE_* operand type
+    int isa; // ISA_* level the kernel needs
+    int vnni; // 1 if it also needs AVX512-VNNI
+    int m_r; // Rows of the register tile
+    int n_r; // Columns of the register tile
+    int k_group; // k packed together: 4 for int8, 2 for int16
+    void (*kernel)(int groups, const void* A, const void* B, int32_t* C, int ldc, int m, int n, int accumulate, const quant_tile_t* q);
+} ikernel_t;
+
+/**
+ * This function returns the name of an integer operand type: "int8" or "int16".
+ *
+ * @param itype One of the ITYPE_* values
+ * @return Pointer to a static string.
+ */
+const char* itype_name(int itype);
+
+/**
+ * This function returns the integer microkernel of an operand type for the
+ * widest instruction set the CPU supports: AVX512-VNNI 48x8 (vpdpbusd or
+ * vpdpwssd), else AVX2 (vpmaddwd, on int8 sign extended to int16), else
+ * scalar 8x4.
+ *
+ * @param itype One of the ITYPE_* values
+ * @return The selected microkernel.
+ */
+const ikernel_t* select_ikernel(int itype);
+
+/**
+ * This function lists the integer microkernels of an operand type the CPU
+ * supports, widest first.
+ *
+ * @param itype One of the ITYPE_* values
+ * @param kernels Array that receives the microkernels
+ * @param max_kernels Capacity of kernels
+ * @return The number of microkernels written.
+ */
+int supported_ikernels(int itype, const ikernel_t** kernels, int max_kernels);
+
+/**
+ * This function returns the analytical blocking (see analytical_blocking)
+ * for an integer microkernel, with k_c a multiple of its k_group.
+ *
+ * @param kernel Integer microkernel
+ * @return The blocking.
+ */
+blocking_t ikernel_blocking(const ikernel_t* kernel);
+
+/**
+ * ## Integer GEMM
+ *
+ * Computes C = A * B for int8 A and B with int32 accumulation, for quantized
+ * workloads, all column-major. It runs the GEBP loop nest of gebp: the k_c x
+ * n_c panel of B is packed once and shared by the threads, each thread packs
+ * its m_c x k_c blocks of A, and the microkernel keeps an m_r x n_r tile of
+ * int32 sums in registers. The AVX2 kernel sign extends the bytes to int16 and
+ * multiplies them with vpmaddwd. The AVX512-VNNI kernel reads A as unsigned
+ * (A + 128) and subtracts 128 times the column sums of B. Both are exact for
+ * every value. The int32 sums wrap if they exceed its range.
+ *
+ * With q, the dequantized product (see quant_epilogue_t) is written to q->Y by
+ * the kernels as they store the last k_c slice of C. The zero points need the
+ * row sums of A and column sums of B, which are computed once up front.
+ *
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A and rows of B
+ * @param A Matrix A
+ * @param lda Leading dimension of A
+ * @param B Matrix B
+ * @param ldb Leading dimension of B
+ * @param C Matrix C, receives A * B
+ * @param ldc Leading dimension of C
+ * @param q Dequantization to Y, or NULL
+ * @param kernel Microkernel for int8, or NULL for select_ikernel(ITYPE_INT8)
+ * @param blocking Blocking, or NULL for ikernel_blocking(kernel)
+ * @param num_threads Number of OpenMP threads to use, 0 for omp_get_max_threads()
+ */
+void gemm_s8s8s32(int M, int N, int K, const int8_t* A, int lda, const int8_t* B, int ldb, int32_t* C, int ldc,
+                  const quant_epilogue_t* q, const ikernel_t* kernel, const blocking_t* blocking, int num_threads);
+
+/**
+ * gemm_s8s8s32 for int16 A and B, with vpmaddwd (AVX2) or vpdpwssd
+ * (AVX512-VNNI). It is exact unless a pair of products is
+ * (-32768) * (-32768) twice.
+ */
+void gemm_s16s16s32(int M, int N, int K, const int16_t* A, int lda, const int16_t* B, int ldb, int32_t* C, int ldc,
+                    const quant_epilogue_t* q, const ikernel_t* kernel, const blocking_t* blocking, int num_threads);
+
+#endif
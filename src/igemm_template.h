@@ -0,0 +1,278 @@
+/**
+ * Packing, the scalar kernel and the GEBP driver of the integer GEMM
+ * for one operand type. igemm.c includes this file once per type, with:
+ *   ELEM  the operand type (int8_t or int16_t)
+ *   KG    the k packed together for the multiply-add instructions
+ *   FN    a macro adding the type to a function name
+ * There is deliberately no include guard.
+ */
+
+/**
+ * Packs an m_b x k_b block of A into micro-panels of m_r rows. Within a
+ * micro-panel the KG consecutive k of a row are adjacent, groups of
+ * k follow each other, and rows past m_b and k past k_b (up to k_pad)
+ * are zero.
+ */
+static void FN(pack_A)(ELEM* A_packed, const ELEM* A, int lda, int m_b, int k_b, int k_pad, int m_r, int i_block, int k_block)
+{
+    for (int i = 0; i < m_b; i += m_r) 
+    {
+        int m = (m_b - i < m_r) ? m_b - i : m_r;
+        ELEM* panel = &A_packed[(size_t)i * k_pad];
+
+        for (int k = 0; k < k_pad; k++) 
+        {
+            ELEM* dst = &panel[(k / KG) * m_r * KG + k % KG];
+            int ii = 0;
+
+            if (k < k_b) 
+            {
+                const ELEM* col = &A[(size_t)(k_block + k) * lda + i_block + i];
+                for (; ii < m; ii++) 
+                {
+                    dst[ii * KG] = col[ii];
+                }
+            }
+            for (; ii < m_r; ii++) 
+            {
+                dst[ii * KG] = 0;
+            }
+        }
+    }
+}
+
+/**
+ * Packs a k_b x n_b panel of B into micro-panels of n_r columns, with the
+ * KG consecutive k of a column adjacent and zeros past n_b and k_b.
+ */
+static void FN(pack_B)(ELEM* B_packed, const ELEM* B, int ldb, int k_b, int k_pad, int n_b, int n_r, int j_block, int k_block)
+{
+    for (int j = 0; j < n_b; j += n_r) 
+    {
+        int n = (n_b - j < n_r) ? n_b - j : n_r;
+        ELEM* panel = &B_packed[(size_t)j * k_pad];
+
+        for (int jj = 0; jj < n_r; jj++) 
+        {
+            const ELEM* col = &B[(size_t)(j_block + j + (jj < n ? jj : 0)) * ldb + k_block];
+            for (int k = 0; k < k_pad; k++) 
+            {
+                panel[((k / KG) * n_r + jj) * KG + k % KG] = (jj < n && k < k_b) ? col[k] : 0;
+            }
+        }
+    }
+}
+
+/**
+ * Packs this thread's share, every nthreads-th micro-panel, of a panel of B.
+ */
+static void FN(pack_B_share)(ELEM* B_packed, const ELEM* B, int ldb, int k_b, int k_pad, int n_b, int n_r, int j_block, int k_block,
+                             int tid, int nthreads)
+{
+    for (int j = tid * n_r; j < n_b; j += nthreads * n_r) 
+    {
+        int n = (n_b - j < n_r) ? n_b - j : n_r;
+        FN(pack_B)(&B_packed[(size_t)j * k_pad], B, ldb, k_b, k_pad, n, n_r, j_block + j, k_block);
+    }
+}
+
+/**
+ * Sets sum[i] to the sum of row i of A minus K times its zero point
+ * (zero may be NULL). The sums are kept unsigned so that they wrap like
+ * the kernels' do.
+ */
+static void FN(sum_rows)(int M, int K, const ELEM* A, int lda, const int32_t* zero, int32_t* sum)
+{
+    uint32_t* s = (uint32_t*)sum;
+
+    for (int i = 0; i < M; i++) 
+    {
+        s[i] = (zero != NULL) ? (uint32_t)0 - (uint32_t)K * (uint32_t)zero[i] : 0;
+    }
+    for (int k = 0; k < K; k++) 
+    {
+        for (int i = 0; i < M; i++) 
+        {
+            s[i] += (uint32_t)A[(size_t)k * lda + i];
+        }
+    }
+}
+
+/**
+ * Sets sum[j] to the sum of column j of B, wrapping like sum_rows.
+ */
+static void FN(sum_cols)(int N, int K, const ELEM* B, int ldb, int32_t* sum)
+{
+    for (int j = 0; j < N; j++) 
+    {
+        uint32_t s = 0;
+        for (int k = 0; k < K; k++) 
+        {
+            s += (uint32_t)B[(size_t)j * ldb + k];
+        }
+        sum[j] = (int32_t)s;
+    }
+}
+
+/**
+ * 8x4 register block in plain C, for CPUs without AVX2. The sums are
+ * kept unsigned so that they wrap like the vector kernels' do.
+ */
+static void FN(ikernel_8x4_scalar)(int groups, const void* A_packed, const void* B_packed, int32_t* C, int ldc, int m, int n,
+                                   int accumulate, const quant_tile_t* q)
+{
+    const ELEM* A = (const ELEM*)A_packed;
+    const ELEM* B = (const ELEM*)B_packed;
+    uint32_t ab[8 * 4] = {0};
+
+    for (int g = 0; g < groups; g++) 
+    {
+        for (int jj = 0; jj < 4; jj++) 
+        {
+            for (int ii = 0; ii < 8; ii++) 
+            {
+                for (int t = 0; t < KG; t++) 
+                {
+                    ab[jj * 8 + ii] += (uint32_t)((int32_t)A[ii * KG + t] * B[jj * KG + t]);
+                }
+            }
+        }
+        A += 8 * KG;
+        B += 4 * KG;
+    }
+
+    store_tile((const int32_t*)ab, 8, C, ldc, m, n, accumulate, q);
+}
+
+static void FN(igemm)(int M, int N, int K, const ELEM* A, int lda, const ELEM* B, int ldb, int32_t* C, int ldc,
+                      const quant_epilogue_t* q, const ikernel_t* kernel, const blocking_t* blocking, int num_threads)
+{
+    if (M <= 0 || N <= 0) 
+    {
+        return;
+    }
+
+    // Whatever blocking is given, the blocks hold whole micro-panels and groups of k
+    int m_r = kernel->m_r, n_r = kernel->n_r;
+    blocking_t b = (blocking != NULL) ? *blocking : ikernel_blocking(kernel);
+    int m_c = (b.m_c < m_r) ? m_r : b.m_c / m_r * m_r;
+    int n_c = (b.n_c < n_r) ? n_r : b.n_c / n_r * n_r;
+    int k_c = (b.k_c < KG) ? KG : b.k_c / KG * KG;
+
+    // With no k, C and Y are zero
+    if (K <= 0) 
+    {
+        for (int j = 0; j < N; j++) 
+        {
+            for (int i = 0; i < M; i++) 
+            {
+                C[(size_t)j * ldc + i] = 0;
+                if (q != NULL && q->Y != NULL) { q->Y[(size_t)j * q->ldy + i] = 0.0f; }
+            }
+        }
+        return;
+    }
+
+    // The zero points need the sums of the rows of A and the columns of B
+    int quantize = (q != NULL && q->Y != NULL);
+    int32_t* row_sum = NULL;
+    int32_t* col_sum = NULL;
+    if (quantize && q->col_zero != NULL) 
+    {
+        row_sum = (int32_t*)malloc((size_t)M * sizeof(int32_t));
+        if (row_sum == NULL) 
+        {
+            fprintf(stderr, "igemm: unable to allocate the sums of %d rows\n", M);
+            return;
+        }
+        FN(sum_rows)(M, K, A, lda, q->row_zero, row_sum);
+    }
+    if (quantize && q->row_zero != NULL) 
+    {
+        col_sum = (int32_t*)malloc((size_t)N * sizeof(int32_t));
+        if (col_sum == NULL) 
+        {
+            fprintf(stderr, "igemm: unable to allocate the sums of %d columns\n", N);
+            free(row_sum);
+            return;
+        }
+        FN(sum_cols)(N, K, B, ldb, col_sum);
+    }
+
+    int m_c_used = (M < m_c) ? M : m_c;
+    int n_c_used = (N < n_c) ? N : n_c;
+    int k_c_used = (K < k_c) ? (K + KG - 1) / KG * KG : k_c;
+    int m_c_padded = (m_c_used + m_r - 1) / m_r * m_r;
+    int n_c_padded = (n_c_used + n_r - 1) / n_r * n_r;
+    ELEM* B_packed = (ELEM*)arena_get(ARENA_PACK_B, (size_t)k_c_used * n_c_padded * sizeof(ELEM)); // Panel of B: k_c x n_c, shared
+    int i_blocks = (M + m_c - 1) / m_c;
+    int threads = (num_threads > 0) ? num_threads : omp_get_max_threads();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+        ELEM* A_packed = (ELEM*)arena_get(ARENA_PACK_A, (size_t)m_c_padded * k_c_used * sizeof(ELEM)); // Block of A: m_c x k_c, per thread
+
+        // The i blocks are divided into contiguous ranges, as in gebp
+        int first = (int)((long)i_blocks * tid / nthreads);
+        int last_block = (int)((long)i_blocks * (tid + 1) / nthreads);
+
+        for (int j_block = 0; j_block < N; j_block += n_c) 
+        {
+            int n_b = (N - j_block < n_c) ? N - j_block : n_c;
+
+            for (int k_block = 0; k_block < K; k_block += k_c) 
+            {
+                int k_b = (K - k_block < k_c) ? K - k_block : k_c;
+                int k_pad = (k_b + KG - 1) / KG * KG; // the last slice is zero padded to whole groups
+                int last_slice = (k_block + k_b >= K); // Y is written with the final sums
+
+                FN(pack_B_share)(B_packed, B, ldb, k_b, k_pad, n_b, n_r, j_block, k_block, tid, nthreads);
+
+                #pragma omp barrier
+
+                for (int ib = first; ib < last_block; ib++) 
+                {
+                    int i_block = ib * m_c;
+                    int m_b = (M - i_block < m_c) ? M - i_block : m_c;
+
+                    FN(pack_A)(A_packed, A, lda, m_b, k_b, k_pad, m_r, i_block, k_block);
+
+                    // A micro-panel of B stays in L1 while the block of A streams past it
+                    for (int j = 0; j < n_b; j += n_r) 
+                    {
+                        int n = (n_b - j < n_r) ? n_b - j : n_r;
+
+                        for (int i = 0; i < m_b; i += m_r) 
+                        {
+                            int m = (m_b - i < m_r) ? m_b - i : m_r;
+                            int row = i_block + i, col = j_block + j;
+                            quant_tile_t tile; // q offset to this tile
+
+                            if (quantize && last_slice) 
+                            {
+                                tile.row_scale = (q->row_scale != NULL) ? q->row_scale + row : NULL;
+                                tile.col_scale = (q->col_scale != NULL) ? q->col_scale + col : NULL;
+                                tile.row_zero = (q->row_zero != NULL) ? q->row_zero + row : NULL;
+                                tile.col_zero = (q->col_zero != NULL) ? q->col_zero + col : NULL;
+                                tile.row_sum = (row_sum != NULL) ? row_sum + row : NULL;
+                                tile.col_sum = (col_sum != NULL) ? col_sum + col : NULL;
+                                tile.Y = &q->Y[(size_t)col * q->ldy + row];
+                                tile.ldy = q->ldy;
+                            }
+                            kernel->kernel(k_pad / KG, &A_packed[(size_t)i * k_pad], &B_packed[(size_t)j * k_pad], &C[(size_t)col * ldc + row], ldc,
+                                           m, n, k_block > 0, (quantize && last_slice) ? &tile : NULL);
+                        }
+                    }
+                }
+
+                // Nobody may overwrite the panel until every thread is done with it
+                #pragma omp barrier
+            }
+        }
+    }
+
+    free(row_sum);
+    free(col_sum);
+}
@@ -0,0 +1,1219 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Register blocked microkernels for each element type and
+ * instruction set, and the cpuid based selection between them. Kernels are
+ * compiled with target attributes, so the library runs on
+ * any x86-64 CPU and only calls kernels the CPU supports.
+ */
+
+#include <immintrin.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "matrix_ops.h"
+
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+/**
+ * Prefetches bytes at p into L1 with one prefetch per 64 bytes. The kernels
+ * call it once per k iteration for the packed A and B, prefetch iterations
+ * ahead, with the bytes of one iteration; since consecutive calls are that
+ * many bytes apart, every line is covered. The micro-panels are contiguous,
+ * so near the end of one it reaches into the next.
+ */
+static inline __attribute__((always_inline)) void prefetch_lines(const void* p, int bytes)
+{
+    for (int offset = 0; offset < bytes; offset += 64) 
+    {
+        __builtin_prefetch((const char*)p + offset, 0, 3);
+    }
+}
+
+/**
+ * Prefetches for writing the n columns of col_bytes bytes of the C tile a
+ * kernel merges into. Called before the k loop, the lines have the whole
+ * loop to arrive.
+ */
+static inline __attribute__((always_inline)) void prefetch_C(const void* C, size_t ldc_bytes, int col_bytes, int n)
+{
+    for (int j = 0; j < n; j++) 
+    {
+        const char* col = (const char*)C + j * ldc_bytes;
+        for (const char* q = (const char*)((size_t)col & ~(size_t)63); q <= col + col_bytes - 1; q += 64) 
+        {
+            __builtin_prefetch(q, 1, 3);
+        }
+    }
+}
+
+#define GELU_SCALE 0.7978845608028654 // sqrt(2 / pi)
+#define GELU_CUBIC 0.044715 // Weight of x^3 in the tanh approximation of GELU
+
+double activate(double x, int activation)
+{
+    switch (activation) 
+    {
+        case ACTIVATION_RELU:
+            return (x > 0.0) ? x : 0.0;
+        case ACTIVATION_GELU:
+            return 0.5 * x * (1.0 + tanh(GELU_SCALE * (x + GELU_CUBIC * x * x * x)));
+        default:
+            return x;
+    }
+}
+
+float sactivate(float x, int activation)
+{
+    switch (activation) 
+    {
+        case ACTIVATION_RELU:
+            return (x > 0.0f) ? x : 0.0f;
+        case ACTIVATION_GELU:
+            return 0.5f * x * (1.0f + tanhf((float)GELU_SCALE * (x + (float)GELU_CUBIC * x * x * x)));
+        default:
+            return x;
+    }
+}
+
+/**
+ * Applies an epilogue to the element in row i and column j of a tile.
+ */
+static inline double epilogue_scalar(double v, const epilogue_t* ep, int i, int j)
+{
+    if (ep->row_bias != NULL) { v += ((const double*)ep->row_bias)[i]; }
+    if (ep->col_bias != NULL) { v += ((const double*)ep->col_bias)[j]; }
+    return activate(v, ep->activation);
+}
+
+static inline float sepilogue_scalar(float v, const epilogue_t* ep, int i, int j)
+{
+    if (ep->row_bias != NULL) { v += ((const float*)ep->row_bias)[i]; }
+    if (ep->col_bias != NULL) { v += ((const float*)ep->col_bias)[j]; }
+    return sactivate(v, ep->activation);
+}
+
+/**
+ * Complex epilogues add the biases only.
+ */
+static inline double complex zepilogue_scalar(double complex v, const epilogue_t* ep, int i, int j)
+{
+    if (ep->row_bias != NULL) { v += ((const double complex*)ep->row_bias)[i]; }
+    if (ep->col_bias != NULL) { v += ((const double complex*)ep->col_bias)[j]; }
+    return v;
+}
+
+/**
+ * e^x for four doubles: x = n ln2 + r with |r| <= ln2 / 2, e^r from its
+ * Taylor series to degree 12 (relative error below 1e-15), and 2^n built
+ * in the exponent bits. x is clamped to +-708, where e^x stays finite.
+ */
+TARGET_AVX2 static inline __m256d exp_avx2(__m256d x)
+{
+    x = _mm256_min_pd(_mm256_max_pd(x, _mm256_set1_pd(-708.0)), _mm256_set1_pd(708.0));
+    __m256d n = _mm256_round_pd(_mm256_mul_pd(x, _mm256_set1_pd(1.4426950408889634)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256d r = _mm256_fnmadd_pd(n, _mm256_set1_pd(6.93145751953125e-1), x);
+    r = _mm256_fnmadd_pd(n, _mm256_set1_pd(1.42860682030941723212e-6), r);
+
+    __m256d p = _mm256_set1_pd(1.0 / 479001600.0);
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 39916800.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 3628800.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 362880.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 40320.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 5040.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 720.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 120.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 24.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0 / 6.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(0.5));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+    p = _mm256_fmadd_pd(p, r, _mm256_set1_pd(1.0));
+
+    __m256i e = _mm256_add_epi64(_mm256_cvtepi32_epi64(_mm256_cvtpd_epi32(n)), _mm256_set1_epi64x(1023));
+    return _mm256_mul_pd(p, _mm256_castsi256_pd(_mm256_slli_epi64(e, 52)));
+}
+
+/**
+ * exp_avx2 for eight floats, with the series to degree 7 and x clamped to +-87.
+ */
+TARGET_AVX2 static inline __m256 sexp_avx2(__m256 x)
+{
+    x = _mm256_min_ps(_mm256_max_ps(x, _mm256_set1_ps(-87.0f)), _mm256_set1_ps(87.0f));
+    __m256 n = _mm256_round_ps(_mm256_mul_ps(x, _mm256_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m256 r = _mm256_fnmadd_ps(n, _mm256_set1_ps(0.693359375f), x);
+    r = _mm256_fnmadd_ps(n, _mm256_set1_ps(-2.12194440e-4f), r);
+
+    __m256 p = _mm256_set1_ps(1.0f / 5040.0f);
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 720.0f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 120.0f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 24.0f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f / 6.0f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(0.5f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f));
+    p = _mm256_fmadd_ps(p, r, _mm256_set1_ps(1.0f));
+
+    __m256i e = _mm256_add_epi32(_mm256_cvtps_epi32(n), _mm256_set1_epi32(127));
+    return _mm256_mul_ps(p, _mm256_castsi256_ps(_mm256_slli_epi32(e, 23)));
+}
+
+/**
+ * Applies an epilogue to rows i to i + 3 of column j of a tile, the rows
+ * outside mask excluded. GELU is computed as x / (1 + e^(-2 z)), the same
+ * as 0.5 x (1 + tanh(z)) without a vector tanh.
+ */
+TARGET_AVX2 static inline __m256d epilogue_avx2(__m256d v, __m256i mask, const epilogue_t* ep, int i, int j)
+{
+    if (ep->row_bias != NULL) 
+    {
+        v = _mm256_add_pd(v, _mm256_maskload_pd(&((const double*)ep->row_bias)[i], mask));
+    }
+    if (ep->col_bias != NULL) 
+    {
+        v = _mm256_add_pd(v, _mm256_broadcast_sd(&((const double*)ep->col_bias)[j]));
+    }
+
+    if (ep->activation == ACTIVATION_RELU) 
+    {
+        v = _mm256_max_pd(v, _mm256_setzero_pd());
+    }
+    else if (ep->activation == ACTIVATION_GELU) 
+    {
+        __m256d z = _mm256_mul_pd(v, _mm256_fmadd_pd(_mm256_set1_pd(-2.0 * GELU_SCALE * GELU_CUBIC), _mm256_mul_pd(v, v), _mm256_set1_pd(-2.0 * GELU_SCALE)));
+        v = _mm256_div_pd(v, _mm256_add_pd(_mm256_set1_pd(1.0), exp_avx2(z)));
+    }
+    return v;
+}
+
+/**
+ * Float version of epilogue_avx2, eight rows at a time.
+ */
+TARGET_AVX2 static inline __m256 sepilogue_avx2(__m256 v, __m256i mask, const epilogue_t* ep, int i, int j)
+{
+    if (ep->row_bias != NULL) 
+    {
+        v = _mm256_add_ps(v, _mm256_maskload_ps(&((const float*)ep->row_bias)[i], mask));
+    }
+    if (ep->col_bias != NULL) 
+    {
+        v = _mm256_add_ps(v, _mm256_broadcast_ss(&((const float*)ep->col_bias)[j]));
+    }
+
+    if (ep->activation == ACTIVATION_RELU) 
+    {
+        v = _mm256_max_ps(v, _mm256_setzero_ps());
+    }
+    else if (ep->activation == ACTIVATION_GELU) 
+    {
+        __m256 z = _mm256_mul_ps(v, _mm256_fmadd_ps(_mm256_set1_ps((float)(-2.0 * GELU_SCALE * GELU_CUBIC)), _mm256_mul_ps(v, v), _mm256_set1_ps((float)(-2.0 * GELU_SCALE))));
+        v = _mm256_div_ps(v, _mm256_add_ps(_mm256_set1_ps(1.0f), sexp_avx2(z)));
+    }
+    return v;
+}
+
+/**
+ * exp_avx2 for eight doubles. AVX-512 scales by 2^n with scalef.
+ */
+TARGET_AVX512 static inline __m512d exp_avx512(__m512d x)
+{
+    x = _mm512_min_pd(_mm512_max_pd(x, _mm512_set1_pd(-708.0)), _mm512_set1_pd(708.0));
+    __m512d n = _mm512_roundscale_pd(_mm512_mul_pd(x, _mm512_set1_pd(1.4426950408889634)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512d r = _mm512_fnmadd_pd(n, _mm512_set1_pd(6.93145751953125e-1), x);
+    r = _mm512_fnmadd_pd(n, _mm512_set1_pd(1.42860682030941723212e-6), r);
+
+    __m512d p = _mm512_set1_pd(1.0 / 479001600.0);
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 39916800.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 3628800.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 362880.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 40320.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 5040.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 720.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 120.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 24.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0 / 6.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(0.5));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0));
+    p = _mm512_fmadd_pd(p, r, _mm512_set1_pd(1.0));
+    return _mm512_scalef_pd(p, n);
+}
+
+TARGET_AVX512 static inline __m512 sexp_avx512(__m512 x)
+{
+    x = _mm512_min_ps(_mm512_max_ps(x, _mm512_set1_ps(-87.0f)), _mm512_set1_ps(87.0f));
+    __m512 n = _mm512_roundscale_ps(_mm512_mul_ps(x, _mm512_set1_ps(1.44269504f)), _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC);
+    __m512 r = _mm512_fnmadd_ps(n, _mm512_set1_ps(0.693359375f), x);
+    r = _mm512_fnmadd_ps(n, _mm512_set1_ps(-2.12194440e-4f), r);
+
+    __m512 p = _mm512_set1_ps(1.0f / 5040.0f);
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.0f / 720.0f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.0f / 120.0f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.0f / 24.0f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.0f / 6.0f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(0.5f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.0f));
+    p = _mm512_fmadd_ps(p, r, _mm512_set1_ps(1.0f));
+    return _mm512_scalef_ps(p, n);
+}
+
+/**
+ * epilogue_avx2 for eight rows, with an AVX-512 mask.
+ */
+TARGET_AVX512 static inline __m512d epilogue_avx512(__m512d v, __mmask8 mask, const epilogue_t* ep, int i, int j)
+{
+    if (ep->row_bias != NULL) 
+    {
+        v = _mm512_add_pd(v, _mm512_maskz_loadu_pd(mask, &((const double*)ep->row_bias)[i]));
+    }
+    if (ep->col_bias != NULL) 
+    {
+        v = _mm512_add_pd(v, _mm512_set1_pd(((const double*)ep->col_bias)[j]));
+    }
+
+    if (ep->activation == ACTIVATION_RELU) 
+    {
+        v = _mm512_max_pd(v, _mm512_setzero_pd());
+    }
+    else if (ep->activation == ACTIVATION_GELU) 
+    {
+        __m512d z = _mm512_mul_pd(v, _mm512_fmadd_pd(_mm512_set1_pd(-2.0 * GELU_SCALE * GELU_CUBIC), _mm512_mul_pd(v, v), _mm512_set1_pd(-2.0 * GELU_SCALE)));
+        v = _mm512_div_pd(v, _mm512_add_pd(_mm512_set1_pd(1.0), exp_avx512(z)));
+    }
+    return v;
+}
+
+TARGET_AVX512 static inline __m512 sepilogue_avx512(__m512 v, __mmask16 mask, const epilogue_t* ep, int i, int j)
+{
+    if (ep->row_bias != NULL) 
+    {
+        v = _mm512_add_ps(v, _mm512_maskz_loadu_ps(mask, &((const float*)ep->row_bias)[i]));
+    }
+    if (ep->col_bias != NULL) 
+    {
+        v = _mm512_add_ps(v, _mm512_set1_ps(((const float*)ep->col_bias)[j]));
+    }
+
+    if (ep->activation == ACTIVATION_RELU) 
+    {
+        v = _mm512_max_ps(v, _mm512_setzero_ps());
+    }
+    else if (ep->activation == ACTIVATION_GELU) 
+    {
+        __m512 z = _mm512_mul_ps(v, _mm512_fmadd_ps(_mm512_set1_ps((float)(-2.0 * GELU_SCALE * GELU_CUBIC)), _mm512_mul_ps(v, v), _mm512_set1_ps((float)(-2.0 * GELU_SCALE))));
+        v = _mm512_div_ps(v, _mm512_add_ps(_mm512_set1_ps(1.0f), sexp_avx512(z)));
+    }
+    return v;
+}
+
+/**
+ * Portable 4x4 register block for CPUs without AVX2 and FMA.
+ * The compiler keeps the 16 accumulators in SSE2 registers.
+ */
+static void microkernel_4x4_scalar(int k_c, const double* A, const double* B, double* C, int ldc, int m, int n, 
+                                   double alpha, double beta, int prefetch, const epilogue_t* ep)
+{
+    double ab[4][4] = {{0}};
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        for (int j = 0; j < 4; j++) 
+        {
+            for (int i = 0; i < 4; i++) 
+            {
+                ab[j][i] += A[i] * B[j];
+            }
+        }
+        A += 4;
+        B += 4;
+    }
+
+    for (int j = 0; j < n; j++) 
+    {
+        for (int i = 0; i < m; i++) 
+        {
+            double v = alpha * ab[j][i] + (beta == 0.0 ? 0.0 : beta * C[j * ldc + i]);
+            C[j * ldc + i] = (ep != NULL) ? epilogue_scalar(v, ep, i, j) : v;
+        }
+    }
+}
+
+/**
+ * Writes rows i to i + 3 of column j of a register tile to C as
+ * C = alpha * AB + beta * C, then applies ep if it is not NULL.
+ * C is not read when beta is zero.
+ */
+TARGET_AVX2 static inline void update_C(double* C, __m256d ab, __m256d alpha, __m256d beta, int beta_zero, const epilogue_t* ep, int i, int j)
+{
+    ab = _mm256_mul_pd(alpha, ab);
+    if (!beta_zero) 
+    {
+        ab = _mm256_fmadd_pd(beta, _mm256_loadu_pd(C), ab);
+    }
+    if (ep != NULL) 
+    {
+        ab = epilogue_avx2(ab, _mm256_set1_epi64x(-1), ep, i, j);
+    }
+    _mm256_storeu_pd(C, ab);
+}
+
+/**
+ * Merges an m x n corner of an m_r x n_r product tile (ab, stored column by
+ * column) into C, applying ep if it is not NULL. Rows past m are masked off
+ * with maskload/maskstore so the edges of C are never read or written out of
+ * bounds.
+ */
+TARGET_AVX2 static void update_C_fringe(double* C, int ldc, const double* ab, int m_r, int m, int n, double alpha, double beta, const epilogue_t* ep)
+{
+    __m256d va = _mm256_set1_pd(alpha), vb = _mm256_set1_pd(beta);
+    const __m256i lanes = _mm256_set_epi64x(3, 2, 1, 0);
+
+    for (int j = 0; j < n; j++) 
+    {
+        for (int i = 0; i < m; i += 4) 
+        {
+            __m256i mask = _mm256_cmpgt_epi64(_mm256_set1_epi64x(m - i), lanes);
+            __m256d v = _mm256_mul_pd(va, _mm256_maskload_pd(&ab[(size_t)j * m_r + i], mask));
+            if (beta != 0.0) 
+            {
+                v = _mm256_fmadd_pd(vb, _mm256_maskload_pd(&C[(size_t)j * ldc + i], mask), v);
+            }
+            if (ep != NULL) 
+            {
+                v = epilogue_avx2(v, mask, ep, i, j);
+            }
+            _mm256_maskstore_pd(&C[(size_t)j * ldc + i], mask, v);
+        }
+    }
+}
+
+/**
+ * 8x6 register block. The 8 x 6 product is accumulated in 12 YMM
+ * registers (two per column) for the whole k_c loop and merged into
+ * C once at the end. A and B are packed micro-panels, so both are
+ * read with unit stride. Only the top left m x n corner is merged.
+ */
+TARGET_AVX2 static void microkernel_8x6_avx2(int k_c, const double* A, const double* B, double* C, int ldc, int m, int n, 
+                                             double alpha, double beta, int prefetch, const epilogue_t* ep)
+{
+    __m256d c00 = _mm256_setzero_pd(), c10 = _mm256_setzero_pd();
+    __m256d c01 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd();
+    __m256d c02 = _mm256_setzero_pd(), c12 = _mm256_setzero_pd();
+    __m256d c03 = _mm256_setzero_pd(), c13 = _mm256_setzero_pd();
+    __m256d c04 = _mm256_setzero_pd(), c14 = _mm256_setzero_pd();
+    __m256d c05 = _mm256_setzero_pd(), c15 = _mm256_setzero_pd();
+
+    if (prefetch > 0) 
+    {
+        prefetch_C(C, ldc * sizeof(double), m * (int)sizeof(double), n);
+    }
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        if (prefetch > 0) 
+        {
+            prefetch_lines(&A[prefetch * 8], 8 * sizeof(double));
+            prefetch_lines(&B[prefetch * 6], 6 * sizeof(double));
+        }
+
+        __m256d a0 = _mm256_load_pd(&A[0]);
+        __m256d a1 = _mm256_load_pd(&A[4]);
+        __m256d b;
+
+        b = _mm256_broadcast_sd(&B[0]);
+        c00 = _mm256_fmadd_pd(a0, b, c00); c10 = _mm256_fmadd_pd(a1, b, c10);
+        b = _mm256_broadcast_sd(&B[1]);
+        c01 = _mm256_fmadd_pd(a0, b, c01); c11 = _mm256_fmadd_pd(a1, b, c11);
+        b = _mm256_broadcast_sd(&B[2]);
+        c02 = _mm256_fmadd_pd(a0, b, c02); c12 = _mm256_fmadd_pd(a1, b, c12);
+        b = _mm256_broadcast_sd(&B[3]);
+        c03 = _mm256_fmadd_pd(a0, b, c03); c13 = _mm256_fmadd_pd(a1, b, c13);
+        b = _mm256_broadcast_sd(&B[4]);
+        c04 = _mm256_fmadd_pd(a0, b, c04); c14 = _mm256_fmadd_pd(a1, b, c14);
+        b = _mm256_broadcast_sd(&B[5]);
+        c05 = _mm256_fmadd_pd(a0, b, c05); c15 = _mm256_fmadd_pd(a1, b, c15);
+
+        A += 8;
+        B += 6;
+    }
+
+    if (m < 8 || n < 6) 
+    {
+        double ab[8 * 6];
+        _mm256_storeu_pd(&ab[0 * 8 + 0], c00); _mm256_storeu_pd(&ab[0 * 8 + 4], c10);
+        _mm256_storeu_pd(&ab[1 * 8 + 0], c01); _mm256_storeu_pd(&ab[1 * 8 + 4], c11);
+        _mm256_storeu_pd(&ab[2 * 8 + 0], c02); _mm256_storeu_pd(&ab[2 * 8 + 4], c12);
+        _mm256_storeu_pd(&ab[3 * 8 + 0], c03); _mm256_storeu_pd(&ab[3 * 8 + 4], c13);
+        _mm256_storeu_pd(&ab[4 * 8 + 0], c04); _mm256_storeu_pd(&ab[4 * 8 + 4], c14);
+        _mm256_storeu_pd(&ab[5 * 8 + 0], c05); _mm256_storeu_pd(&ab[5 * 8 + 4], c15);
+        update_C_fringe(C, ldc, ab, 8, m, n, alpha, beta, ep);
+        return;
+    }
+
+    __m256d va = _mm256_set1_pd(alpha), vb = _mm256_set1_pd(beta);
+    int bz = (beta == 0.0);
+    update_C(&C[0 * ldc + 0], c00, va, vb, bz, ep, 0, 0); update_C(&C[0 * ldc + 4], c10, va, vb, bz, ep, 4, 0);
+    update_C(&C[1 * ldc + 0], c01, va, vb, bz, ep, 0, 1); update_C(&C[1 * ldc + 4], c11, va, vb, bz, ep, 4, 1);
+    update_C(&C[2 * ldc + 0], c02, va, vb, bz, ep, 0, 2); update_C(&C[2 * ldc + 4], c12, va, vb, bz, ep, 4, 2);
+    update_C(&C[3 * ldc + 0], c03, va, vb, bz, ep, 0, 3); update_C(&C[3 * ldc + 4], c13, va, vb, bz, ep, 4, 3);
+    update_C(&C[4 * ldc + 0], c04, va, vb, bz, ep, 0, 4); update_C(&C[4 * ldc + 4], c14, va, vb, bz, ep, 4, 4);
+    update_C(&C[5 * ldc + 0], c05, va, vb, bz, ep, 0, 5); update_C(&C[5 * ldc + 4], c15, va, vb, bz, ep, 4, 5);
+}
+
+/**
+ * 12x4 register block. Three YMM accumulators per column of C,
+ * twelve in total, with one broadcast of B feeding three FMAs.
+ */
+TARGET_AVX2 static void microkernel_12x4_avx2(int k_c, const double* A, const double* B, double* C, int ldc, int m, int n, 
+                                              double alpha, double beta, int prefetch, const epilogue_t* ep)
+{
+    __m256d c00 = _mm256_setzero_pd(), c10 = _mm256_setzero_pd(), c20 = _mm256_setzero_pd();
+    __m256d c01 = _mm256_setzero_pd(), c11 = _mm256_setzero_pd(), c21 = _mm256_setzero_pd();
+    __m256d c02 = _mm256_setzero_pd(), c12 = _mm256_setzero_pd(), c22 = _mm256_setzero_pd();
+    __m256d c03 = _mm256_setzero_pd(), c13 = _mm256_setzero_pd(), c23 = _mm256_setzero_pd();
+
+    if (prefetch > 0) 
+    {
+        prefetch_C(C, ldc * sizeof(double), m * (int)sizeof(double), n);
+    }
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        if (prefetch > 0) 
+        {
+            prefetch_lines(&A[prefetch * 12], 12 * sizeof(double));
+            prefetch_lines(&B[prefetch * 4], 4 * sizeof(double));
+        }
+
+        __m256d a0 = _mm256_load_pd(&A[0]);
+        __m256d a1 = _mm256_load_pd(&A[4]);
+        __m256d a2 = _mm256_load_pd(&A[8]);
+        __m256d b;
+
+        b = _mm256_broadcast_sd(&B[0]);
+        c00 = _mm256_fmadd_pd(a0, b, c00); c10 = _mm256_fmadd_pd(a1, b, c10); c20 = _mm256_fmadd_pd(a2, b, c20);
+        b = _mm256_broadcast_sd(&B[1]);
+        c01 = _mm256_fmadd_pd(a0, b, c01); c11 = _mm256_fmadd_pd(a1, b, c11); c21 = _mm256_fmadd_pd(a2, b, c21);
+        b = _mm256_broadcast_sd(&B[2]);
+        c02 = _mm256_fmadd_pd(a0, b, c02); c12 = _mm256_fmadd_pd(a1, b, c12); c22 = _mm256_fmadd_pd(a2, b, c22);
+        b = _mm256_broadcast_sd(&B[3]);
+        c03 = _mm256_fmadd_pd(a0, b, c03); c13 = _mm256_fmadd_pd(a1, b, c13); c23 = _mm256_fmadd_pd(a2, b, c23);
+
+        A += 12;
+        B += 4;
+    }
+
+    if (m < 12 || n < 4) 
+    {
+        double ab[12 * 4];
+        _mm256_storeu_pd(&ab[0 * 12 + 0], c00); _mm256_storeu_pd(&ab[0 * 12 + 4], c10); _mm256_storeu_pd(&ab[0 * 12 + 8], c20);
+        _mm256_storeu_pd(&ab[1 * 12 + 0], c01); _mm256_storeu_pd(&ab[1 * 12 + 4], c11); _mm256_storeu_pd(&ab[1 * 12 + 8], c21);
+        _mm256_storeu_pd(&ab[2 * 12 + 0], c02); _mm256_storeu_pd(&ab[2 * 12 + 4], c12); _mm256_storeu_pd(&ab[2 * 12 + 8], c22);
+        _mm256_storeu_pd(&ab[3 * 12 + 0], c03); _mm256_storeu_pd(&ab[3 * 12 + 4], c13); _mm256_storeu_pd(&ab[3 * 12 + 8], c23);
+        update_C_fringe(C, ldc, ab, 12, m, n, alpha, beta, ep);
+        return;
+    }
+
+    __m256d va = _mm256_set1_pd(alpha), vb = _mm256_set1_pd(beta);
+    int bz = (beta == 0.0);
+    update_C(&C[0 * ldc + 0], c00, va, vb, bz, ep, 0, 0); update_C(&C[0 * ldc + 4], c10, va, vb, bz, ep, 4, 0); update_C(&C[0 * ldc + 8], c20, va, vb, bz, ep, 8, 0);
+    update_C(&C[1 * ldc + 0], c01, va, vb, bz, ep, 0, 1); update_C(&C[1 * ldc + 4], c11, va, vb, bz, ep, 4, 1); update_C(&C[1 * ldc + 8], c21, va, vb, bz, ep, 8, 1);
+    update_C(&C[2 * ldc + 0], c02, va, vb, bz, ep, 0, 2); update_C(&C[2 * ldc + 4], c12, va, vb, bz, ep, 4, 2); update_C(&C[2 * ldc + 8], c22, va, vb, bz, ep, 8, 2);
+    update_C(&C[3 * ldc + 0], c03, va, vb, bz, ep, 0, 3); update_C(&C[3 * ldc + 4], c13, va, vb, bz, ep, 4, 3); update_C(&C[3 * ldc + 8], c23, va, vb, bz, ep, 8, 3);
+}
+
+/**
+ * 24x8 register block for AVX-512. The 32 ZMM registers hold the
+ * 24 x 8 tile in 24 accumulators (three per column) with room for
+ * three vectors of A and a broadcast of B. Edge tiles are merged
+ * with AVX-512 write masks.
+ */
+TARGET_AVX512 static void microkernel_24x8_avx512(int k_c, const double* A, const double* B, double* C, int ldc, int m, int n, 
+                                                  double alpha, double beta, int prefetch, const epilogue_t* ep)
+{
+    __m512d c0[8], c1[8], c2[8];
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) 
+    {
+        c0[j] = _mm512_setzero_pd();
+        c1[j] = _mm512_setzero_pd();
+        c2[j] = _mm512_setzero_pd();
+    }
+
+    if (prefetch > 0) 
+    {
+        prefetch_C(C, ldc * sizeof(double), m * (int)sizeof(double), n);
+    }
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        if (prefetch > 0) 
+        {
+            prefetch_lines(&A[prefetch * 24], 24 * sizeof(double));
+            prefetch_lines(&B[prefetch * 8], 8 * sizeof(double));
+        }
+
+        __m512d a0 = _mm512_load_pd(&A[0]);
+        __m512d a1 = _mm512_load_pd(&A[8]);
+        __m512d a2 = _mm512_load_pd(&A[16]);
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < 8; j++) 
+        {
+            __m512d b = _mm512_set1_pd(B[j]);
+            c0[j] = _mm512_fmadd_pd(a0, b, c0[j]);
+            c1[j] = _mm512_fmadd_pd(a1, b, c1[j]);
+            c2[j] = _mm512_fmadd_pd(a2, b, c2[j]);
+        }
+
+        A += 24;
+        B += 8;
+    }
+
+    __m512d va = _mm512_set1_pd(alpha), vb = _mm512_set1_pd(beta);
+    __mmask8 mask0 = (m >= 8) ? 0xFF : (__mmask8)((1u << m) - 1);
+    __mmask8 mask1 = (m >= 16) ? 0xFF : (m <= 8) ? 0 : (__mmask8)((1u << (m - 8)) - 1);
+    __mmask8 mask2 = (m >= 24) ? 0xFF : (m <= 16) ? 0 : (__mmask8)((1u << (m - 16)) - 1);
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) 
+    {
+        if (j >= n) 
+        {
+            break;
+        }
+
+        double* c = &C[j * ldc];
+        __m512d r0 = _mm512_mul_pd(va, c0[j]);
+        __m512d r1 = _mm512_mul_pd(va, c1[j]);
+        __m512d r2 = _mm512_mul_pd(va, c2[j]);
+
+        if (beta != 0.0) 
+        {
+            r0 = _mm512_fmadd_pd(vb, _mm512_maskz_loadu_pd(mask0, &c[0]), r0);
+            r1 = _mm512_fmadd_pd(vb, _mm512_maskz_loadu_pd(mask1, &c[8]), r1);
+            r2 = _mm512_fmadd_pd(vb, _mm512_maskz_loadu_pd(mask2, &c[16]), r2);
+        }
+
+        if (ep != NULL) 
+        {
+            r0 = epilogue_avx512(r0, mask0, ep, 0, j);
+            r1 = epilogue_avx512(r1, mask1, ep, 8, j);
+            r2 = epilogue_avx512(r2, mask2, ep, 16, j);
+        }
+
+        _mm512_mask_storeu_pd(&c[0], mask0, r0);
+        _mm512_mask_storeu_pd(&c[8], mask1, r1);
+        _mm512_mask_storeu_pd(&c[16], mask2, r2);
+    }
+}
+
+/**
+ * Portable 8x4 register block for float. The compiler keeps the
+ * 32 accumulators in 8 SSE registers.
+ */
+static void smicrokernel_8x4_scalar(int k_c, const float* A, const float* B, float* C, int ldc, int m, int n, 
+                                    float alpha, float beta, int prefetch, const epilogue_t* ep)
+{
+    float ab[4][8] = {{0}};
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        for (int j = 0; j < 4; j++) 
+        {
+            for (int i = 0; i < 8; i++) 
+            {
+                ab[j][i] += A[i] * B[j];
+            }
+        }
+        A += 8;
+        B += 4;
+    }
+
+    for (int j = 0; j < n; j++) 
+    {
+        for (int i = 0; i < m; i++) 
+        {
+            float v = alpha * ab[j][i] + (beta == 0.0f ? 0.0f : beta * C[j * ldc + i]);
+            C[j * ldc + i] = (ep != NULL) ? sepilogue_scalar(v, ep, i, j) : v;
+        }
+    }
+}
+
+/**
+ * Float version of update_C_fringe: rows past m are masked off eight
+ * at a time.
+ */
+TARGET_AVX2 static void supdate_C_fringe(float* C, int ldc, const float* ab, int m_r, int m, int n, float alpha, float beta, const epilogue_t* ep)
+{
+    __m256 va = _mm256_set1_ps(alpha), vb = _mm256_set1_ps(beta);
+    const __m256i lanes = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+    for (int j = 0; j < n; j++) 
+    {
+        for (int i = 0; i < m; i += 8) 
+        {
+            __m256i mask = _mm256_cmpgt_epi32(_mm256_set1_epi32(m - i), lanes);
+            __m256 v = _mm256_mul_ps(va, _mm256_maskload_ps(&ab[(size_t)j * m_r + i], mask));
+            if (beta != 0.0f) 
+            {
+                v = _mm256_fmadd_ps(vb, _mm256_maskload_ps(&C[(size_t)j * ldc + i], mask), v);
+            }
+            if (ep != NULL) 
+            {
+                v = sepilogue_avx2(v, mask, ep, i, j);
+            }
+            _mm256_maskstore_ps(&C[(size_t)j * ldc + i], mask, v);
+        }
+    }
+}
+
+/**
+ * 24x4 register block for float, the 12x4 double kernel with eight
+ * floats per YMM register: twelve accumulators, three per column.
+ */
+TARGET_AVX2 static void smicrokernel_24x4_avx2(int k_c, const float* A, const float* B, float* C, int ldc, int m, int n, 
+                                               float alpha, float beta, int prefetch, const epilogue_t* ep)
+{
+    __m256 c0[4], c1[4], c2[4];
+
+    #pragma GCC unroll 4
+    for (int j = 0; j < 4; j++) 
+    {
+        c0[j] = _mm256_setzero_ps();
+        c1[j] = _mm256_setzero_ps();
+        c2[j] = _mm256_setzero_ps();
+    }
+
+    if (prefetch > 0) 
+    {
+        prefetch_C(C, ldc * sizeof(float), m * (int)sizeof(float), n);
+    }
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        if (prefetch > 0) 
+        {
+            prefetch_lines(&A[prefetch * 24], 24 * sizeof(float));
+            prefetch_lines(&B[prefetch * 4], 4 * sizeof(float));
+        }
+
+        __m256 a0 = _mm256_load_ps(&A[0]);
+        __m256 a1 = _mm256_load_ps(&A[8]);
+        __m256 a2 = _mm256_load_ps(&A[16]);
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < 4; j++) 
+        {
+            __m256 b = _mm256_broadcast_ss(&B[j]);
+            c0[j] = _mm256_fmadd_ps(a0, b, c0[j]);
+            c1[j] = _mm256_fmadd_ps(a1, b, c1[j]);
+            c2[j] = _mm256_fmadd_ps(a2, b, c2[j]);
+        }
+
+        A += 24;
+        B += 4;
+    }
+
+    if (m < 24 || n < 4) 
+    {
+        float ab[24 * 4];
+
+        #pragma GCC unroll 4
+        for (int j = 0; j < 4; j++) 
+        {
+            _mm256_storeu_ps(&ab[j * 24 + 0], c0[j]);
+            _mm256_storeu_ps(&ab[j * 24 + 8], c1[j]);
+            _mm256_storeu_ps(&ab[j * 24 + 16], c2[j]);
+        }
+        supdate_C_fringe(C, ldc, ab, 24, m, n, alpha, beta, ep);
+        return;
+    }
+
+    __m256 va = _mm256_set1_ps(alpha), vb = _mm256_set1_ps(beta);
+
+    #pragma GCC unroll 4
+    for (int j = 0; j < 4; j++) 
+    {
+        float* c = &C[j * ldc];
+        __m256 r0 = _mm256_mul_ps(va, c0[j]);
+        __m256 r1 = _mm256_mul_ps(va, c1[j]);
+        __m256 r2 = _mm256_mul_ps(va, c2[j]);
+
+        if (beta != 0.0f) 
+        {
+            r0 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(&c[0]), r0);
+            r1 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(&c[8]), r1);
+            r2 = _mm256_fmadd_ps(vb, _mm256_loadu_ps(&c[16]), r2);
+        }
+
+        if (ep != NULL) 
+        {
+            const __m256i all = _mm256_set1_epi32(-1);
+            r0 = sepilogue_avx2(r0, all, ep, 0, j);
+            r1 = sepilogue_avx2(r1, all, ep, 8, j);
+            r2 = sepilogue_avx2(r2, all, ep, 16, j);
+        }
+
+        _mm256_storeu_ps(&c[0], r0);
+        _mm256_storeu_ps(&c[8], r1);
+        _mm256_storeu_ps(&c[16], r2);
+    }
+}
+
+/**
+ * 48x8 register block for float on AVX-512, the 24x8 double kernel
+ * with sixteen floats per ZMM register.
+ */
+TARGET_AVX512 static void smicrokernel_48x8_avx512(int k_c, const float* A, const float* B, float* C, int ldc, int m, int n, 
+                                                   float alpha, float beta, int prefetch, const epilogue_t* ep)
+{
+    __m512 c0[8], c1[8], c2[8];
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) 
+    {
+        c0[j] = _mm512_setzero_ps();
+        c1[j] = _mm512_setzero_ps();
+        c2[j] = _mm512_setzero_ps();
+    }
+
+    if (prefetch > 0) 
+    {
+        prefetch_C(C, ldc * sizeof(float), m * (int)sizeof(float), n);
+    }
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        if (prefetch > 0) 
+        {
+            prefetch_lines(&A[prefetch * 48], 48 * sizeof(float));
+            prefetch_lines(&B[prefetch * 8], 8 * sizeof(float));
+        }
+
+        __m512 a0 = _mm512_load_ps(&A[0]);
+        __m512 a1 = _mm512_load_ps(&A[16]);
+        __m512 a2 = _mm512_load_ps(&A[32]);
+
+        #pragma GCC unroll 8
+        for (int j = 0; j < 8; j++) 
+        {
+            __m512 b = _mm512_set1_ps(B[j]);
+            c0[j] = _mm512_fmadd_ps(a0, b, c0[j]);
+            c1[j] = _mm512_fmadd_ps(a1, b, c1[j]);
+            c2[j] = _mm512_fmadd_ps(a2, b, c2[j]);
+        }
+
+        A += 48;
+        B += 8;
+    }
+
+    __m512 va = _mm512_set1_ps(alpha), vb = _mm512_set1_ps(beta);
+    __mmask16 mask0 = (m >= 16) ? 0xFFFF : (__mmask16)((1u << m) - 1);
+    __mmask16 mask1 = (m >= 32) ? 0xFFFF : (m <= 16) ? 0 : (__mmask16)((1u << (m - 16)) - 1);
+    __mmask16 mask2 = (m >= 48) ? 0xFFFF : (m <= 32) ? 0 : (__mmask16)((1u << (m - 32)) - 1);
+
+    #pragma GCC unroll 8
+    for (int j = 0; j < 8; j++) 
+    {
+        if (j >= n) 
+        {
+            break;
+        }
+
+        float* c = &C[j * ldc];
+        __m512 r0 = _mm512_mul_ps(va, c0[j]);
+        __m512 r1 = _mm512_mul_ps(va, c1[j]);
+        __m512 r2 = _mm512_mul_ps(va, c2[j]);
+
+        if (beta != 0.0f) 
+        {
+            r0 = _mm512_fmadd_ps(vb, _mm512_maskz_loadu_ps(mask0, &c[0]), r0);
+            r1 = _mm512_fmadd_ps(vb, _mm512_maskz_loadu_ps(mask1, &c[16]), r1);
+            r2 = _mm512_fmadd_ps(vb, _mm512_maskz_loadu_ps(mask2, &c[32]), r2);
+        }
+
+        if (ep != NULL) 
+        {
+            r0 = sepilogue_avx512(r0, mask0, ep, 0, j);
+            r1 = sepilogue_avx512(r1, mask1, ep, 16, j);
+            r2 = sepilogue_avx512(r2, mask2, ep, 32, j);
+        }
+
+        _mm512_mask_storeu_ps(&c[0], mask0, r0);
+        _mm512_mask_storeu_ps(&c[16], mask1, r1);
+        _mm512_mask_storeu_ps(&c[32], mask2, r2);
+    }
+}
+
+/**
+ * Merges an m x n corner of a complex product tile into C, applying ep if
+ * it is not NULL. The merge runs once per k_c loop, so plain complex
+ * arithmetic is fast enough.
+ */
+static void zupdate_C(double complex* C, int ldc, const double complex* ab, int m_r, int m, int n, double complex alpha, double complex beta, 
+                      const epilogue_t* ep)
+{
+    for (int j = 0; j < n; j++) 
+    {
+        for (int i = 0; i < m; i++) 
+        {
+            double complex v = alpha * ab[j * m_r + i] + (beta == 0.0 ? 0.0 : beta * C[j * ldc + i]);
+            C[j * ldc + i] = (ep != NULL) ? zepilogue_scalar(v, ep, i, j) : v;
+        }
+    }
+}
+
+/**
+ * Portable 2x2 register block for double complex, with the real and
+ * imaginary parts accumulated separately.
+ */
+static void zmicrokernel_2x2_scalar(int k_c, const double complex* A, const double complex* B, double complex* C, int ldc, int m, int n, 
+                                    double complex alpha, double complex beta, int prefetch, const epilogue_t* ep)
+{
+    const double* a = (const double*)A;
+    const double* b = (const double*)B;
+    double re[2][2] = {{0}}, im[2][2] = {{0}};
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        for (int j = 0; j < 2; j++) 
+        {
+            for (int i = 0; i < 2; i++) 
+            {
+                re[j][i] += a[2 * i] * b[2 * j] - a[2 * i + 1] * b[2 * j + 1];
+                im[j][i] += a[2 * i] * b[2 * j + 1] + a[2 * i + 1] * b[2 * j];
+            }
+        }
+        a += 4;
+        b += 4;
+    }
+
+    double complex ab[2 * 2];
+    for (int j = 0; j < 2; j++) 
+    {
+        for (int i = 0; i < 2; i++) 
+        {
+            ab[j * 2 + i] = re[j][i] + im[j][i] * I;
+        }
+    }
+    zupdate_C(C, ldc, ab, 2, m, n, alpha, beta, ep);
+}
+
+/**
+ * 4x3 register block for double complex. A YMM register holds two
+ * interleaved complex numbers of A. Each is multiplied by the real and
+ * by the imaginary part of b in two separate accumulators, 12 in all,
+ * and the pairs are combined once at the end:
+ * (ar br - ai bi, ai br + ar bi) = addsub(a * br, swap(a * bi)).
+ */
+TARGET_AVX2 static void zmicrokernel_4x3_avx2(int k_c, const double complex* A, const double complex* B, double complex* C, int ldc, int m, int n, 
+                                              double complex alpha, double complex beta, int prefetch, const epilogue_t* ep)
+{
+    const double* a = (const double*)A;
+    const double* b = (const double*)B;
+    __m256d re0[3], re1[3], im0[3], im1[3];
+
+    #pragma GCC unroll 3
+    for (int j = 0; j < 3; j++) 
+    {
+        re0[j] = _mm256_setzero_pd();
+        re1[j] = _mm256_setzero_pd();
+        im0[j] = _mm256_setzero_pd();
+        im1[j] = _mm256_setzero_pd();
+    }
+
+    if (prefetch > 0) 
+    {
+        prefetch_C(C, ldc * sizeof(double complex), m * (int)sizeof(double complex), n);
+    }
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        if (prefetch > 0) 
+        {
+            prefetch_lines(&a[prefetch * 8], 8 * sizeof(double));
+            prefetch_lines(&b[prefetch * 6], 6 * sizeof(double));
+        }
+
+        __m256d a0 = _mm256_load_pd(&a[0]);
+        __m256d a1 = _mm256_load_pd(&a[4]);
+
+        #pragma GCC unroll 3
+        for (int j = 0; j < 3; j++) 
+        {
+            __m256d br = _mm256_broadcast_sd(&b[2 * j]);
+            __m256d bi = _mm256_broadcast_sd(&b[2 * j + 1]);
+            re0[j] = _mm256_fmadd_pd(a0, br, re0[j]);
+            re1[j] = _mm256_fmadd_pd(a1, br, re1[j]);
+            im0[j] = _mm256_fmadd_pd(a0, bi, im0[j]);
+            im1[j] = _mm256_fmadd_pd(a1, bi, im1[j]);
+        }
+
+        a += 8;
+        b += 6;
+    }
+
+    double complex ab[4 * 3];
+
+    #pragma GCC unroll 3
+    for (int j = 0; j < 3; j++) 
+    {
+        _mm256_storeu_pd((double*)&ab[j * 4 + 0], _mm256_addsub_pd(re0[j], _mm256_permute_pd(im0[j], 0x5)));
+        _mm256_storeu_pd((double*)&ab[j * 4 + 2], _mm256_addsub_pd(re1[j], _mm256_permute_pd(im1[j], 0x5)));
+    }
+    zupdate_C(C, ldc, ab, 4, m, n, alpha, beta, ep);
+}
+
+/**
+ * 8x6 register block for double complex on AVX-512, the 4x3 kernel with
+ * four complex numbers per ZMM register: 24 accumulators, two vectors
+ * of A and two broadcasts of B. AVX-512 has no addsub, so the pairs are
+ * combined with fmaddsub(re, 1, swap(im)).
+ */
+TARGET_AVX512 static void zmicrokernel_8x6_avx512(int k_c, const double complex* A, const double complex* B, double complex* C, int ldc, int m, int n, 
+                                                  double complex alpha, double complex beta, int prefetch, const epilogue_t* ep)
+{
+    const double* a = (const double*)A;
+    const double* b = (const double*)B;
+    __m512d re0[6], re1[6], im0[6], im1[6];
+
+    #pragma GCC unroll 6
+    for (int j = 0; j < 6; j++) 
+    {
+        re0[j] = _mm512_setzero_pd();
+        re1[j] = _mm512_setzero_pd();
+        im0[j] = _mm512_setzero_pd();
+        im1[j] = _mm512_setzero_pd();
+    }
+
+    if (prefetch > 0) 
+    {
+        prefetch_C(C, ldc * sizeof(double complex), m * (int)sizeof(double complex), n);
+    }
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        if (prefetch > 0) 
+        {
+            prefetch_lines(&a[prefetch * 16], 16 * sizeof(double));
+            prefetch_lines(&b[prefetch * 12], 12 * sizeof(double));
+        }
+
+        __m512d a0 = _mm512_load_pd(&a[0]);
+        __m512d a1 = _mm512_load_pd(&a[8]);
+
+        #pragma GCC unroll 6
+        for (int j = 0; j < 6; j++) 
+        {
+            __m512d br = _mm512_set1_pd(b[2 * j]);
+            __m512d bi = _mm512_set1_pd(b[2 * j + 1]);
+            re0[j] = _mm512_fmadd_pd(a0, br, re0[j]);
+            re1[j] = _mm512_fmadd_pd(a1, br, re1[j]);
+            im0[j] = _mm512_fmadd_pd(a0, bi, im0[j]);
+            im1[j] = _mm512_fmadd_pd(a1, bi, im1[j]);
+        }
+
+        a += 16;
+        b += 12;
+    }
+
+    double complex ab[8 * 6];
+    const __m512d one = _mm512_set1_pd(1.0);
+
+    #pragma GCC unroll 6
+    for (int j = 0; j < 6; j++) 
+    {
+        _mm512_storeu_pd((double*)&ab[j * 8 + 0], _mm512_fmaddsub_pd(re0[j], one, _mm512_permute_pd(im0[j], 0x55)));
+        _mm512_storeu_pd((double*)&ab[j * 8 + 4], _mm512_fmaddsub_pd(re1[j], one, _mm512_permute_pd(im1[j], 0x55)));
+    }
+    zupdate_C(C, ldc, ab, 8, m, n, alpha, beta, ep);
+}
+
+static const microkernel_t microkernels[] = {
+    {"avx512 48x8", DTYPE_FLOAT, ISA_AVX512, 48, 8, 8, {.s = smicrokernel_48x8_avx512}},
+    {"avx2 24x4", DTYPE_FLOAT, ISA_AVX2, 24, 4, 4, {.s = smicrokernel_24x4_avx2}},
+    {"scalar 8x4", DTYPE_FLOAT, ISA_SCALAR, 8, 4, 1, {.s = smicrokernel_8x4_scalar}},
+    {"avx512 24x8", DTYPE_DOUBLE, ISA_AVX512, 24, 8, 8, {.d = microkernel_24x8_avx512}},
+    {"avx2 12x4", DTYPE_DOUBLE, ISA_AVX2, 12, 4, 4, {.d = microkernel_12x4_avx2}},
+    {"avx2 8x6", DTYPE_DOUBLE, ISA_AVX2, 8, 6, 4, {.d = microkernel_8x6_avx2}},
+    {"scalar 4x4", DTYPE_DOUBLE, ISA_SCALAR, 4, 4, 1, {.d = microkernel_4x4_scalar}},
+    {"avx512 8x6", DTYPE_COMPLEX, ISA_AVX512, 8, 6, 8, {.z = zmicrokernel_8x6_avx512}},
+    {"avx2 4x3", DTYPE_COMPLEX, ISA_AVX2, 4, 3, 4, {.z = zmicrokernel_4x3_avx2}},
+    {"scalar 2x2", DTYPE_COMPLEX, ISA_SCALAR, 2, 2, 1, {.z = zmicrokernel_2x2_scalar}},
+};
+
+#define MICROKERNEL_COUNT (int)(sizeof(microkernels) / sizeof(microkernels[0]))
+
+int detect_isa(void)
+{
+    static int isa = -1;
+
+    if (isa < 0) 
+    {
+        // MAXGFLOPS_ISA=scalar|avx2|avx512 caps the instruction set
+        const char* force = getenv("MAXGFLOPS_ISA");
+        int limit = ISA_AVX512;
+        if (force != NULL && strcmp(force, "scalar") == 0) { limit = ISA_SCALAR; }
+        if (force != NULL && strcmp(force, "avx2") == 0) { limit = ISA_AVX2; }
+
+        __builtin_cpu_init();
+        int detected = ISA_SCALAR;
+        if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) 
+        {
+            detected = ISA_AVX2;
+        }
+        if (detected == ISA_AVX2 && __builtin_cpu_supports("avx512f")) 
+        {
+            detected = ISA_AVX512;
+        }
+        isa = (detected < limit) ? detected : limit;
+    }
+    return isa;
+}
+
+const microkernel_t* select_microkernel(int dtype)
+{
+    int isa = detect_isa();
+    const microkernel_t* fallback = NULL;
+
+    // The table is ordered by element type and, within one, from the widest instruction set down
+    for (int i = 0; i < MICROKERNEL_COUNT; i++) 
+    {
+        if (microkernels[i].dtype != dtype) 
+        {
+            continue;
+        }
+        if (microkernels[i].isa <= isa) 
+        {
+            return &microkernels[i];
+        }
+        fallback = &microkernels[i];
+    }
+    return fallback;
+}
+
+const microkernel_t* find_microkernel(int dtype, int m_r, int n_r)
+{
+    int isa = detect_isa();
+
+    for (int i = 0; i < MICROKERNEL_COUNT; i++) 
+    {
+        if (microkernels[i].dtype == dtype && microkernels[i].m_r == m_r && microkernels[i].n_r == n_r && microkernels[i].isa <= isa) 
+        {
+            return &microkernels[i];
+        }
+    }
+    return NULL;
+}
+
+int supported_microkernels(int dtype, const microkernel_t** kernels, int max_kernels)
+{
+    int isa = detect_isa();
+    int count = 0;
+
+    for (int i = 0; i < MICROKERNEL_COUNT && count < max_kernels; i++) 
+    {
+        if (microkernels[i].dtype == dtype && microkernels[i].isa <= isa) 
+        {
+            kernels[count++] = &microkernels[i];
+        }
+    }
+    return count;
+}
+/**
+ * AVX-512 pass of apply_epilogue, eight rows at a time.
+ */
+TARGET_AVX512 static void epilogue_pass_avx512(double* C, int ldc, int M, int N, const epilogue_t* ep)
+{
+    for (int j = 0; j < N; j++) 
+    {
+        for (int i = 0; i < M; i += 8) 
+        {
+            __mmask8 mask = (M - i >= 8) ? 0xFF : (__mmask8)((1u << (M - i)) - 1);
+            double* c = &C[(size_t)j * ldc + i];
+            _mm512_mask_storeu_pd(c, mask, epilogue_avx512(_mm512_maskz_loadu_pd(mask, c), mask, ep, i, j));
+        }
+    }
+}
+
+TARGET_AVX512 static void sepilogue_pass_avx512(float* C, int ldc, int M, int N, const epilogue_t* ep)
+{
+    for (int j = 0; j < N; j++) 
+    {
+        for (int i = 0; i < M; i += 16) 
+        {
+            __mmask16 mask = (M - i >= 16) ? 0xFFFF : (__mmask16)((1u << (M - i)) - 1);
+            float* c = &C[(size_t)j * ldc + i];
+            _mm512_mask_storeu_ps(c, mask, sepilogue_avx512(_mm512_maskz_loadu_ps(mask, c), mask, ep, i, j));
+        }
+    }
+}
+
+void apply_epilogue(double* C, int ldc, int M, int N, const epilogue_t* ep)
+{
+    if (ep == NULL) 
+    {
+        return;
+    }
+
+    switch (detect_isa()) 
+    {
+        case ISA_AVX512:
+            epilogue_pass_avx512(C, ldc, M, N, ep);
+            break;
+        case ISA_AVX2:
+            // C merged into itself with alpha = 1 and beta = 0
+            update_C_fringe(C, ldc, C, ldc, M, N, 1.0, 0.0, ep);
+            break;
+        default:
+            for (int j = 0; j < N; j++) 
+            {
+                for (int i = 0; i < M; i++) 
+                {
+                    C[(size_t)j * ldc + i] = epilogue_scalar(C[(size_t)j * ldc + i], ep, i, j);
+                }
+            }
+    }
+}
+
+void sapply_epilogue(float* C, int ldc, int M, int N, const epilogue_t* ep)
+{
+    if (ep == NULL) 
+    {
+        return;
+    }
+
+    switch (detect_isa()) 
+    {
+        case ISA_AVX512:
+            sepilogue_pass_avx512(C, ldc, M, N, ep);
+            break;
+        case ISA_AVX2:
+            supdate_C_fringe(C, ldc, C, ldc, M, N, 1.0f, 0.0f, ep);
+            break;
+        default:
+            for (int j = 0; j < N; j++) 
+            {
+                for (int i = 0; i < M; i++) 
+                {
+                    C[(size_t)j * ldc + i] = sepilogue_scalar(C[(size_t)j * ldc + i], ep, i, j);
+                }
+            }
+    }
+}
+
+void zapply_epilogue(double complex* C, int ldc, int M, int N, const epilogue_t* ep)
+{
+    if (ep == NULL) 
+    {
+        return;
+    }
+
+    for (int j = 0; j < N; j++) 
+    {
+        for (int i = 0; i < M; i++) 
+        {
+            C[(size_t)j * ldc + i] = zepilogue_scalar(C[(size_t)j * ldc + i], ep, i, j);
+        }
+    }
+}
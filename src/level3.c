@@ -0,0 +1,581 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Symmetric and triangular level 3 routines (SYRK, SYMM and
+ * TRMM) on the packing routines and microkernels of gebp. Each
+ * computes only the part of C it needs and packs symmetric and
+ * triangular operands straight from their stored triangle.
+ * Everything is column major.
+ */
+
+#include <omp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "arena.h"
+#include "gemm.h"
+#include "level3.h"
+#include "matrix_ops.h"
+#include "tune.h"
+
+#define SHAPE_GENERAL 0 // Every element stored
+#define SHAPE_SYMMETRIC 1 // One triangle stored, the other is its mirror image
+#define SHAPE_TRIANGULAR 2 // One triangle stored, the other is zero
+
+#define BLOCK_STRIDED 0 // The block is a strided view of the stored matrix
+#define BLOCK_ZERO 1 // The block is all zeros
+#define BLOCK_MIXED 2 // The block crosses the diagonal
+
+#define PART_ALL 0 // All of C is computed
+#define PART_LOWER 1 // The lower triangle of C, with the diagonal
+#define PART_UPPER 2 // The upper triangle of C, with the diagonal
+
+#define TILE_SKIP 0 // Register tile left alone
+#define TILE_FULL 1 // Register tile merged straight into C
+#define TILE_DIAGONAL 2 // Register tile crossing the diagonal of C
+
+/**
+ * An operand of the product, op(X), as it is stored.
+ */
+typedef struct
+{
+    const double* X; // Stored matrix, column-major
+    int ld; // Leading dimension of X
+    int trans; // 1 if the operand is X^T
+    int shape; // SHAPE_*
+    int lower; // 1 if the lower triangle of a symmetric or triangular X is the one stored
+    int unit; // 1 if a triangular X has ones on its diagonal, not stored
+} operand_t;
+
+/**
+ * Returns element (r, c) of op(X).
+ */
+static double operand_at(const operand_t* x, int r, int c)
+{
+    if (x->shape == SHAPE_SYMMETRIC) 
+    {
+        int hi = (r > c) ? r : c, lo = (r > c) ? c : r;
+        return x->lower ? x->X[(size_t)lo * x->ld + hi] : x->X[(size_t)hi * x->ld + lo];
+    }
+    if (x->shape == SHAPE_TRIANGULAR) 
+    {
+        int lower = (x->lower != x->trans); // op(X) is lower triangular
+        if (lower ? r < c : r > c) 
+        {
+            return 0.0;
+        }
+        if (r == c && x->unit) 
+        {
+            return 1.0;
+        }
+    }
+    return x->trans ? x->X[(size_t)r * x->ld + c] : x->X[(size_t)c * x->ld + r];
+}
+
+/**
+ * Classifies the rows x cols block of op(X) at (r0, c0). A BLOCK_STRIDED
+ * block is element (r, c) = X[r * rs + c * cs]: a general operand, a block
+ * of a symmetric X on one side of the diagonal (read from the stored
+ * triangle, or from its mirror with the strides swapped), or a block of
+ * a triangular X strictly inside its triangle.
+ */
+static int operand_block(const operand_t* x, int r0, int c0, int rows, int cols, int* rs, int* cs)
+{
+    int r1 = r0 + rows - 1, c1 = c0 + cols - 1; // Last row and column of the block
+
+    *rs = x->trans ? x->ld : 1;
+    *cs = x->trans ? 1 : x->ld;
+
+    if (x->shape == SHAPE_SYMMETRIC) 
+    {
+        int below = (r0 >= c1), above = (r1 <= c0); // On or below, on or above the diagonal
+        if (!below && !above) 
+        {
+            return BLOCK_MIXED;
+        }
+        int stored = x->lower ? below : above;
+        *rs = stored ? 1 : x->ld;
+        *cs = stored ? x->ld : 1;
+    }
+    else if (x->shape == SHAPE_TRIANGULAR) 
+    {
+        int lower = (x->lower != x->trans); // op(X) is lower triangular
+        if (lower ? r1 < c0 : r0 > c1) 
+        {
+            return BLOCK_ZERO;
+        }
+        if (lower ? r0 <= c1 : r1 >= c0) 
+        {
+            return BLOCK_MIXED;
+        }
+    }
+    return BLOCK_STRIDED;
+}
+
+/**
+ * Packs one micro-panel of op(A), rows [row, row + m) of the k slice, in
+ * the layout of pack_A. An all-zero micro-panel is left unpacked (the
+ * caller skips it). One crossing the diagonal is split at the columns
+ * the diagonal passes through: the parts on either side go through
+ * pack_A or are zeroed, and only the m x m part on the diagonal is
+ * packed element by element.
+ */
+static void pack_panel_A(double* panel, const operand_t* a, int row, int m, int m_r, int k_block, int k_b)
+{
+    int rs, cs;
+    int kind = operand_block(a, row, k_block, m, k_b, &rs, &cs);
+
+    if (kind == BLOCK_STRIDED) 
+    {
+        pack_A(panel, a->X, rs, cs, m, k_b, m_r, row, k_block);
+        return;
+    }
+    if (kind == BLOCK_ZERO) 
+    {
+        return;
+    }
+
+    int cuts[4] = {k_block, row, row + m, k_block + k_b};
+    for (int s = 0; s < 3; s++) 
+    {
+        int c0 = (cuts[s] < k_block) ? k_block : (cuts[s] > k_block + k_b) ? k_block + k_b : cuts[s];
+        int c1 = (cuts[s + 1] < k_block) ? k_block : (cuts[s + 1] > k_block + k_b) ? k_block + k_b : cuts[s + 1];
+        double* dst = &panel[(size_t)(c0 - k_block) * m_r];
+
+        if (c1 <= c0) 
+        {
+            continue;
+        }
+
+        kind = operand_block(a, row, c0, m, c1 - c0, &rs, &cs);
+        if (kind == BLOCK_STRIDED) 
+        {
+            pack_A(dst, a->X, rs, cs, m, c1 - c0, m_r, row, c0);
+        }
+        else if (kind == BLOCK_ZERO) 
+        {
+            memset(dst, 0, (size_t)(c1 - c0) * m_r * sizeof(double));
+        }
+        else 
+        {
+            for (int k = 0; k < c1 - c0; k++) 
+            {
+                for (int ii = 0; ii < m_r; ii++) 
+                {
+                    dst[k * m_r + ii] = (ii < m) ? operand_at(a, row + ii, c0 + k) : 0.0;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Packs one micro-panel of op(B), columns [col, col + n) of the k slice,
+ * in the layout of pack_B, split at the diagonal as pack_panel_A does.
+ */
+static void pack_panel_B(double* panel, const operand_t* b, int col, int n, int n_r, int k_block, int k_b)
+{
+    int rs, cs;
+    int kind = operand_block(b, k_block, col, k_b, n, &rs, &cs);
+
+    if (kind == BLOCK_STRIDED) 
+    {
+        pack_B(panel, b->X, rs, cs, k_b, n, n_r, col, k_block);
+        return;
+    }
+    if (kind == BLOCK_ZERO) 
+    {
+        return;
+    }
+
+    int cuts[4] = {k_block, col, col + n, k_block + k_b};
+    for (int s = 0; s < 3; s++) 
+    {
+        int r0 = (cuts[s] < k_block) ? k_block : (cuts[s] > k_block + k_b) ? k_block + k_b : cuts[s];
+        int r1 = (cuts[s + 1] < k_block) ? k_block : (cuts[s + 1] > k_block + k_b) ? k_block + k_b : cuts[s + 1];
+        double* dst = &panel[(size_t)(r0 - k_block) * n_r];
+
+        if (r1 <= r0) 
+        {
+            continue;
+        }
+
+        kind = operand_block(b, r0, col, r1 - r0, n, &rs, &cs);
+        if (kind == BLOCK_STRIDED) 
+        {
+            pack_B(dst, b->X, rs, cs, r1 - r0, n, n_r, col, r0);
+        }
+        else if (kind == BLOCK_ZERO) 
+        {
+            memset(dst, 0, (size_t)(r1 - r0) * n_r * sizeof(double));
+        }
+        else 
+        {
+            for (int k = 0; k < r1 - r0; k++) 
+            {
+                for (int jj = 0; jj < n_r; jj++) 
+                {
+                    dst[k * n_r + jj] = (jj < n) ? operand_at(b, r0 + k, col + jj) : 0.0;
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Returns 1 if element (i, j) of C is in the part computed.
+ */
+static int in_part(int c_part, int i, int j)
+{
+    return (c_part == PART_LOWER) ? i >= j : (c_part == PART_UPPER) ? i <= j : 1;
+}
+
+/**
+ * Classifies the m x n register tile of C at (row, col) against the part computed.
+ */
+static int tile_kind(int c_part, int row, int m, int col, int n)
+{
+    if (c_part == PART_LOWER) 
+    {
+        return (row + m - 1 < col) ? TILE_SKIP : (row >= col + n - 1) ? TILE_FULL : TILE_DIAGONAL;
+    }
+    if (c_part == PART_UPPER) 
+    {
+        return (row > col + n - 1) ? TILE_SKIP : (row + m - 1 <= col) ? TILE_FULL : TILE_DIAGONAL;
+    }
+    return TILE_FULL;
+}
+
+/**
+ * Sets the part of C computed to beta times itself, without reading C when beta is 0.
+ */
+static void scale_part(int M, int N, double beta, double* C, int ldc, int c_part)
+{
+    if (beta == 1.0) 
+    {
+        return;
+    }
+    for (int j = 0; j < N; j++) 
+    {
+        int first = (c_part == PART_LOWER) ? j : 0;
+        int last = (c_part == PART_UPPER && j + 1 < M) ? j + 1 : M;
+
+        for (int i = first; i < last; i++) 
+        {
+            double* c = &C[(size_t)j * ldc + i];
+            *c = (beta == 0.0) ? 0.0 : beta * *c;
+        }
+    }
+}
+
+/**
+ * The five loop nest of gebp for C = alpha * op(A) * op(B) + beta * C with
+ * symmetric and triangular operands and, for c_part PART_LOWER or
+ * PART_UPPER, only a triangle of C. Blocks of A with no rows in the part
+ * of C, or all zeros in the k slice, are not packed; runs of register
+ * tiles inside the part are handed to multiply_blocks_avx together, and
+ * tiles crossing the diagonal of C are computed into a scratch tile and
+ * merged an element at a time. The threads share the packed panel of B
+ * and divide the blocks of A that have work, as in gebp.
+ */
+static void part_gebp(int M, int N, int K, double alpha, const operand_t* A, const operand_t* B, double beta,
+                      double* C, int ldc, int c_part, const blocking_t* b, int num_threads)
+{
+    int m_c = b->m_c, k_c = b->k_c, n_c = b->n_c, n_r = b->n_r, m_r = b->m_r;
+
+    // With a triangular operand some tiles get no k slice to apply beta in, so it is applied up front
+    if (K <= 0 || alpha == 0.0 || A->shape == SHAPE_TRIANGULAR || B->shape == SHAPE_TRIANGULAR) 
+    {
+        scale_part(M, N, beta, C, ldc, c_part);
+        if (K <= 0 || alpha == 0.0) 
+        {
+            return;
+        }
+        beta = 1.0;
+    }
+
+    int m_c_used = (M < m_c) ? M : m_c;
+    int n_c_used = (N < n_c) ? N : n_c;
+    int k_c_used = (K < k_c) ? K : k_c;
+    int m_c_padded = (m_c_used + m_r - 1) / m_r * m_r;
+    int n_c_padded = (n_c_used + n_r - 1) / n_r * n_r;
+    double* B_packed = (double*)arena_get(ARENA_PACK_B, (size_t)k_c_used * n_c_padded * sizeof(double)); // Panel of B: k_c x n_c, shared
+    int i_blocks = (M + m_c - 1) / m_c;
+    int threads = (num_threads > 0) ? num_threads : omp_get_max_threads();
+
+    #pragma omp parallel num_threads(threads)
+    {
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+        double* A_packed = (double*)arena_get(ARENA_PACK_A, (size_t)m_c_padded * k_c_used * sizeof(double)); // Block of A: m_c x k_c, per thread
+        double tile[MR_MAX * NR_MAX]; // Register tile crossing the diagonal of C
+        int rs, cs;
+
+        for (int j_block = 0; j_block < N; j_block += n_c) 
+        {
+            int n_b = (N - j_block < n_c) ? N - j_block : n_c;
+
+            for (int k_block = 0; k_block < K; k_block += k_c) 
+            {
+                int k_b = (K - k_block < k_c) ? K - k_block : k_c;
+                double beta_k = (k_block == 0) ? beta : 1.0;
+
+                // The blocks of A with rows in the part of C and, for a triangular A, nonzeros in the slice
+                int lo = 0, hi = i_blocks;
+                if (c_part == PART_LOWER) 
+                {
+                    lo = j_block / m_c;
+                }
+                else if (c_part == PART_UPPER) 
+                {
+                    hi = (j_block + n_b - 1) / m_c + 1;
+                }
+                if (A->shape == SHAPE_TRIANGULAR) 
+                {
+                    if (A->lower != A->trans) 
+                    {
+                        lo = (k_block / m_c > lo) ? k_block / m_c : lo;
+                    }
+                    else 
+                    {
+                        hi = ((k_block + k_b - 1) / m_c + 1 < hi) ? (k_block + k_b - 1) / m_c + 1 : hi;
+                    }
+                }
+                int range = (hi > lo) ? hi - lo : 0;
+                int first = lo + (int)((long)range * tid / nthreads);
+                int last_block = lo + (int)((long)range * (tid + 1) / nthreads);
+
+                // Each thread packs every nthreads-th micro-panel of the shared panel
+                for (int j = tid * n_r; j < n_b; j += nthreads * n_r) 
+                {
+                    int n = (n_b - j < n_r) ? n_b - j : n_r;
+                    pack_panel_B(&B_packed[(size_t)j * k_b], B, j_block + j, n, n_r, k_block, k_b);
+                }
+
+                #pragma omp barrier
+
+                for (int ib = first; ib < last_block; ib++) 
+                {
+                    int i_block = ib * m_c;
+                    int m_b = (M - i_block < m_c) ? M - i_block : m_c;
+
+                    for (int i = 0; i < m_b; i += m_r) 
+                    {
+                        int m = (m_b - i < m_r) ? m_b - i : m_r;
+                        pack_panel_A(&A_packed[(size_t)i * k_b], A, i_block + i, m, m_r, k_block, k_b);
+                    }
+
+                    for (int j = 0; j < n_b; j += n_r) 
+                    {
+                        int n = (n_b - j < n_r) ? n_b - j : n_r;
+                        int col = j_block + j;
+                        double* B_panel = &B_packed[(size_t)j * k_b];
+                        double* C_col = &C[(size_t)col * ldc + i_block];
+                        int run = 0; // First row of the current run of full tiles
+
+                        if (operand_block(B, k_block, col, k_b, n, &rs, &cs) == BLOCK_ZERO) 
+                        {
+                            continue;
+                        }
+
+                        for (int i = 0; i < m_b; i += m_r) 
+                        {
+                            int m = (m_b - i < m_r) ? m_b - i : m_r;
+                            int row = i_block + i;
+                            int kind = (operand_block(A, row, k_block, m, k_b, &rs, &cs) == BLOCK_ZERO) ? TILE_SKIP
+                                     : tile_kind(c_part, row, m, col, n);
+
+                            if (kind == TILE_FULL) 
+                            {
+                                continue;
+                            }
+                            if (i > run) 
+                            {
+                                multiply_blocks_avx(&A_packed[(size_t)run * k_b], B_panel, &C_col[run], ldc, i - run, n, k_b, n_r, m_r,
+                                                    alpha, beta_k, b->prefetch, NULL);
+                            }
+                            run = i + m_r;
+
+                            if (kind == TILE_DIAGONAL) 
+                            {
+                                multiply_blocks_avx(&A_packed[(size_t)i * k_b], B_panel, tile, m_r, m, n, k_b, n_r, m_r,
+                                                    alpha, 0.0, b->prefetch, NULL);
+                                for (int jj = 0; jj < n; jj++) 
+                                {
+                                    for (int ii = 0; ii < m; ii++) 
+                                    {
+                                        if (in_part(c_part, row + ii, col + jj)) 
+                                        {
+                                            double* c = &C_col[(size_t)jj * ldc + i + ii];
+                                            *c = tile[jj * m_r + ii] + ((beta_k == 0.0) ? 0.0 : beta_k * *c);
+                                        }
+                                    }
+                                }
+                            }
+                        }
+                        if (m_b > run) 
+                        {
+                            multiply_blocks_avx(&A_packed[(size_t)run * k_b], B_panel, &C_col[run], ldc, m_b - run, n, k_b, n_r, m_r,
+                                                alpha, beta_k, b->prefetch, NULL);
+                        }
+                    }
+                }
+
+                // Nobody may overwrite the panel until every thread is done with it
+                #pragma omp barrier
+            }
+        }
+    }
+}
+
+void syrk(char uplo, char trans, int N, int K, double alpha, const double* A, int lda,
+          double beta, double* C, int ldc, const blocking_t* blocking, int num_threads)
+{
+    int lower = (uplo == 'L' || uplo == 'l');
+    int ta = (trans == 'T' || trans == 't' || trans == 'C' || trans == 'c');
+    int rows = ta ? K : N; // Rows of A
+    int info = 0;
+
+    // Argument checks in the order of the reference BLAS
+    if (!lower && uplo != 'U' && uplo != 'u') { info = 1; }
+    else if (!ta && trans != 'N' && trans != 'n') { info = 2; }
+    else if (N < 0) { info = 3; }
+    else if (K < 0) { info = 4; }
+    else if (lda < (rows > 1 ? rows : 1)) { info = 7; }
+    else if (ldc < (N > 1 ? N : 1)) { info = 10; }
+
+    if (info != 0) 
+    {
+        fprintf(stderr, "syrk: parameter %d had an illegal value\n", info);
+        return;
+    }
+    if (N == 0) 
+    {
+        return;
+    }
+
+    // op(A) * op(A)^T, both operands read from A with their own strides
+    operand_t left = {A, lda, ta, SHAPE_GENERAL, 0, 0};
+    operand_t right = {A, lda, !ta, SHAPE_GENERAL, 0, 0};
+    blocking_t b = (blocking != NULL) ? *blocking : dgemm_get_blocking();
+
+    part_gebp(N, N, K, alpha, &left, &right, beta, C, ldc, lower ? PART_LOWER : PART_UPPER, &b, num_threads);
+}
+
+void symm(char side, char uplo, int M, int N, double alpha, const double* A, int lda,
+          const double* B, int ldb, double beta, double* C, int ldc, const blocking_t* blocking, int num_threads)
+{
+    int left_side = (side == 'L' || side == 'l');
+    int lower = (uplo == 'L' || uplo == 'l');
+    int order = left_side ? M : N; // Order of A
+    int info = 0;
+
+    // Argument checks in the order of the reference BLAS
+    if (!left_side && side != 'R' && side != 'r') { info = 1; }
+    else if (!lower && uplo != 'U' && uplo != 'u') { info = 2; }
+    else if (M < 0) { info = 3; }
+    else if (N < 0) { info = 4; }
+    else if (lda < (order > 1 ? order : 1)) { info = 7; }
+    else if (ldb < (M > 1 ? M : 1)) { info = 9; }
+    else if (ldc < (M > 1 ? M : 1)) { info = 12; }
+
+    if (info != 0) 
+    {
+        fprintf(stderr, "symm: parameter %d had an illegal value\n", info);
+        return;
+    }
+    if (M == 0 || N == 0) 
+    {
+        return;
+    }
+
+    operand_t sym = {A, lda, 0, SHAPE_SYMMETRIC, lower, 0};
+    operand_t general = {B, ldb, 0, SHAPE_GENERAL, 0, 0};
+    blocking_t b = (blocking != NULL) ? *blocking : dgemm_get_blocking();
+
+    if (left_side) 
+    {
+        part_gebp(M, N, M, alpha, &sym, &general, beta, C, ldc, PART_ALL, &b, num_threads);
+    }
+    else 
+    {
+        part_gebp(M, N, N, alpha, &general, &sym, beta, C, ldc, PART_ALL, &b, num_threads);
+    }
+}
+
+void trmm(char side, char uplo, char transA, char diag, int M, int N, double alpha, const double* A, int lda,
+          double* B, int ldb, const blocking_t* blocking, int num_threads)
+{
+    int left_side = (side == 'L' || side == 'l');
+    int lower = (uplo == 'L' || uplo == 'l');
+    int ta = (transA == 'T' || transA == 't' || transA == 'C' || transA == 'c');
+    int unit = (diag == 'U' || diag == 'u');
+    int order = left_side ? M : N; // Order of A
+    int info = 0;
+
+    // Argument checks in the order of the reference BLAS
+    if (!left_side && side != 'R' && side != 'r') { info = 1; }
+    else if (!lower && uplo != 'U' && uplo != 'u') { info = 2; }
+    else if (!ta && transA != 'N' && transA != 'n') { info = 3; }
+    else if (!unit && diag != 'N' && diag != 'n') { info = 4; }
+    else if (M < 0) { info = 5; }
+    else if (N < 0) { info = 6; }
+    else if (lda < (order > 1 ? order : 1)) { info = 9; }
+    else if (ldb < (M > 1 ? M : 1)) { info = 11; }
+
+    if (info != 0) 
+    {
+        fprintf(stderr, "trmm: parameter %d had an illegal value\n", info);
+        return;
+    }
+    if (M == 0 || N == 0) 
+    {
+        return;
+    }
+    if (alpha == 0.0) 
+    {
+        scale_part(M, N, 0.0, B, ldb, PART_ALL);
+        return;
+    }
+
+    operand_t tri = {A, lda, ta, SHAPE_TRIANGULAR, lower, unit};
+    blocking_t b = (blocking != NULL) ? *blocking : dgemm_get_blocking();
+    int threads = (num_threads > 0) ? num_threads : omp_get_max_threads();
+
+    // B is read while the product is formed, so each panel goes to scratch first:
+    // n_c columns on the left, where the threads divide the rows, and m_c rows per thread on the right
+    int rows = left_side ? M : ((M < b.m_c * threads) ? M : b.m_c * threads);
+    int cols = left_side ? ((N < b.n_c) ? N : b.n_c) : N;
+    double* T = (double*)malloc((size_t)rows * cols * sizeof(double));
+    if (T == NULL) 
+    {
+        fprintf(stderr, "trmm: unable to allocate a %d x %d scratch panel\n", rows, cols);
+        return;
+    }
+
+    for (int j0 = 0; j0 < N; j0 += cols) 
+    {
+        int n = (N - j0 < cols) ? N - j0 : cols;
+
+        for (int i0 = 0; i0 < M; i0 += rows) 
+        {
+            int m = (M - i0 < rows) ? M - i0 : rows;
+            operand_t general = {&B[(size_t)j0 * ldb + i0], ldb, 0, SHAPE_GENERAL, 0, 0};
+
+            if (left_side) 
+            {
+                part_gebp(m, n, M, alpha, &tri, &general, 0.0, T, m, PART_ALL, &b, threads);
+            }
+            else 
+            {
+                part_gebp(m, n, N, alpha, &general, &tri, 0.0, T, m, PART_ALL, &b, threads);
+            }
+
+            for (int j = 0; j < n; j++) 
+            {
+                memcpy(&B[(size_t)(j0 + j) * ldb + i0], &T[(size_t)j * m], (size_t)m * sizeof(double));
+            }
+        }
+    }
+
+    free(T);
+}
@@ -0,0 +1,89 @@
+#ifndef LEVEL3_H
+#define LEVEL3_H
+#include "tune.h"
+
+/**
+ * ## Symmetric rank-k update
+ *
+ * Computes C = alpha * A * A^T + beta * C (trans 'N', A is N x K) or
+ * C = alpha * A^T * A + beta * C (trans 'T' or 'C', A is K x N), where C
+ * is N x N and only its uplo triangle is read and written; everything is
+ * column-major. It runs the five loop nest of gebp with A packed as both
+ * operands (the second through the transposed strides, see pack_A and
+ * pack_B), but skips every block and register tile of C outside the
+ * triangle, so it does about half the flops of the full product. Tiles
+ * crossing the diagonal are computed into a scratch tile and only their
+ * triangle is merged into C.
+ *
+ * @param uplo 'L' or 'U': the triangle of C computed
+ * @param trans 'N' for A * A^T, 'T' or 'C' for A^T * A
+ * @param N Order of C
+ * @param K Columns of A (rows when transposed)
+ * @param alpha Scale applied to the product
+ * @param A Matrix A
+ * @param lda Leading dimension of A
+ * @param beta Scale applied to the existing C; C is not read when it is 0
+ * @param C Matrix C
+ * @param ldc Leading dimension of C
+ * @param blocking Blocking, or NULL for the one dgemm uses (see dgemm_get_blocking)
+ * @param num_threads Threads, 0 for omp_get_max_threads()
+ */
+void syrk(char uplo, char trans, int N, int K, double alpha, const double* A, int lda,
+          double beta, double* C, int ldc, const blocking_t* blocking, int num_threads);
+
+/**
+ * This function computes C = alpha * A * B + beta * C (side 'L', A is
+ * M x M) or C = alpha * B * A + beta * C (side 'R', A is N x N), where A
+ * is symmetric and only its uplo triangle is read; B and C are M x N. The
+ * packing routines rebuild the full A from the stored triangle: blocks
+ * off the diagonal are packed from the triangle or from its mirror,
+ * read with swapped strides, and only micro-panels crossing the diagonal
+ * are packed element by element.
+ *
+ * @param side 'L' or 'R': the side A is on
+ * @param uplo 'L' or 'U': the triangle of A stored
+ * @param M Rows of B and C
+ * @param N Columns of B and C
+ * @param alpha Scale applied to the product
+ * @param A Symmetric matrix A
+ * @param lda Leading dimension of A
+ * @param B Matrix B
+ * @param ldb Leading dimension of B
+ * @param beta Scale applied to the existing C; C is not read when it is 0
+ * @param C Matrix C
+ * @param ldc Leading dimension of C
+ * @param blocking Blocking, or NULL for the one dgemm uses
+ * @param num_threads Threads, 0 for omp_get_max_threads()
+ */
+void symm(char side, char uplo, int M, int N, double alpha, const double* A, int lda,
+          const double* B, int ldb, double beta, double* C, int ldc, const blocking_t* blocking, int num_threads);
+
+/**
+ * This function computes B = alpha * op(A) * B (side 'L', A is M x M) or
+ * B = alpha * B * op(A) (side 'R', A is N x N) in place, where A is
+ * triangular and op(A) is A or A^T; B is M x N. The triangle of A is
+ * packed with zeros in the other one (and ones on the diagonal for a
+ * unit diagonal), and the register tiles and blocks whose micro-panel of
+ * op(A) is all zeros are skipped, so it does about half the flops of the
+ * full product. The product is formed a panel of B at a time in a
+ * scratch panel (M x n_c columns, or m_c * num_threads rows x N) and
+ * copied back.
+ *
+ * @param side 'L' or 'R': the side A is on
+ * @param uplo 'L' or 'U': the triangle of A stored
+ * @param transA 'N' for op(A) = A, 'T' or 'C' for op(A) = A^T
+ * @param diag 'U' if the diagonal of A is all ones and not read, 'N' if not
+ * @param M Rows of B
+ * @param N Columns of B
+ * @param alpha Scale applied to the product; B is zeroed without being read when it is 0
+ * @param A Triangular matrix A
+ * @param lda Leading dimension of A
+ * @param B Matrix B, overwritten with the product
+ * @param ldb Leading dimension of B
+ * @param blocking Blocking, or NULL for the one dgemm uses
+ * @param num_threads Threads, 0 for omp_get_max_threads()
+ */
+void trmm(char side, char uplo, char transA, char diag, int M, int N, double alpha, const double* A, int lda,
+          double* B, int ldb, const blocking_t* blocking, int num_threads);
+
+#endif
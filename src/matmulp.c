@@ -2,251 +2,324 @@
  * Author: Amna Hogan-Bailey
  * Uta - Parallel proccesing
  * Performing matrix multiplication using different
- * loop orderings and tiems them. 
+ * loop orderings and tiems them. Every ordering is run
+ * naive, cache tiled, and tiled across OpenMP threads.
+ * Matrices are stored contiguously in row major order.
  */
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <omp.h>
+#include "bench.h"
 
-void matmul_ijk(int N, double** A, double** B, double** C);
-void matmul_ikj(int N, double** A, double** B, double** C);
-void matmul_kij(int N, double** A, double** B, double** C);
-void matmul_kji(int N, double** A, double** B, double** C);
-void matmul_jki(int N, double** A, double** B, double** C);
-void matmul_jik(int N, double** A, double** B, double** C);
+#define TILE 64 // Tile edge, three 64 x 64 tiles of doubles fit in L2
 
-void reset_matrix(int N, double** C);
-void free_memory(int N, double** A, double** B, double** C);
-int main() 
+#define DIM_I 0
+#define DIM_J 1
+#define DIM_K 2
+
+/**
+ * The loop orderings multiply the [i0, i1) x [j0, j1) block of C by the
+ * [k0, k1) slice of A and B, accumulating into C.
+ */
+void matmul_ijk(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1);
+void matmul_ikj(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1);
+void matmul_kij(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1);
+void matmul_kji(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1);
+void matmul_jki(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1);
+void matmul_jik(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1);
+
+void reset_matrix(int N, double* C);
+
+/**
+ * A loop ordering: its name, its kernel, and the dimensions of its
+ * loops from outermost to innermost.
+ */
+typedef struct
 {
-    // Length and width of all matrices
-    int N = 512 * 3;
-
-    // A Matrix
-    double** A = (double**)malloc(N * sizeof(double*));
-
-    // B Matrix
-    double** B = (double**)malloc(N * sizeof(double*));
-    
-    // Resultant Matrix
-    double** C = (double**)malloc(N * sizeof(double*));
-    
-    // Allocate space for matrices
-    for (int i = 0; i < N; i++) 
-    {
-        A[i] = (double*)malloc(N * sizeof(double));
-        B[i] = (double*)malloc(N * sizeof(double));
-        C[i] = (double*)malloc(N * sizeof(double));
-    }
+    const char* name;
+    void (*matmul)(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1);
+    int dims[3];
+} loop_order_t;
+
+/**
+ * How an ordering is run.
+ */
+typedef enum
+{
+    VARIANT_NAIVE, // One block covering the whole matrix
+    VARIANT_TILED, // TILE x TILE x TILE blocks, visited in the same order as the loops
+    VARIANT_PARALLEL, // Tiled, with the tiles of C divided among threads
+} variant_t;
+
+static const char* variant_names[] = {"naive", "tiled", "parallel"};
+
+/**
+ * One ordering and variant for bench_run.
+ */
+typedef struct
+{
+    int N; // Length and width of all matrices
+    const double* A; // A Matrix
+    const double* B; // B Matrix
+    double* C; // Resultant Matrix
+    const loop_order_t* order; // Ordering to run
+    variant_t variant; // How to run it
+    int threads; // Threads for VARIANT_PARALLEL
+} matmul_job_t;
 
-    // Initialize matrices
-    for (int i = 0; i < N; i++) 
+/**
+ * Runs an ordering over tiles. The tile loops follow the same order as
+ * the element loops. In parallel, the outermost of the i and j tile loops
+ * is divided cyclically among the threads, so every thread owns distinct
+ * tiles of C and no two threads ever update the same element, even when
+ * k is the outermost loop.
+ */
+static void matmul_tiled(int N, const double* A, const double* B, double* C, const loop_order_t* order, int tile, int threads)
+{
+    int tiles = (N + tile - 1) / tile;
+    int split = (order->dims[0] == DIM_K) ? 1 : 0; // loop level divided among threads
+
+    #pragma omp parallel num_threads(threads)
     {
-        for (int j = 0; j < N; j++) 
+        int tid = omp_get_thread_num();
+        int nthreads = omp_get_num_threads();
+        int t[3]; // tile index per loop level
+
+        for (t[0] = 0; t[0] < tiles; t[0]++) 
         {
-            A[i][j] = rand() % 10;
-            B[i][j] = rand() % 10;
-            C[i][j] = 0.0;
+            if (split == 0 && t[0] % nthreads != tid) { continue; }
+
+            for (t[1] = 0; t[1] < tiles; t[1]++) 
+            {
+                if (split == 1 && t[1] % nthreads != tid) { continue; }
+
+                for (t[2] = 0; t[2] < tiles; t[2]++) 
+                {
+                    int lo[3], hi[3]; // bounds per dimension
+                    for (int level = 0; level < 3; level++) 
+                    {
+                        int dim = order->dims[level];
+                        lo[dim] = t[level] * tile;
+                        hi[dim] = (lo[dim] + tile < N) ? lo[dim] + tile : N;
+                    }
+                    order->matmul(N, A, B, C, lo[DIM_I], hi[DIM_I], lo[DIM_J], hi[DIM_J], lo[DIM_K], hi[DIM_K]);
+                }
+            }
         }
     }
+}
+
+/**
+ * Runs the ordering and variant of a matmul_job_t.
+ */
+static void run_matmul(void* ctx)
+{
+    matmul_job_t* job = (matmul_job_t*)ctx;
+
+    switch (job->variant) 
+    {
+        case VARIANT_NAIVE:
+            job->order->matmul(job->N, job->A, job->B, job->C, 0, job->N, 0, job->N, 0, job->N);
+            break;
+        case VARIANT_TILED:
+            matmul_tiled(job->N, job->A, job->B, job->C, job->order, TILE, 1);
+            break;
+        case VARIANT_PARALLEL:
+            matmul_tiled(job->N, job->A, job->B, job->C, job->order, TILE, job->threads);
+            break;
+    }
+}
+
+/**
+ * Zeroes C of a matmul_job_t between runs.
+ */
+static void reset_job(void* ctx)
+{
+    matmul_job_t* job = (matmul_job_t*)ctx;
+    reset_matrix(job->N, job->C);
+}
+
+int main(int argc, char* argv[]) 
+{
+    bench_options_t opts;
+    if (bench_parse_args(argc, argv, &opts, "../output/matmulp_results.csv", 512 * 3) != 0) 
+    {
+        return 1;
+    }
+    if (opts.pin) 
+    {
+        bench_pin_threads(opts.threads);
+    }
 
-    struct timespec start, end;
-    double time_taken;
-    double flops, gflops;
+    loop_order_t orders[] = {
+        {"ijk", matmul_ijk, {DIM_I, DIM_J, DIM_K}},
+        {"ikj", matmul_ikj, {DIM_I, DIM_K, DIM_J}},
+        {"kij", matmul_kij, {DIM_K, DIM_I, DIM_J}},
+        {"kji", matmul_kji, {DIM_K, DIM_J, DIM_I}},
+        {"jki", matmul_jki, {DIM_J, DIM_K, DIM_I}},
+        {"jik", matmul_jik, {DIM_J, DIM_I, DIM_K}},
+    };
 
     // Open CSV file for writing
-    FILE *fp = fopen("../output/matmulp_results.csv", "w");
-    if (fp == NULL)
+    FILE *fp = fopen(opts.output, "w");
+    if (fp == NULL) 
     {
-        fprintf(stderr, "Error opening file!\n");
+        fprintf(stderr, "Error opening file %s!\n", opts.output);
         return 1;
     }
-    
+
     // Write header to CSV file
-    fprintf(fp, "Order,Seconds,GFLOPS\n");
-
-    // Measure time for each permutation
-    printf("Matrix Multiplications:\n");
-
-    // ijk
-    reset_matrix(N, C);
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    matmul_ijk(N, A, B, C);
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    time_taken = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
-    flops = ((double)N * N * N * 2) / time_taken;
-    gflops = flops / 1e9;
-    printf("ijk order: %f seconds. GFLOPS: %lf\n", time_taken, gflops);
-    fprintf(fp, "ijk,%f,%lf\n", time_taken, gflops);
-
-    // ikj
-    reset_matrix(N, C);
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    matmul_ikj(N, A, B, C);
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    time_taken = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
-    flops = ((double)N * N * N * 2) / time_taken;
-    gflops = flops / 1e9;
-    printf("ikj order: %f seconds. GFLOPS: %lf\n", time_taken, gflops);
-    fprintf(fp, "ikj,%f,%lf\n", time_taken, gflops);
-
-    // kij
-    reset_matrix(N, C);
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    matmul_kij(N, A, B, C);
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    time_taken = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
-    flops = ((double)N * N * N * 2) / time_taken;
-    gflops = flops / 1e9;
-    printf("kij order: %f seconds. GFLOPS: %lf\n", time_taken, gflops);
-    fprintf(fp, "kij,%f,%lf\n", time_taken, gflops);
-
-    // kji
-    reset_matrix(N, C);
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    matmul_kji(N, A, B, C);
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    time_taken = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
-    flops = ((double)N * N * N * 2) / time_taken;
-    gflops = flops / 1e9;
-    printf("kji order: %f seconds. GFLOPS: %lf\n", time_taken, gflops);
-    fprintf(fp, "kji,%f,%lf\n", time_taken, gflops);
-
-    // jki
-    reset_matrix(N, C);
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    matmul_jki(N, A, B, C);
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    time_taken = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
-    flops = ((double)N * N * N * 2) / time_taken;
-    gflops = flops / 1e9;
-    printf("jki order: %f seconds. GFLOPS: %lf\n", time_taken, gflops);
-    fprintf(fp, "jki,%f,%lf\n", time_taken, gflops);
-
-    // jik
-    reset_matrix(N, C);
-    clock_gettime(CLOCK_MONOTONIC, &start);
-    matmul_jik(N, A, B, C);
-    clock_gettime(CLOCK_MONOTONIC, &end);
-    time_taken = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
-    flops = ((double)N * N * N * 2) / time_taken;
-    gflops = flops / 1e9;
-    printf("jik order: %f seconds. GFLOPS: %lf\n", time_taken, gflops);
-    fprintf(fp, "jik,%f,%lf\n", time_taken, gflops);
+    fprintf(fp, "Order,Variant,N,Threads,Seconds,GFLOPS,max error," BENCH_STATS_HEADER "\n");
 
-    // Close the CSV file
-    fclose(fp);
+    for (int s = 0; s < opts.num_sizes; s++) 
+    {
+        // Length and width of all matrices
+        int N = opts.sizes[s];
+        size_t count = (size_t)N * N;
 
-    // Free allocated memory
-    free_memory(N, A, B, C);
-    return 0;
-}
+        double* A = (double*)malloc(count * sizeof(double)); // A Matrix
+        double* B = (double*)malloc(count * sizeof(double)); // B Matrix
+        double* C = (double*)malloc(count * sizeof(double)); // Resultant Matrix
+        double* C_ref = (double*)malloc(count * sizeof(double)); // Result of naive ijk, to check the others against
 
-void reset_matrix(int N, double** C) 
-{
-    for (int i = 0; i < N; i++) 
-    {
-        for (int j = 0; j < N; j++) 
+        // Initialize matrices
+        for (size_t i = 0; i < count; i++) 
         {
-            C[i][j] = 0.0;
+            A[i] = rand() % 10;
+            B[i] = rand() % 10;
+        }
+
+        // Measure time for each permutation
+        printf("Matrix Multiplications, N = %d (%d reps, %d warmup, %d threads):\n", N, opts.reps, opts.warmup, opts.threads);
+        printf("%6s %9s %8s %12s %12s %10s\n", "order", "variant", "threads", "median (s)", "p95 (s)", "GFLOPS");
+
+        for (int v = VARIANT_NAIVE; v <= VARIANT_PARALLEL; v++) 
+        {
+            for (int o = 0; o < sizeof(orders) / sizeof(orders[0]); o++) 
+            {
+                int threads = (v == VARIANT_PARALLEL) ? opts.threads : 1;
+                matmul_job_t job = {N, A, B, C, &orders[o], (variant_t)v, threads};
+                bench_stats_t stats = bench_run(&opts, run_matmul, reset_job, &job);
+
+                // Every run starts from a zero C, so the last run holds the full product
+                if (v == VARIANT_NAIVE && o == 0) 
+                {
+                    memcpy(C_ref, C, count * sizeof(double));
+                }
+                double max_error = 0.0;
+                for (size_t i = 0; i < count; i++) 
+                {
+                    double error = (C[i] > C_ref[i]) ? C[i] - C_ref[i] : C_ref[i] - C[i];
+                    max_error = (error > max_error) ? error : max_error;
+                }
+
+                double gflops = ((double)N * N * N * 2) / stats.median / 1e9;
+                printf("%6s %9s %8d %12f %12f %10.3f\n", orders[o].name, variant_names[v], threads, stats.median, stats.p95, gflops);
+                fprintf(fp, "%s,%s,%d,%d,%f,%lf,%e,", orders[o].name, variant_names[v], N, threads, stats.median, gflops, max_error);
+                bench_fprint_stats(fp, &stats);
+                fprintf(fp, "\n");
+            }
         }
+
+        // Free allocated memory
+        free(A);
+        free(B);
+        free(C);
+        free(C_ref);
     }
+
+    // Close the CSV file
+    fclose(fp);
+    return 0;
 }
 
-void free_memory(int N, double** A, double** B, double** C)
+void reset_matrix(int N, double* C) 
 {
-    for (int i = 0; i < N; i++) 
-    {
-        free(A[i]);
-        free(B[i]);
-        free(C[i]);
-    }
-    free(A);
-    free(B);
-    free(C);
+    memset(C, 0, (size_t)N * N * sizeof(double));
 }
 
-void matmul_ijk(int N, double** A, double** B, double** C) 
+void matmul_ijk(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1) 
 {
-    for (int i = 0; i < N; i++) 
+    for (int i = i0; i < i1; i++) 
     {
-        for (int j = 0; j < N; j++) 
+        for (int j = j0; j < j1; j++) 
         {
-            C[i][j] = 0;
-            for (int k = 0; k < N; k++) 
+            for (int k = k0; k < k1; k++) 
             {
-                C[i][j] += A[i][k] * B[k][j];
+                C[(size_t)i * N + j] += A[(size_t)i * N + k] * B[(size_t)k * N + j];
             }
         }
     }
 }
 
-void matmul_ikj(int N, double** A, double** B, double** C) 
+void matmul_ikj(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1) 
 {
-    for (int i = 0; i < N; i++) 
+    for (int i = i0; i < i1; i++) 
     {
-        for (int k = 0; k < N; k++) 
+        for (int k = k0; k < k1; k++) 
         {
-            for (int j = 0; j < N; j++) 
+            for (int j = j0; j < j1; j++) 
             {
-                C[i][j] += A[i][k] * B[k][j];
+                C[(size_t)i * N + j] += A[(size_t)i * N + k] * B[(size_t)k * N + j];
             }
         }
     }
 }
 
-void matmul_kij(int N, double** A, double** B, double** C) 
+void matmul_kij(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1) 
 {
-    for (int k = 0; k < N; k++) 
+    for (int k = k0; k < k1; k++) 
     {
-        for (int i = 0; i < N; i++) 
+        for (int i = i0; i < i1; i++) 
         {
-            for (int j = 0; j < N; j++) 
+            for (int j = j0; j < j1; j++) 
             {
-                C[i][j] += A[i][k] * B[k][j];
+                C[(size_t)i * N + j] += A[(size_t)i * N + k] * B[(size_t)k * N + j];
             }
         }
     }
 }
 
-void matmul_kji(int N, double** A, double** B, double** C) 
+void matmul_kji(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1) 
 {
-    for (int k = 0; k < N; k++) 
+    for (int k = k0; k < k1; k++) 
     {
-        for (int j = 0; j < N; j++) 
+        for (int j = j0; j < j1; j++) 
         {
-            for (int i = 0; i < N; i++) 
+            for (int i = i0; i < i1; i++) 
             {
-                C[i][j] += A[i][k] * B[k][j];
+                C[(size_t)i * N + j] += A[(size_t)i * N + k] * B[(size_t)k * N + j];
             }
         }
     }
 }
 
-void matmul_jki(int N, double** A, double** B, double** C) 
+void matmul_jki(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1) 
 {
-    for (int j = 0; j < N; j++) 
+    for (int j = j0; j < j1; j++) 
     {
-        for (int k = 0; k < N; k++) 
+        for (int k = k0; k < k1; k++) 
         {
-            for (int i = 0; i < N; i++) 
+            for (int i = i0; i < i1; i++) 
             {
-                C[i][j] += A[i][k] * B[k][j];
+                C[(size_t)i * N + j] += A[(size_t)i * N + k] * B[(size_t)k * N + j];
             }
         }
     }
 }
 
-void matmul_jik(int N, double** A, double** B, double** C)
- {
-    for (int j = 0; j < N; j++) 
+void matmul_jik(int N, const double* A, const double* B, double* C, int i0, int i1, int j0, int j1, int k0, int k1) 
+{
+    for (int j = j0; j < j1; j++) 
     {
-        for (int i = 0; i < N; i++) 
+        for (int i = i0; i < i1; i++) 
         {
-            for (int k = 0; k < N; k++) 
+            for (int k = k0; k < k1; k++) 
             {
-                C[i][j] += A[i][k] * B[k][j];
+                C[(size_t)i * N + j] += A[(size_t)i * N + k] * B[(size_t)k * N + j];
             }
         }
     }
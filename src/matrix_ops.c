@@ -1,53 +1,84 @@
 #include "matrix_ops.h"
 #include <stdio.h>
 #include <stdlib.h>
+#include <time.h>
 
 
-void load_A(double* A_block, double* A, int N, int m_c, int k_c, int i_block, int k_block) 
+void* alloc_packed(size_t count, size_t size)
 {
-    for (int k = 0; k < k_c && k_block + k < N; k++) 
-    {
-        for (int i = 0; i < m_c && i_block + i < N; i++) 
-        {
-            A_block[k * m_c + i] = A[(k_block + k) * N + (i_block + i)];
-        }
-    }
+    size_t bytes = (count * size + PACK_ALIGNMENT - 1) / PACK_ALIGNMENT * PACK_ALIGNMENT;
+    return aligned_alloc(PACK_ALIGNMENT, bytes);
 }
 
-void load_B(double* B_sliver, double* B, int N, int k_c, int n_r, int j_block, int k_block) 
+double wall_time(void)
 {
-    for (int j = 0; j < n_r && j_block + j < N; j++) 
-    {
-        for (int k = 0; k < k_c && k_block + k < N; k++) 
-        {
-            B_sliver[j * k_c + k] = B[(j_block + j) * N + (k_block + k)];
-        }
-    }
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
 }
 
-void load_C(double* C_block, double* C, int N, int m_c, int n_r, int i_block, int j_block) 
+const char* dtype_name(int dtype)
 {
-    for (int j = 0; j < n_r && j_block + j < N; j++) 
-    {
-        for (int i = 0; i < m_c && i_block + i < N; i++) 
-        {
-            C_block[j * m_c + i] = C[(j_block + j) * N + (i_block + i)];
-        }
-    }
+    static const char* names[DTYPE_COUNT] = {"float", "double", "complex double"};
+    return names[dtype];
 }
 
-void store_C(double* C_block, double* C, int N, int m_c, int n_r, int i_block, int j_block) 
+size_t dtype_size(int dtype)
 {
-    for (int j = 0; j < n_r; j++) 
+    static const size_t sizes[DTYPE_COUNT] = {sizeof(float), sizeof(double), sizeof(double complex)};
+    return sizes[dtype];
+}
+
+int dtype_flops(int dtype)
+{
+    // A complex multiply-add is 4 multiplies and 4 adds
+    return (dtype == DTYPE_COMPLEX) ? 8 : 2;
+}
+
+void random_fill(int dtype, void* X, size_t count)
+{
+    for (size_t i = 0; i < count; i++) 
     {
-        for (int i = 0; i < m_c; i++) 
+        switch (dtype) 
         {
-            C[(j_block + j) * N + (i_block + i)] = C_block[j * m_c + i];
-            
+            case DTYPE_FLOAT: ((float*)X)[i] = rand() % 10; break;
+            case DTYPE_DOUBLE: ((double*)X)[i] = rand() % 10; break;
+            case DTYPE_COMPLEX: ((double complex*)X)[i] = (rand() % 10) + (rand() % 10) * I; break;
         }
     }
 }
 
+// The packing routines and block multiply, once per element type
+#define DTYPE DTYPE_FLOAT
+#define ELEM float
+#define FN(name) s##name
+#define KERNEL s
+#include "pack_template.h"
+#undef DTYPE
+#undef ELEM
+#undef FN
+#undef KERNEL
+
+#define DTYPE DTYPE_DOUBLE
+#define ELEM double
+#define FN(name) name
+#define KERNEL d
+#include "pack_template.h"
+#undef DTYPE
+#undef ELEM
+#undef FN
+#undef KERNEL
+
+#define DTYPE DTYPE_COMPLEX
+#define ELEM double complex
+#define FN(name) z##name
+#define KERNEL z
+#include "pack_template.h"
+#undef DTYPE
+#undef ELEM
+#undef FN
+#undef KERNEL
+
 void print_matrix(double* matrix, int rows, int cols, const char* name)
 {
     printf("Matrix %s (%dx%d):\n", name, rows, cols);
@@ -62,51 +93,68 @@ void print_matrix(double* matrix, int rows, int cols, const char* name)
     printf("\n");
 }
 
-void multiply_blocks_avx(double* A_block, double* B_sliver, double* C_block, int m_c, int k_c, int n_r, int m_r)
- {
-    for (int j = 0; j < n_r; j++) 
-    {
-        for (int k = 0; k < k_c; k++) 
-        {
-            double b_val = B_sliver[j * k_c + k];
-
-            int i;
-            for (i = 0; i <= m_c - m_r; i += m_r) 
-            {
-                __m256d a_val_avx_0 = _mm256_loadu_pd(&A_block[k * m_c + i]);
-                __m256d c_val_avx_0 = _mm256_loadu_pd(&C_block[j * m_c + i]);
-                __m256d b_val_avx = _mm256_set1_pd(b_val);
-                c_val_avx_0 = _mm256_fmadd_pd(a_val_avx_0, b_val_avx, c_val_avx_0);
-                _mm256_storeu_pd(&C_block[j * m_c + i], c_val_avx_0);
-
-            }
-
-            for (; i < m_c; i++) 
-            {
-                C_block[j * m_c + i] += A_block[k * m_c + i] * b_val;
-
-            }
-        }
-    }
-}
-
 void print_performance_info(
-    double time_taken, double gflops, double gflops_util,
+    double time_taken, double pack_time, double gflops, double gflops_util,
+    double intensity, double bandwidth_util, double roofline_util,
     int cache_l1_used, int cache_l2_used, 
     double CACHE_L1_SIZE_KB, double CACHE_L2_SIZE_KB, 
-    int k_c, int n_r, int m_r,
-    FILE* fp
+    int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch,
+    const char* precision, const char* kernel_name, const gebp_counters_t* counters, FILE* fp
 ) 
 {
     printf("Time taken: %f seconds\n", time_taken);
+    printf("Packing time: %f seconds (%.1f%%)\n", pack_time, 100.0 * pack_time / time_taken);
     printf("GFLOPS: %lf\n", gflops);
     printf("GFLOPS Utilization: %lf\n", gflops_util);
+    printf("Arithmetic intensity: %.2f flop/byte, bandwidth utilization: %lf, roofline utilization: %lf\n", intensity, bandwidth_util, roofline_util);
     printf("B block size (KB)/L1 Cache size: %d/%lf\n", cache_l1_used, CACHE_L1_SIZE_KB);
     printf("A block size (KB)/L2 Cache size: %d/%lf\n", cache_l2_used, CACHE_L2_SIZE_KB);
+
+    // Per phase IPC and misses per 1000 instructions
+    if (counters != NULL && counters->pack[PERF_INSTRUCTIONS] > 0 && counters->compute[PERF_INSTRUCTIONS] > 0) 
+    {
+        const long long* phases[2] = {counters->pack, counters->compute};
+        const char* phase_names[2] = {"Pack", "Compute"};
+
+        for (int p = 0; p < 2; p++) 
+        {
+            const long long* v = phases[p];
+            double kilo_instr = v[PERF_INSTRUCTIONS] / 1000.0;
+
+            printf("%s: IPC %.2f", phase_names[p], v[PERF_CYCLES] > 0 ? (double)v[PERF_INSTRUCTIONS] / v[PERF_CYCLES] : 0.0);
+            for (int e = PERF_L1D_MISSES; e < PERF_EVENTS; e++) 
+            {
+                if (v[e] >= 0) 
+                {
+                    printf(", %s/1k instr %.2f", perf_event_name(e), v[e] / kilo_instr);
+                }
+            }
+            printf("\n");
+        }
+    }
     printf("---------------------------------------\n");
 
-    fprintf(fp, "%d,%d,%d,%lf,%f,%lf,%d/%lf,%d/%lf\n",
-                k_c, n_r, m_r, gflops, time_taken, gflops_util,
-                cache_l2_used, CACHE_L2_SIZE_KB, cache_l1_used, CACHE_L1_SIZE_KB
+    fprintf(fp, "%d,%d,%d,%d,%d,%d,%lf,%f,%f,%lf,%lf,%lf,%lf,%d/%lf,%d/%lf,%s,%s",
+                k_c, m_c, n_c, n_r, m_r, prefetch, gflops, time_taken, pack_time, gflops_util, intensity, bandwidth_util, roofline_util,
+                cache_l2_used, CACHE_L2_SIZE_KB, cache_l1_used, CACHE_L1_SIZE_KB, precision, kernel_name
             );
+
+    for (int e = 0; e < 2 * PERF_EVENTS; e++) 
+    {
+        long long v = -1;
+        if (counters != NULL) 
+        {
+            v = (e < PERF_EVENTS) ? counters->pack[e] : counters->compute[e - PERF_EVENTS];
+        }
+
+        if (v >= 0) 
+        {
+            fprintf(fp, ",%lld", v);
+        }
+        else 
+        {
+            fprintf(fp, ",");
+        }
+    }
+    fprintf(fp, "\n");
 }
\ No newline at end of file
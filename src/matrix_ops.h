@@ -1,82 +1,276 @@
 #ifndef MATRIX_OPS_H
 #define MATRIX_OPS_H
+#include <complex.h>
 #include <immintrin.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include "perf_counters.h"
+
+#define PACK_ALIGNMENT 64 // Alignment in bytes of packing buffers (one cache line)
+#define MR_MAX 48 // Largest supported register tile height
+#define NR_MAX 16 // Largest supported register tile width
+
+#define ISA_SCALAR 0 // Portable C
+#define ISA_AVX2 1 // AVX2 and FMA3
+#define ISA_AVX512 2 // AVX-512F
+
+#define DTYPE_FLOAT 0 // float, BLAS prefix s
+#define DTYPE_DOUBLE 1 // double, BLAS prefix d
+#define DTYPE_COMPLEX 2 // double complex, BLAS prefix z
+#define DTYPE_COUNT 3 // Number of element types
+
+#define ACTIVATION_NONE 0 // Identity
+#define ACTIVATION_RELU 1 // max(x, 0)
+#define ACTIVATION_GELU 2 // x * Phi(x), with the tanh approximation of the normal CDF Phi
+
+/**
+ * Elementwise operations a GEMM applies to each element of C as it is
+ * written for the last time, so that C = act(alpha * A * B + beta * C + bias)
+ * needs no second pass over C. The biases have the element type of C and
+ * are added before the activation; either may be NULL. Activations apply
+ * to float and double only; the complex kernels add the biases and ignore
+ * the activation. The kernels get the biases offset to their tile, so
+ * row_bias[0] and col_bias[0] belong to the tile's top left element.
+ */
+typedef struct
+{
+    const void* row_bias; // One value per row of C, or NULL
+    const void* col_bias; // One value per column of C, or NULL
+    int activation; // ACTIVATION_* applied last
+} epilogue_t;
 
 /**
- * This function loads a sub-block of matrix A into A_block, where A is stored
- * in column-major order. The sub-block loaded is determined by the block coordinates
+ * A register blocked microkernel. The kernel multiplies an m_r x k_c packed
+ * micro-panel of A with a k_c x n_r packed micro-panel of B and merges the
+ * top left m x n corner of the product into C as C = alpha * A * B + beta * C.
+ * Each element type has its own kernels, with register tiles sized for it at
+ * compile time; the member of kernel named by dtype is the one set. With
+ * prefetch > 0 the SIMD kernels prefetch the C tile before their k loop and,
+ * in every iteration, the A and B data prefetch iterations ahead; the
+ * scalar kernels ignore it. When ep is not NULL, its biases and activation
+ * are applied to the tile in registers before it is stored.
+ */
+typedef struct
+{
+    const char* name; // Instruction set and tile shape, e.g. "avx2 12x4"
+    int dtype; // DTYPE_* element type
+    int isa; // ISA_* level the kernel needs
+    int m_r; // Rows of the register tile
+    int n_r; // Columns of the register tile
+    int vector_doubles; // Doubles per SIMD register
+    union
+    {
+        void (*s)(int k_c, const float* A, const float* B, float* C, int ldc, int m, int n, float alpha, float beta, int prefetch, 
+                  const epilogue_t* ep);
+        void (*d)(int k_c, const double* A, const double* B, double* C, int ldc, int m, int n, double alpha, double beta, int prefetch, 
+                  const epilogue_t* ep);
+        void (*z)(int k_c, const double complex* A, const double complex* B, double complex* C, int ldc, int m, int n, 
+                  double complex alpha, double complex beta, int prefetch, const epilogue_t* ep);
+    } kernel;
+} microkernel_t;
+
+/**
+ * This function returns the name of an element type as used in the wisdom
+ * file and the CSV output: "float", "double" or "complex double".
  *
- * @param A_block Pointer to the block of A 
- * @param A Pointer to the original matrix A 
- * @param N The dimension
- * @param m_c Number of rows 
- * @param k_c Number of columns 
- * @param i_block The starting row index for the block in matrix A.
- * @param k_block The starting column index for the block in matrix A.
+ * @param dtype One of the DTYPE_* values
+ * @return Pointer to a static string.
  */
-void load_A(double* A_block, double* A, int N, int m_c, int k_c, int i_block, int k_block);
+const char* dtype_name(int dtype);
 
 /**
- * This function loads a sub-sliver of matrix B into B_sliver, where B is stored
- * in column-major order. The sub-sliver loaded is determined by the block coordinates
- * (j_block, k_block).
+ * This function returns the size in bytes of one element of a type.
  *
- * @param B_sliver Pointer to the sliver of B
- * @param B Pointer to matrix B 
- * @param N The dimension
- * @param k_c Number of rows 
- * @param n_r Number of columns 
- * @param j_block The starting column index for the sliver in matrix B.
- * @param k_block The starting row index for the sliver in matrix B.
+ * @param dtype One of the DTYPE_* values
+ * @return sizeof the element type.
  */
-void load_B(double* B_sliver, double* B, int N, int k_c, int n_r, int j_block, int k_block);
+size_t dtype_size(int dtype);
 
 /**
- * This function loads a sub-block of matrix C into C_block, where C is stored
- * in column-major order. The sub-block loaded is determined by the block coordinates
- * (i_block, j_block).
+ * This function returns the real floating point operations in one
+ * multiply-add of a type: 2 for float and double, 8 for complex double.
  *
- * @param C_block Pointer to the block of C 
- * @param C Pointer to the matrix C 
- * @param N  The dimension
- * @param m_c Number of rows 
- * @param n_r Number of columns 
- * @param i_block The starting row index for the block in matrix C.
- * @param j_block The starting column index for the block in matrix C.
+ * @param dtype One of the DTYPE_* values
+ * @return Flops per multiply-add.
  */
-void load_C(double* C_block, double* C, int N, int m_c, int n_r, int i_block, int j_block);
+int dtype_flops(int dtype);
 
 /**
- * This function stores a sub-block of matrix C from C_block back into C,
- * where C is stored in column-major order. The sub-block is stored at 
- * (i_block, j_block).
+ * This function fills count elements of a type with small random integers
+ * (both parts for complex), so products are exact in every precision.
  *
- * @param C_block Pointer to the block of C that will be stored back into matrix C.
- * @param C Pointer to the original matrix C stored in column-major order.
- * @param N The dimension of the square matrix C (N x N).
- * @param m_c Number of rows in the block.
- * @param n_r Number of columns in the block.
- * @param i_block The starting row index for the block in matrix C.
- * @param j_block The starting column index for the block in matrix C.
+ * @param dtype One of the DTYPE_* values
+ * @param X Buffer of at least count elements
+ * @param count Number of elements
  */
-void store_C(double* C_block, double* C, int N, int m_c, int n_r, int i_block, int j_block);
+void random_fill(int dtype, void* X, size_t count);
 
 /**
- * This function multiplies a block of matrix A (A_block) with a sliver of matrix B (B_sliver)
- * and accumulates the result in the corresponding block of matrix C (C_block). AVX2 SIMD 
- * intrinsics are used to optimize the matrix multiplication.
+ * This function allocates a buffer of count elements of size bytes, aligned
+ * to PACK_ALIGNMENT bytes, for packed blocks of A and B. Release it with free().
  *
- * @param A_block Pointer to the block of A.
- * @param B_sliver Pointer to the sliver of B.
- * @param C_block Pointer to the block of C
+ * @param count Number of elements in the buffer.
+ * @param size Bytes per element.
+ * @return Pointer to the buffer, or NULL if the allocation failed.
+ */
+void* alloc_packed(size_t count, size_t size);
+
+/**
+ * This function returns a monotonic wall clock reading in seconds. The
+ * library and the benchmark programs time their runs with it.
+ */
+double wall_time(void);
+
+/**
+ * This function packs an m_c x k_c block of matrix A into contiguous micro-panels
+ * of m_r rows. Element (i, k) of A is A[i * rsa + k * csa], so one routine reads
+ * column-major (rsa = 1, csa = lda), row-major or transposed (rsa = lda, csa = 1)
+ * and arbitrarily strided matrices in place, without a transposed copy. Within
+ * a micro-panel the m_r elements of each column are adjacent, so the microkernel
+ * reads the panel with unit stride. The block must lie inside A; the last
+ * micro-panel is zero padded to m_r rows, so A_packed must hold
+ * ceil(m_c / m_r) * m_r * k_c elements. spack_A and zpack_A do the same for
+ * float and double complex.
+ *
+ * @param A_packed Pointer to the packed block of A
+ * @param A Pointer to the original matrix A
+ * @param rsa Distance in elements between rows of A
+ * @param csa Distance in elements between columns of A
+ * @param m_c Number of rows
+ * @param k_c Number of columns
+ * @param m_r Number of rows in a micro-panel
+ * @param i_block The starting row index for the block in matrix A.
+ * @param k_block The starting column index for the block in matrix A.
+ */
+void pack_A(double* A_packed, const double* A, int rsa, int csa, int m_c, int k_c, int m_r, int i_block, int k_block);
+void spack_A(float* A_packed, const float* A, int rsa, int csa, int m_c, int k_c, int m_r, int i_block, int k_block);
+void zpack_A(double complex* A_packed, const double complex* A, int rsa, int csa, int m_c, int k_c, int m_r, int i_block, int k_block);
+
+/**
+ * This function packs a k_c x n_c panel of matrix B into contiguous micro-panels
+ * of n_r columns. Element (k, j) of B is B[k * rsb + j * csb], as for pack_A;
+ * row-major and transposed panels (csb = 1) are read a row at a time. Within a
+ * micro-panel the n_r elements of each row are adjacent. The panel must lie
+ * inside B; the last micro-panel is zero padded to n_r columns, so B_packed
+ * must hold ceil(n_c / n_r) * n_r * k_c elements. spack_B and zpack_B do the
+ * same for float and double complex.
+ *
+ * @param B_packed Pointer to the packed panel of B
+ * @param B Pointer to matrix B
+ * @param rsb Distance in elements between rows of B
+ * @param csb Distance in elements between columns of B
+ * @param k_c Number of rows
+ * @param n_c Number of columns
+ * @param n_r Number of columns in a micro-panel
+ * @param j_block The starting column index for the panel in matrix B.
+ * @param k_block The starting row index for the panel in matrix B.
+ */
+void pack_B(double* B_packed, const double* B, int rsb, int csb, int k_c, int n_c, int n_r, int j_block, int k_block);
+void spack_B(float* B_packed, const float* B, int rsb, int csb, int k_c, int n_c, int n_r, int j_block, int k_block);
+void zpack_B(double complex* B_packed, const double complex* B, int rsb, int csb, int k_c, int n_c, int n_r, int j_block, int k_block);
+
+/**
+ * This function multiplies a packed block of matrix A (A_packed) with a packed micro-panel
+ * of matrix B (B_packed) and merges the result into matrix C in place as
+ * C = alpha * A * B + beta * C. The block is walked in m_r x n_r register tiles; each
+ * product tile is kept in SIMD registers for the whole k_c loop and merged into C once,
+ * so no copy of C is made. C is not read when beta is zero. The microkernel for the
+ * m_r x n_r tile is found with find_microkernel; shapes without one, up to MR_MAX x NR_MAX,
+ * use a portable loop. Partial tiles on the bottom and right edges are merged with masked
+ * loads and stores. smultiply_blocks_avx and zmultiply_blocks_avx do the same with
+ * the float and double complex microkernels.
+ *
+ * @param A_packed Pointer to the block of A, packed by pack_A with the same m_r.
+ * @param B_packed Pointer to one n_r wide micro-panel of B, packed by pack_B.
+ * @param C Pointer to the top left element of the m_c x n block of C.
+ * @param ldc Leading dimension (column stride) of C.
  * @param m_c Number of rows in the block of matrix A and C.
+ * @param n Number of columns of C to update (at most n_r).
  * @param k_c Number of columns in the block of matrix A and rows  B.
- * @param n_r Number of columns in B and matrix C.
- * @param m_r number of rows to be processed at a time within A_block and C_block.
+ * @param n_r Number of columns in the register tile.
+ * @param m_r Number of rows in the register tile.
+ * @param alpha Scale applied to A * B.
+ * @param beta Scale applied to the existing C.
+ * @param prefetch Prefetch distance of the microkernel in k iterations, 0 for none.
+ * @param ep Epilogue to apply as C is stored, with its biases offset to the
+ *           block's top left element, or NULL.
+ */
+void multiply_blocks_avx(double* A_packed, double* B_packed, double* C, int ldc, int m_c, int n, int k_c, int n_r, int m_r, double alpha, double beta, 
+                         int prefetch, const epilogue_t* ep);
+void smultiply_blocks_avx(float* A_packed, float* B_packed, float* C, int ldc, int m_c, int n, int k_c, int n_r, int m_r, float alpha, float beta, 
+                          int prefetch, const epilogue_t* ep);
+void zmultiply_blocks_avx(double complex* A_packed, double complex* B_packed, double complex* C, int ldc, int m_c, int n, int k_c, int n_r, int m_r, 
+                          double complex alpha, double complex beta, int prefetch, const epilogue_t* ep);
+
+/**
+ * This function applies an epilogue to an M x N matrix C in place, as a
+ * separate pass: C = act(C + row_bias + col_bias). It is what a fused
+ * epilogue saves, and is vectorized with the same code as the kernels.
+ * sapply_epilogue and zapply_epilogue do the same for float and double
+ * complex.
+ *
+ * @param C Matrix C, column-major
+ * @param ldc Leading dimension of C
+ * @param M Rows of C
+ * @param N Columns of C
+ * @param ep Epilogue to apply, or NULL for none
+ */
+void apply_epilogue(double* C, int ldc, int M, int N, const epilogue_t* ep);
+void sapply_epilogue(float* C, int ldc, int M, int N, const epilogue_t* ep);
+void zapply_epilogue(double complex* C, int ldc, int M, int N, const epilogue_t* ep);
+
+/**
+ * This function applies an activation to one value, for the scalar
+ * kernels and the edges of the vector ones. sactivate is the float version.
+ *
+ * @param x Value
+ * @param activation One of the ACTIVATION_* values
+ * @return The activated value.
+ */
+double activate(double x, int activation);
+float sactivate(float x, int activation);
+
+/**
+ * This function detects the widest instruction set the CPU and OS support
+ * with cpuid, once. The MAXGFLOPS_ISA environment variable (scalar, avx2 or
+ * avx512) can cap it, e.g. to compare kernels on one machine.
+ *
+ * @return One of ISA_SCALAR, ISA_AVX2 or ISA_AVX512.
+ */
+int detect_isa(void);
+
+/**
+ * This function returns the microkernel of an element type for the widest
+ * instruction set the CPU supports. For double: AVX-512 24x8, else AVX2 12x4,
+ * else scalar 4x4. For float: AVX-512 48x8, else AVX2 24x4, else scalar 8x4.
+ * For double complex: AVX-512 8x6, else AVX2 4x3, else scalar 2x2.
+ *
+ * @param dtype One of the DTYPE_* values
+ * @return The selected microkernel.
+ */
+const microkernel_t* select_microkernel(int dtype);
+
+/**
+ * This function looks up a microkernel of an element type with an
+ * m_r x n_r register tile that the CPU supports.
+ *
+ * @param dtype One of the DTYPE_* values
+ * @param m_r Rows of the register tile
+ * @param n_r Columns of the register tile
+ * @return The microkernel, or NULL if there is none for this shape.
+ */
+const microkernel_t* find_microkernel(int dtype, int m_r, int n_r);
+
+/**
+ * This function lists the microkernels of an element type the CPU
+ * supports, widest first.
+ *
+ * @param dtype One of the DTYPE_* values
+ * @param kernels Array that receives the microkernels
+ * @param max_kernels Capacity of kernels
+ * @return The number of microkernels written.
  */
-void multiply_blocks_avx(double* A_block, double* B_sliver, double* C_block, int m_c, int k_c, int n_r, int m_r);
+int supported_microkernels(int dtype, const microkernel_t** kernels, int max_kernels);
 
 /**
  * This function prints the matrix with the given number of rows and columns.
@@ -93,23 +287,36 @@ void print_matrix(double* matrix, int rows, int cols, const char* name);
  * This function prints and logs various performance metrics
  *
  * @param time_taken Time taken
+ * @param pack_time Part of time_taken spent packing A and B
  * @param gflops Calculated GFLOPS 
- * @param gflops_util Utilization
+ * @param gflops_util Share of the measured compute ceiling
+ * @param intensity Arithmetic intensity in flops per byte of DRAM traffic
+ * @param bandwidth_util Share of the measured bandwidth ceiling
+ * @param roofline_util Share of the roofline bound at intensity, see roofline_bound
  * @param cache_l1_used Amount of L1 cache used in KB.
  * @param cache_l2_used Amount of L2 cache used in KB.
  * @param CACHE_L1_SIZE_KB Total size of the L1 cache in KB.
  * @param CACHE_L2_SIZE_KB Total size of the L2 cache in KB.
+ * @param m_c rows of the packed block of A
  * @param k_c columns of A, rows of B
+ * @param n_c columns of the packed panel of B
  * @param n_r columns of B and C
  * @param m_r rows of A and C
+ * @param prefetch prefetch distance of the microkernel in k iterations
+ * @param precision Element type that ran, see dtype_name
+ * @param kernel_name Name of the microkernel that ran
+ * @param counters Hardware counts of the run, or NULL. Appended to the
+ *                 CSV row as the pack then compute phase of every event,
+ *                 with empty cells for events that were not counted.
  * @param fp File pointer to log the performance data into a CSV file.
  */
 void print_performance_info(
-    double time_taken, double gflops, double gflops_util,
+    double time_taken, double pack_time, double gflops, double gflops_util,
+    double intensity, double bandwidth_util, double roofline_util,
     int cache_l1_used, int cache_l2_used, 
     double CACHE_L1_SIZE_KB, double CACHE_L2_SIZE_KB, 
-    int k_c, int n_r, int m_r,
-    FILE* fp
+    int m_c, int k_c, int n_c, int n_r, int m_r, int prefetch,
+    const char* precision, const char* kernel_name, const gebp_counters_t* counters, FILE* fp
 );
 
 #endif
\ No newline at end of file
@@ -0,0 +1,484 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Matrix files and the out-of-core GEMM that streams
+ * their panels through gebp, reading the next panels on
+ * a second thread. Everything is column major.
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "arena.h"
+#include "gemm.h"
+#include "matrix_ops.h"
+#include "ooc.h"
+
+#define OOC_TILE_ALIGN 8 // Tile edges are rounded down to whole cache lines of doubles
+
+/**
+ * Reads or writes bytes at offset, retrying short transfers. Returns 0,
+ * or -1 with errno set (EIO at the end of the file).
+ */
+static int transfer(int fd, void* buf, size_t bytes, off_t offset, int write)
+{
+    char* p = (char*)buf;
+
+    while (bytes > 0) 
+    {
+        ssize_t done = write ? pwrite(fd, p, bytes, offset) : pread(fd, p, bytes, offset);
+        if (done < 0 && errno == EINTR) 
+        {
+            continue;
+        }
+        if (done <= 0) 
+        {
+            errno = (done == 0) ? EIO : errno;
+            return -1;
+        }
+        p += done;
+        bytes -= (size_t)done;
+        offset += done;
+    }
+    return 0;
+}
+
+/**
+ * Byte offset of element (i, j) of a matrix file.
+ */
+static off_t element_offset(const matrix_file_t* f, int i, int j)
+{
+    return MATRIX_FILE_DATA + ((off_t)j * f->rows + i) * (off_t)dtype_size(f->dtype);
+}
+
+int matrix_file_create(const char* path, int dtype, int rows, int cols, matrix_file_t* f)
+{
+    matrix_file_header_t header;
+
+    if (rows < 0 || cols < 0 || dtype < 0 || dtype >= DTYPE_COUNT) 
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    f->fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (f->fd < 0) 
+    {
+        return -1;
+    }
+    f->rows = rows;
+    f->cols = cols;
+    f->dtype = dtype;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = MATRIX_FILE_MAGIC;
+    header.version = MATRIX_FILE_VERSION;
+    header.dtype = dtype;
+    header.rows = rows;
+    header.cols = cols;
+
+    if (transfer(f->fd, &header, sizeof(header), 0, 1) != 0 || ftruncate(f->fd, element_offset(f, 0, cols)) != 0) 
+    {
+        int saved = errno;
+        close(f->fd);
+        errno = saved;
+        return -1;
+    }
+    return 0;
+}
+
+int matrix_file_open(const char* path, int writable, matrix_file_t* f)
+{
+    matrix_file_header_t header;
+
+    f->fd = open(path, writable ? O_RDWR : O_RDONLY);
+    if (f->fd < 0) 
+    {
+        return -1;
+    }
+
+    off_t size = lseek(f->fd, 0, SEEK_END);
+    int ok = transfer(f->fd, &header, sizeof(header), 0, 0) == 0
+             && header.magic == MATRIX_FILE_MAGIC && header.version == MATRIX_FILE_VERSION
+             && header.dtype >= 0 && header.dtype < DTYPE_COUNT
+             && header.rows >= 0 && header.rows <= INT32_MAX && header.cols >= 0 && header.cols <= INT32_MAX;
+
+    if (ok) 
+    {
+        f->rows = (int)header.rows;
+        f->cols = (int)header.cols;
+        f->dtype = header.dtype;
+        ok = size >= element_offset(f, 0, f->cols);
+    }
+    if (!ok) 
+    {
+        close(f->fd);
+        errno = EINVAL;
+        return -1;
+    }
+
+    posix_fadvise(f->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+void matrix_file_close(matrix_file_t* f)
+{
+    close(f->fd);
+    f->fd = -1;
+}
+
+/**
+ * Moves the m x n block at (i0, j0) between a double precision matrix
+ * file and X, in one transfer when the block spans whole columns.
+ */
+static int transfer_block(const matrix_file_t* f, int i0, int j0, int m, int n, double* X, int ldx, int write)
+{
+    if (m <= 0 || n <= 0) 
+    {
+        return 0;
+    }
+    if (f->dtype != DTYPE_DOUBLE || i0 < 0 || j0 < 0 || i0 + m > f->rows || j0 + n > f->cols) 
+    {
+        errno = EINVAL;
+        return -1;
+    }
+
+    if (m == f->rows && ldx == m) 
+    {
+        return transfer(f->fd, X, (size_t)m * n * sizeof(double), element_offset(f, i0, j0), write);
+    }
+
+    for (int j = 0; j < n; j++) 
+    {
+        if (transfer(f->fd, &X[(size_t)j * ldx], (size_t)m * sizeof(double), element_offset(f, i0, j0 + j), write) != 0) 
+        {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+int matrix_file_read_block(const matrix_file_t* f, int i0, int j0, int m, int n, double* X, int ldx)
+{
+    return transfer_block(f, i0, j0, m, n, X, ldx, 0);
+}
+
+int matrix_file_write_block(const matrix_file_t* f, int i0, int j0, int m, int n, const double* X, int ldx)
+{
+    return transfer_block(f, i0, j0, m, n, (double*)X, ldx, 1);
+}
+
+void matrix_file_evict(const matrix_file_t* f)
+{
+    fdatasync(f->fd);
+    posix_fadvise(f->fd, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+/**
+ * A panel of A and a panel of B to read, and how the read went.
+ */
+typedef struct
+{
+    const matrix_file_t* A; // File of A
+    const matrix_file_t* B; // File of B
+    int i0, j0, k0; // First row of A, column of B, and column of A / row of B
+    int m, n, k; // Panel of A is m x k, panel of B is k x n
+    double* A_panel; // Receives the panel of A, leading dimension m
+    double* B_panel; // Receives the panel of B, leading dimension k
+    int status; // 0, or -1 if a read failed
+    int error; // errno of the failed read
+} panel_read_t;
+
+/**
+ * The reader thread of ooc_dgemm and the read it is working on.
+ */
+typedef struct
+{
+    pthread_t thread; // The reader
+    pthread_mutex_t lock; // Guards job and stop
+    pthread_cond_t wake; // Signalled when a read is posted or the reader must stop
+    pthread_cond_t done; // Signalled when the posted read is finished
+    panel_read_t* job; // Posted read, NULL once it is finished
+    int stop; // 1 when the reader must exit
+} panel_reader_t;
+
+/**
+ * Reads the panels of a panel_read_t.
+ */
+static void read_panels(panel_read_t* r)
+{
+    r->status = matrix_file_read_block(r->A, r->i0, r->k0, r->m, r->k, r->A_panel, r->m);
+    if (r->status == 0) 
+    {
+        r->status = matrix_file_read_block(r->B, r->k0, r->j0, r->k, r->n, r->B_panel, r->k);
+    }
+    r->error = (r->status != 0) ? errno : 0;
+}
+
+/**
+ * Body of the reader thread: reads each posted panel_read_t until stopped.
+ */
+static void* reader_main(void* arg)
+{
+    panel_reader_t* reader = (panel_reader_t*)arg;
+
+    // The caller may be pinned to the CPU of gebp's thread 0; the reads must not compete with it
+    gebp_place_thread(-1);
+
+    pthread_mutex_lock(&reader->lock);
+    for (;;) 
+    {
+        while (reader->job == NULL && !reader->stop) 
+        {
+            pthread_cond_wait(&reader->wake, &reader->lock);
+        }
+        if (reader->job == NULL) 
+        {
+            break;
+        }
+
+        panel_read_t* job = reader->job;
+        pthread_mutex_unlock(&reader->lock);
+        read_panels(job);
+        pthread_mutex_lock(&reader->lock);
+
+        reader->job = NULL;
+        pthread_cond_signal(&reader->done);
+    }
+    pthread_mutex_unlock(&reader->lock);
+    return NULL;
+}
+
+/**
+ * Hands a read to the reader thread.
+ */
+static void reader_post(panel_reader_t* reader, panel_read_t* job)
+{
+    pthread_mutex_lock(&reader->lock);
+    reader->job = job;
+    pthread_cond_signal(&reader->wake);
+    pthread_mutex_unlock(&reader->lock);
+}
+
+/**
+ * Waits until the reader thread has finished the read posted last.
+ */
+static void reader_wait(panel_reader_t* reader)
+{
+    pthread_mutex_lock(&reader->lock);
+    while (reader->job != NULL) 
+    {
+        pthread_cond_wait(&reader->done, &reader->lock);
+    }
+    pthread_mutex_unlock(&reader->lock);
+}
+
+/**
+ * Sets up the reads of step s. Steps run through the k panels of each
+ * tile of C, the tiles in column-major order.
+ */
+static void plan_step(panel_read_t* r, long s, int M, int N, int K, int tile_m, int tile_n, int tile_k)
+{
+    long panels = (K + tile_k - 1) / tile_k;
+    long tiles_m = (M + tile_m - 1) / tile_m;
+    long tile = s / panels;
+
+    r->i0 = (int)(tile % tiles_m) * tile_m;
+    r->j0 = (int)(tile / tiles_m) * tile_n;
+    r->k0 = (int)(s % panels) * tile_k;
+    r->m = (M - r->i0 < tile_m) ? M - r->i0 : tile_m;
+    r->n = (N - r->j0 < tile_n) ? N - r->j0 : tile_n;
+    r->k = (K - r->k0 < tile_k) ? K - r->k0 : tile_k;
+}
+
+int ooc_dgemm(const matrix_file_t* A, const matrix_file_t* B, const matrix_file_t* C, size_t memory,
+              const blocking_t* blocking, int num_threads, ooc_stats_t* stats)
+{
+    const blocking_t* b = blocking;
+    int M = A->rows, K = A->cols, N = B->cols;
+    ooc_stats_t st;
+    double start = wall_time();
+
+    memset(&st, 0, sizeof(st));
+    if (B->rows != K || C->rows != M || C->cols != N) 
+    {
+        errno = EINVAL;
+        return -1;
+    }
+    if (M == 0 || N == 0) 
+    {
+        return 0;
+    }
+
+    // A tile of C and two panels each of A and B, all tile x tile: 5 tile^2 doubles
+    long tile = (long)sqrt((double)memory / (5.0 * sizeof(double)));
+    tile = (tile >= OOC_TILE_ALIGN) ? tile / OOC_TILE_ALIGN * OOC_TILE_ALIGN : tile;
+    if (tile < 1) 
+    {
+        errno = ENOMEM;
+        return -1;
+    }
+    st.tile_m = (M < tile) ? M : (int)tile;
+    st.tile_n = (N < tile) ? N : (int)tile;
+    st.tile_k = (K < tile) ? ((K > 0) ? K : 1) : (int)tile;
+
+    double* C_tile = (double*)alloc_matrix((size_t)st.tile_m * st.tile_n, sizeof(double), 0);
+    double* A_panel[2];
+    double* B_panel[2];
+    int ok = C_tile != NULL;
+    for (int s = 0; s < 2; s++) 
+    {
+        A_panel[s] = (double*)alloc_matrix((size_t)st.tile_m * st.tile_k, sizeof(double), 0);
+        B_panel[s] = (double*)alloc_matrix((size_t)st.tile_k * st.tile_n, sizeof(double), 0);
+        ok = ok && A_panel[s] != NULL && B_panel[s] != NULL;
+    }
+
+    long panels = (K + st.tile_k - 1) / st.tile_k;
+    long tiles = (long)((M + st.tile_m - 1) / st.tile_m) * ((N + st.tile_n - 1) / st.tile_n);
+    long steps = (K > 0) ? tiles * panels : 0;
+    panel_read_t read[2];
+    int status = ok ? 0 : -1;
+    int error = ok ? 0 : ENOMEM;
+
+    for (int s = 0; s < 2; s++) 
+    {
+        read[s].A = A;
+        read[s].B = B;
+        read[s].A_panel = A_panel[s];
+        read[s].B_panel = B_panel[s];
+    }
+
+    // One reader for the whole product; without it every read is made in line
+    panel_reader_t reader;
+    int threaded = 0;
+    if (status == 0 && steps > 1) 
+    {
+        reader.job = NULL;
+        reader.stop = 0;
+        pthread_mutex_init(&reader.lock, NULL);
+        pthread_cond_init(&reader.wake, NULL);
+        pthread_cond_init(&reader.done, NULL);
+        threaded = pthread_create(&reader.thread, NULL, reader_main, &reader) == 0;
+        if (!threaded) 
+        {
+            pthread_mutex_destroy(&reader.lock);
+            pthread_cond_destroy(&reader.wake);
+            pthread_cond_destroy(&reader.done);
+        }
+    }
+
+    // The first panels are read before anything can overlap with them
+    if (status == 0 && steps > 0) 
+    {
+        double t = wall_time();
+        plan_step(&read[0], 0, M, N, K, st.tile_m, st.tile_n, st.tile_k);
+        read_panels(&read[0]);
+        status = read[0].status;
+        error = read[0].error;
+        st.io_wait += wall_time() - t;
+    }
+
+    for (long s = 0; status == 0 && s < steps; s++) 
+    {
+        panel_read_t* cur = &read[s % 2];
+        panel_read_t* next = &read[(s + 1) % 2];
+
+        st.bytes_read += ((size_t)cur->m * cur->k + (size_t)cur->k * cur->n) * sizeof(double);
+
+        // Read the next panels while gebp runs on these
+        if (s + 1 < steps) 
+        {
+            plan_step(next, s + 1, M, N, K, st.tile_m, st.tile_n, st.tile_k);
+            if (threaded) 
+            {
+                reader_post(&reader, next);
+            }
+        }
+
+        double t = wall_time();
+        gebp(cur->m, cur->n, cur->k, 1.0, cur->A_panel, cur->m, cur->B_panel, cur->k, (cur->k0 == 0) ? 0.0 : 1.0, C_tile, cur->m, NULL,
+             b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, num_threads, NULL);
+        st.compute += wall_time() - t;
+
+        // The last panel finishes the tile
+        if (cur->k0 + cur->k >= K) 
+        {
+            t = wall_time();
+            if (matrix_file_write_block(C, cur->i0, cur->j0, cur->m, cur->n, C_tile, cur->m) != 0) 
+            {
+                status = -1;
+                error = errno;
+            }
+            st.bytes_written += (size_t)cur->m * cur->n * sizeof(double);
+            st.write += wall_time() - t;
+        }
+
+        if (s + 1 < steps) 
+        {
+            t = wall_time();
+            if (threaded) 
+            {
+                reader_wait(&reader);
+            }
+            else 
+            {
+                read_panels(next);
+            }
+            st.io_wait += wall_time() - t;
+
+            if (status == 0 && next->status != 0) 
+            {
+                status = -1;
+                error = next->error;
+            }
+        }
+    }
+
+    if (threaded) 
+    {
+        pthread_mutex_lock(&reader.lock);
+        reader.stop = 1;
+        pthread_cond_signal(&reader.wake);
+        pthread_mutex_unlock(&reader.lock);
+        pthread_join(reader.thread, NULL);
+        pthread_mutex_destroy(&reader.lock);
+        pthread_cond_destroy(&reader.wake);
+        pthread_cond_destroy(&reader.done);
+    }
+
+    // With K = 0, C = A * B is zero
+    if (status == 0 && steps == 0) 
+    {
+        memset(C_tile, 0, (size_t)st.tile_m * st.tile_n * sizeof(double));
+        for (int j = 0; status == 0 && j < N; j += st.tile_n) 
+        {
+            for (int i = 0; status == 0 && i < M; i += st.tile_m) 
+            {
+                int m = (M - i < st.tile_m) ? M - i : st.tile_m;
+                int n = (N - j < st.tile_n) ? N - j : st.tile_n;
+                status = matrix_file_write_block(C, i, j, m, n, C_tile, m);
+                error = errno;
+                st.bytes_written += (size_t)m * n * sizeof(double);
+            }
+        }
+    }
+
+    free(C_tile);
+    for (int s = 0; s < 2; s++) 
+    {
+        free(A_panel[s]);
+        free(B_panel[s]);
+    }
+
+    st.seconds = wall_time() - start;
+    if (stats != NULL) 
+    {
+        *stats = st;
+    }
+    errno = (status != 0) ? error : errno;
+    return status;
+}
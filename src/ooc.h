@@ -0,0 +1,135 @@
+#ifndef OOC_H
+#define OOC_H
+#include <stddef.h>
+#include <stdint.h>
+#include "tune.h"
+
+#define MATRIX_FILE_MAGIC 0x4647584d // "MXGF" read as a little endian uint32
+#define MATRIX_FILE_VERSION 1 // Version written to new files
+#define MATRIX_FILE_DATA 4096 // Offset of the first element, so the data is page aligned
+
+/**
+ * ## Matrix files
+ *
+ * A matrix file is a header followed, at offset MATRIX_FILE_DATA, by the
+ * elements in column-major order with no padding: element (i, j) is at
+ * MATRIX_FILE_DATA + (j * rows + i) * element size. The header holds the
+ * magic number, the version, the element type (one of the DTYPE_* values)
+ * and the dimensions, in the byte order of the machine that wrote it.
+ */
+typedef struct
+{
+    uint32_t magic; // MATRIX_FILE_MAGIC
+    uint32_t version; // MATRIX_FILE_VERSION
+    int32_t dtype; // Element type, one of DTYPE_*
+    int32_t reserved; // Zero
+    int64_t rows; // Rows of the matrix
+    int64_t cols; // Columns of the matrix
+} matrix_file_header_t;
+
+/**
+ * An open matrix file.
+ */
+typedef struct
+{
+    int fd; // File descriptor
+    int rows; // Rows of the matrix
+    int cols; // Columns of the matrix
+    int dtype; // Element type, one of DTYPE_*
+} matrix_file_t;
+
+/**
+ * What an out-of-core product did, for reporting.
+ */
+typedef struct
+{
+    double seconds; // Wall time of the whole product
+    double compute; // Seconds in gebp
+    double io_wait; // Seconds gebp waited for panels that were not read yet
+    double write; // Seconds writing tiles of C
+    size_t bytes_read; // Bytes read from A and B
+    size_t bytes_written; // Bytes written to C
+    int tile_m, tile_n, tile_k; // Tile of C and width of the panels
+} ooc_stats_t;
+
+/**
+ * This function creates (or truncates) a matrix file of rows x cols elements,
+ * writes its header and sizes it, and opens it for reading and writing. The
+ * elements read as zero until they are written.
+ *
+ * @param path File to create
+ * @param dtype Element type, one of the DTYPE_* values
+ * @param rows Rows of the matrix
+ * @param cols Columns of the matrix
+ * @param f Receives the open file
+ * @return 0, or -1 with errno set.
+ */
+int matrix_file_create(const char* path, int dtype, int rows, int cols, matrix_file_t* f);
+
+/**
+ * This function opens a matrix file and checks its header.
+ *
+ * @param path File to open
+ * @param writable 1 to open it for reading and writing, 0 for reading only
+ * @param f Receives the open file
+ * @return 0, or -1 with errno set (EINVAL for a bad header or size).
+ */
+int matrix_file_open(const char* path, int writable, matrix_file_t* f);
+
+/**
+ * This function closes a matrix file.
+ */
+void matrix_file_close(matrix_file_t* f);
+
+/**
+ * This function reads the m x n block at row i0 and column j0 of a double
+ * precision matrix file into X (column-major, leading dimension ldx), with
+ * one read per column, or a single read when the block spans whole columns.
+ *
+ * @return 0, or -1 with errno set.
+ */
+int matrix_file_read_block(const matrix_file_t* f, int i0, int j0, int m, int n, double* X, int ldx);
+
+/**
+ * This function writes X (m x n, leading dimension ldx) to the block at row
+ * i0 and column j0 of a double precision matrix file.
+ *
+ * @return 0, or -1 with errno set.
+ */
+int matrix_file_write_block(const matrix_file_t* f, int i0, int j0, int m, int n, const double* X, int ldx);
+
+/**
+ * This function writes the file's dirty pages back and drops its pages
+ * from the page cache, so the next reads come from the disk. Benchmarks
+ * call it between runs; it does nothing on file systems in memory (tmpfs).
+ */
+void matrix_file_evict(const matrix_file_t* f);
+
+/**
+ * ## Out-of-core GEMM
+ *
+ * Computes C = A * B for double precision matrix files that need not fit in
+ * memory. C is split into tiles of at most tile_m x tile_n, each held in
+ * memory while the panels of A (tile_m x tile_k) and B (tile_k x
+ * tile_n) are streamed from the files and multiplied into it with gebp. The
+ * panels are double buffered: one reader thread, started for the call and
+ * free to run on any of the process's CPUs, reads the next pair (possibly
+ * of the next tile) while gebp works on the current one, so the disk and
+ * the cores run at the same time. A finished tile is written to C before
+ * the next one starts. The tiles are as large and square as memory allows,
+ * with tile_k equal to the tile edge: A is read N / tile_n times and B
+ * M / tile_m times, so the flops per byte read grow with the memory given.
+ *
+ * @param A M x K matrix file
+ * @param B K x N matrix file
+ * @param C M x N matrix file, opened writable; overwritten
+ * @param memory Bytes for the tile of C and the four panel buffers (gebp's packing buffers come on top)
+ * @param blocking Blocking for gebp
+ * @param num_threads Threads for gebp
+ * @param stats If not NULL, receives the times and bytes moved
+ * @return 0, or -1 if the shapes do not match, memory is too small, or I/O failed (errno set).
+ */
+int ooc_dgemm(const matrix_file_t* A, const matrix_file_t* B, const matrix_file_t* C, size_t memory,
+              const blocking_t* blocking, int num_threads, ooc_stats_t* stats);
+
+#endif
@@ -0,0 +1,149 @@
+/**
+ * Packing routines and the block multiply for one element type.
+ * matrix_ops.c includes this file once per type, with:
+ *   ELEM    the element type (float, double or double complex)
+ *   DTYPE   its DTYPE_* value
+ *   FN      a macro adding the BLAS prefix to a function name
+ *   KERNEL  the member of microkernel_t.kernel for the type
+ * There is deliberately no include guard.
+ */
+
+void FN(pack_A)(ELEM* A_packed, const ELEM* A, int rsa, int csa, int m_c, int k_c, int m_r, int i_block, int k_block)
+{
+    for (int i = 0; i < m_c; i += m_r) 
+    {
+        int m = (m_c - i < m_r) ? m_c - i : m_r;
+        ELEM* panel = &A_packed[i * k_c];
+        const ELEM* a = &A[(size_t)(i_block + i) * rsa + (size_t)k_block * csa];
+
+        for (int k = 0; k < k_c; k++) 
+        {
+            const ELEM* col = &a[(size_t)k * csa];
+            int ii;
+
+            // Column-major blocks are copied a column at a time; otherwise the
+            // m_r rows are walked side by side, so each of their cache lines
+            // serves several k
+            if (rsa == 1) 
+            {
+                for (ii = 0; ii < m; ii++) 
+                {
+                    panel[k * m_r + ii] = col[ii];
+                }
+            }
+            else 
+            {
+                for (ii = 0; ii < m; ii++) 
+                {
+                    panel[k * m_r + ii] = col[(size_t)ii * rsa];
+                }
+            }
+            for (; ii < m_r; ii++) 
+            {
+                panel[k * m_r + ii] = 0;
+            }
+        }
+    }
+}
+
+void FN(pack_B)(ELEM* B_packed, const ELEM* B, int rsb, int csb, int k_c, int n_c, int n_r, int j_block, int k_block)
+{
+    for (int j = 0; j < n_c; j += n_r) 
+    {
+        int n = (n_c - j < n_r) ? n_c - j : n_r;
+        ELEM* panel = &B_packed[j * k_c];
+        const ELEM* b = &B[(size_t)k_block * rsb + (size_t)(j_block + j) * csb];
+
+        if (csb == 1) 
+        {
+            // Row-major or transposed: the n_r elements of a row are adjacent
+            for (int k = 0; k < k_c; k++) 
+            {
+                const ELEM* row = &b[(size_t)k * rsb];
+                int jj;
+
+                for (jj = 0; jj < n; jj++) 
+                {
+                    panel[k * n_r + jj] = row[jj];
+                }
+                for (; jj < n_r; jj++) 
+                {
+                    panel[k * n_r + jj] = 0;
+                }
+            }
+            continue;
+        }
+
+        for (int jj = 0; jj < n_r; jj++) 
+        {
+            const ELEM* col = &b[(size_t)jj * csb];
+
+            for (int k = 0; k < k_c; k++) 
+            {
+                panel[k * n_r + jj] = (jj < n) ? col[(size_t)k * rsb] : 0;
+            }
+        }
+    }
+}
+
+/**
+ * Portable kernel for register tile shapes that have no microkernel.
+ */
+static void FN(microkernel_generic)(int m_r, int n_r, int k_c, const ELEM* A, const ELEM* B, ELEM* C, int ldc, int m, int n, ELEM alpha, ELEM beta)
+{
+    ELEM ab[MR_MAX * NR_MAX] = {0};
+
+    for (int k = 0; k < k_c; k++) 
+    {
+        for (int j = 0; j < n_r; j++) 
+        {
+            ELEM b_val = B[k * n_r + j];
+            for (int i = 0; i < m_r; i++) 
+            {
+                ab[j * m_r + i] += A[k * m_r + i] * b_val;
+            }
+        }
+    }
+
+    for (int j = 0; j < n; j++) 
+    {
+        for (int i = 0; i < m; i++) 
+        {
+            C[j * ldc + i] = alpha * ab[j * m_r + i] + (beta == 0 ? 0 : beta * C[j * ldc + i]);
+        }
+    }
+}
+
+void FN(multiply_blocks_avx)(ELEM* A_packed, ELEM* B_packed, ELEM* C, int ldc, int m_c, int n, int k_c, int n_r, int m_r, ELEM alpha, ELEM beta, 
+                             int prefetch, const epilogue_t* ep)
+{
+    const microkernel_t* kernel = find_microkernel(DTYPE, m_r, n_r);
+    epilogue_t tile_ep; // ep with the row biases offset to the current tile
+
+    for (int i = 0; i < m_c; i += m_r) 
+    {
+        int m = (m_c - i < m_r) ? m_c - i : m_r;
+        const ELEM* A_panel = &A_packed[i * k_c];
+        const epilogue_t* tile = NULL;
+
+        if (ep != NULL) 
+        {
+            tile_ep = *ep;
+            tile_ep.row_bias = (ep->row_bias != NULL) ? (const ELEM*)ep->row_bias + i : NULL;
+            tile = &tile_ep;
+        }
+
+        // The packed panels are zero padded, so edge tiles run the full
+        // kernel and only mask the rows and columns they merge into C
+        if (kernel != NULL) 
+        {
+            kernel->kernel.KERNEL(k_c, A_panel, B_packed, &C[i], ldc, m, n, alpha, beta, prefetch, tile);
+        }
+        else 
+        {
+            // The tile is still in L1 for the epilogue
+            FN(microkernel_generic)(m_r, n_r, k_c, A_panel, B_packed, &C[i], ldc, m, n, alpha, beta);
+            FN(apply_epilogue)(&C[i], ldc, m, n, tile);
+        }
+    }
+}
@@ -0,0 +1,151 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Hardware performance counters through the perf_event_open
+ * system call, used to split gebp into packing and compute
+ * phases. No library beyond libc is needed.
+ */
+
+#include <linux/perf_event.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "perf_counters.h"
+
+#define CACHE_EVENT(cache) ((cache) | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16))
+#define INTEL_L2_RQSTS_MISS 0x3f24 // L2_RQSTS.MISS: event 0x24, umask 0x3f
+
+static const char* event_names[PERF_EVENTS] = {"cycles", "instructions", "L1D misses", "L2 misses", "LLC misses", "dTLB misses"};
+
+int perf_counters_requested(void)
+{
+    const char* env = getenv("MAXGFLOPS_COUNTERS");
+    return env != NULL && atoi(env) != 0;
+}
+
+/**
+ * Fills in the perf_event_attr for one event. Returns 0 if the event
+ * has no encoding on this CPU.
+ */
+static int event_attr(int event, struct perf_event_attr* attr)
+{
+    memset(attr, 0, sizeof(*attr));
+    attr->size = sizeof(*attr);
+    attr->exclude_kernel = 1;
+    attr->exclude_hv = 1;
+    attr->read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    switch (event) 
+    {
+        case PERF_CYCLES:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_CPU_CYCLES;
+            return 1;
+        case PERF_INSTRUCTIONS:
+            attr->type = PERF_TYPE_HARDWARE;
+            attr->config = PERF_COUNT_HW_INSTRUCTIONS;
+            return 1;
+        case PERF_L1D_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = CACHE_EVENT(PERF_COUNT_HW_CACHE_L1D);
+            return 1;
+        case PERF_L2_MISSES:
+            // Only Intel has a stable raw encoding for L2 misses
+            attr->type = PERF_TYPE_RAW;
+            attr->config = INTEL_L2_RQSTS_MISS;
+            return __builtin_cpu_is("intel");
+        case PERF_LLC_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = CACHE_EVENT(PERF_COUNT_HW_CACHE_LL);
+            return 1;
+        case PERF_DTLB_MISSES:
+            attr->type = PERF_TYPE_HW_CACHE;
+            attr->config = CACHE_EVENT(PERF_COUNT_HW_CACHE_DTLB);
+            return 1;
+    }
+    return 0;
+}
+
+int perf_counters_open(perf_counters_t* pc)
+{
+    pc->leader = -1;
+    pc->count = 0;
+
+    for (int e = 0; e < PERF_EVENTS; e++) 
+    {
+        struct perf_event_attr attr;
+        pc->fd[e] = -1;
+        pc->slot[e] = -1;
+
+        if (!event_attr(e, &attr)) 
+        {
+            continue;
+        }
+
+        // The first event that opens leads the group and starts it disabled
+        attr.disabled = (pc->leader < 0);
+        int fd = (int)syscall(SYS_perf_event_open, &attr, 0, -1, pc->leader, 0);
+        if (fd < 0) 
+        {
+            continue;
+        }
+
+        if (pc->leader < 0) 
+        {
+            pc->leader = fd;
+        }
+        pc->fd[e] = fd;
+        pc->slot[e] = pc->count++;
+    }
+
+    if (pc->leader >= 0) 
+    {
+        ioctl(pc->leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(pc->leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    return pc->count;
+}
+
+void perf_counters_read(const perf_counters_t* pc, long long values[PERF_EVENTS])
+{
+    unsigned long long buf[3 + PERF_EVENTS]; // nr, time enabled, time running, values
+    int ok = pc->leader >= 0 && read(pc->leader, buf, sizeof(buf)) > 0;
+
+    // Scale up if the group only ran for part of the time it was enabled
+    double scale = (ok && buf[2] > 0) ? (double)buf[1] / buf[2] : 1.0;
+
+    for (int e = 0; e < PERF_EVENTS; e++) 
+    {
+        values[e] = (ok && pc->slot[e] >= 0) ? (long long)(buf[3 + pc->slot[e]] * scale) : -1;
+    }
+}
+
+void perf_counters_close(perf_counters_t* pc)
+{
+    for (int e = 0; e < PERF_EVENTS; e++) 
+    {
+        if (pc->fd[e] >= 0) 
+        {
+            close(pc->fd[e]);
+        }
+        pc->fd[e] = -1;
+        pc->slot[e] = -1;
+    }
+    pc->leader = -1;
+    pc->count = 0;
+}
+
+const char* perf_event_name(int event)
+{
+    return (event >= 0 && event < PERF_EVENTS) ? event_names[event] : "unknown";
+}
+
+void gebp_counters_clear(gebp_counters_t* counters)
+{
+    for (int e = 0; e < PERF_EVENTS; e++) 
+    {
+        counters->pack[e] = -1;
+        counters->compute[e] = -1;
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#define PERF_CYCLES 0 // Core cycles
+#define PERF_INSTRUCTIONS 1 // Retired instructions
+#define PERF_L1D_MISSES 2 // L1 data cache read misses
+#define PERF_L2_MISSES 3 // L2 misses (Intel only, there is no generic event)
+#define PERF_LLC_MISSES 4 // Last level cache read misses
+#define PERF_DTLB_MISSES 5 // Data TLB read misses
+#define PERF_EVENTS 6 // Number of events
+
+/**
+ * One thread's hardware counters, opened as a single perf_event_open group
+ * so that all events are read with one system call.
+ */
+typedef struct
+{
+    int leader; // File descriptor of the group leader, -1 if nothing opened
+    int fd[PERF_EVENTS]; // File descriptor per event, -1 if unavailable
+    int slot[PERF_EVENTS]; // Position of each event in a group read, -1 if unavailable
+    int count; // Events opened
+} perf_counters_t;
+
+/**
+ * Counter totals of gebp split into phases. The pack phase covers pack_A and
+ * pack_B, the compute phase everything else (the microkernels and the waits
+ * at barriers). Events that could not be counted are -1.
+ */
+typedef struct
+{
+    long long pack[PERF_EVENTS]; // Counts while packing, summed over threads
+    long long compute[PERF_EVENTS]; // Counts while computing, summed over threads
+} gebp_counters_t;
+
+/**
+ * Returns 1 if counters were asked for with MAXGFLOPS_COUNTERS=1, else 0.
+ */
+int perf_counters_requested(void);
+
+/**
+ * This function opens the counters for the calling thread with
+ * perf_event_open, counting user space only. Events the CPU, kernel
+ * or perf_event_paranoid setting do not allow are left out.
+ *
+ * @param pc Receives the counters
+ * @return Number of events opened, 0 if none.
+ */
+int perf_counters_open(perf_counters_t* pc);
+
+/**
+ * This function reads the current counts, scaled up if the kernel had to
+ * multiplex the group.
+ *
+ * @param pc Counters from perf_counters_open
+ * @param values Receives one count per event, -1 for events not opened
+ */
+void perf_counters_read(const perf_counters_t* pc, long long values[PERF_EVENTS]);
+
+/**
+ * This function closes the counters.
+ *
+ * @param pc Counters from perf_counters_open
+ */
+void perf_counters_close(perf_counters_t* pc);
+
+/**
+ * Returns a short name for an event, for use as a column heading.
+ *
+ * @param event One of PERF_CYCLES .. PERF_DTLB_MISSES
+ */
+const char* perf_event_name(int event);
+
+/**
+ * This function sets every count in a gebp_counters_t to -1.
+ *
+ * @param counters Counters to reset
+ */
+void gebp_counters_clear(gebp_counters_t* counters);
+
+#endif
@@ -0,0 +1,466 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * A persistent pool of worker threads that runs many
+ * independent GEMM requests at once. Requests are split
+ * into tiles of C, single threaded gebp calls that the
+ * workers share by work stealing. Everything is column major.
+ */
+
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "pool.h"
+#include "gemm.h"
+#include "matrix_ops.h"
+#include "tune.h"
+
+#define DEQUE_MASK (POOL_DEQUE_SIZE - 1) // Slot of a deque index
+
+/**
+ * A Chase-Lev work-stealing deque of fixed capacity. Its owner pushes
+ * and pops tasks at the bottom; the other workers steal from the top.
+ */
+typedef struct
+{
+    _Atomic(pool_task_t*) slots[POOL_DEQUE_SIZE]; // Ring of tasks
+    atomic_long top; // Index of the oldest task, the next to steal
+    atomic_long bottom; // Index one past the newest task
+} task_deque_t;
+
+/**
+ * A worker thread and its deque.
+ */
+typedef struct
+{
+    gemm_pool_t* pool; // Pool the worker belongs to
+    int index; // Position in the pool, also the CPU it is pinned to
+    pthread_t thread; // The thread
+    unsigned int seed; // State of the victim choice
+    task_deque_t deque; // Tasks this worker took from the submissions
+} pool_worker_t;
+
+struct gemm_pool
+{
+    pool_worker_t* workers; // The workers
+    int num_workers; // Number of workers
+    int pin; // 1 pins worker w to the w-th allowed CPU
+    blocking_t blocking; // Blocking of the gebp calls
+    int task_m, task_n; // Rows and columns of C per task
+    _Atomic(gemm_request_t*) submitted; // Lock-free stack of requests not split yet
+    atomic_long work; // Requests on the stack plus tasks in the deques
+    atomic_long in_flight; // Requests submitted and not done
+    atomic_int sleepers; // Workers waiting on wake
+    atomic_int stop; // Set by gemm_pool_destroy
+    pthread_mutex_t lock; // Guards the waits on wake and done
+    pthread_cond_t wake; // Signalled when work is added or the pool stops
+    pthread_cond_t done; // Signalled when a request completes
+};
+
+/**
+ * Pushes a task at the bottom of the owner's deque. Returns 0, or -1 if
+ * the deque is full.
+ */
+static int deque_push(task_deque_t* d, pool_task_t* task)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+
+    if (b - t >= POOL_DEQUE_SIZE) 
+    {
+        return -1;
+    }
+    atomic_store_explicit(&d->slots[b & DEQUE_MASK], task, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    return 0;
+}
+
+/**
+ * Pops the newest task of the owner's deque, or returns NULL if it is
+ * empty or a thief took the last task first.
+ */
+static pool_task_t* deque_pop(task_deque_t* d)
+{
+    long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+    atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+
+    if (t > b) 
+    {
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+        return NULL;
+    }
+
+    pool_task_t* task = atomic_load_explicit(&d->slots[b & DEQUE_MASK], memory_order_relaxed);
+    if (t == b) 
+    {
+        // The last task: whoever moves top first gets it
+        if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) 
+        {
+            task = NULL;
+        }
+        atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+    return task;
+}
+
+/**
+ * Steals the oldest task of another worker's deque, or returns NULL if
+ * it is empty or another thief got there first.
+ */
+static pool_task_t* deque_steal(task_deque_t* d)
+{
+    long t = atomic_load_explicit(&d->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+    long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+    if (t >= b) 
+    {
+        return NULL;
+    }
+
+    pool_task_t* task = atomic_load_explicit(&d->slots[t & DEQUE_MASK], memory_order_relaxed);
+    if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) 
+    {
+        return NULL;
+    }
+    return task;
+}
+
+/**
+ * Wakes the sleeping workers, if there are any.
+ */
+static void wake_workers(gemm_pool_t* pool)
+{
+    if (atomic_load(&pool->sleepers) > 0) 
+    {
+        pthread_mutex_lock(&pool->lock);
+        pthread_cond_broadcast(&pool->wake);
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+/**
+ * Finishes a request whose last task has run: frees its tasks, calls its
+ * callback and marks it done.
+ */
+static void complete_request(gemm_pool_t* pool, gemm_request_t* request)
+{
+    request->completed = wall_time();
+    free(request->tasks);
+    request->tasks = NULL;
+    if (request->callback != NULL) 
+    {
+        request->callback(request->arg);
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    atomic_store(&request->done, 1);
+    atomic_fetch_sub(&pool->in_flight, 1);
+    pthread_cond_broadcast(&pool->done);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+/**
+ * Computes one tile of C with a single threaded gebp call over all of K.
+ */
+static void run_task(gemm_pool_t* pool, pool_task_t* task)
+{
+    gemm_request_t* r = task->request;
+    const blocking_t* b = &pool->blocking;
+    int i0 = task->i0, j0 = task->j0;
+    int m = (r->M - i0 < pool->task_m) ? r->M - i0 : pool->task_m;
+    int n = (r->N - j0 < pool->task_n) ? r->N - j0 : pool->task_n;
+
+    gebp(m, n, r->K, r->alpha, &r->A[i0], r->lda, &r->B[(size_t)j0 * r->ldb], r->ldb, r->beta, &r->C[(size_t)j0 * r->ldc + i0], r->ldc, NULL,
+         b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, 1, NULL);
+
+    if (atomic_fetch_sub(&r->remaining, 1) == 1) 
+    {
+        complete_request(pool, r);
+    }
+}
+
+/**
+ * Takes every request on the submission stack and pushes their tasks on
+ * the worker's deque, the newest request first, so that the owner pops the
+ * oldest request's tiles first while thieves start on the newest. Tasks
+ * that do not fit in the deque are run at once. Returns 0 if the stack
+ * was empty.
+ */
+static int take_submissions(gemm_pool_t* pool, pool_worker_t* self)
+{
+    gemm_request_t* list = atomic_exchange(&pool->submitted, NULL);
+    long tasks = 0, requests = 0;
+
+    if (list == NULL) 
+    {
+        return 0;
+    }
+
+    // Each request counted as one unit of work when submitted, now it is its tasks
+    for (gemm_request_t* r = list; r != NULL; r = r->next) 
+    {
+        tasks += atomic_load(&r->remaining);
+        requests++;
+    }
+    atomic_fetch_add(&pool->work, tasks - requests);
+
+    for (gemm_request_t* r = list; r != NULL; ) 
+    {
+        gemm_request_t* next = r->next; // r may complete, and be reused, once its tasks are out
+        int count = atomic_load(&r->remaining);
+        pool_task_t* r_tasks = r->tasks;
+
+        for (int t = count - 1; t >= 0; t--) 
+        {
+            if (deque_push(&self->deque, &r_tasks[t]) != 0) 
+            {
+                atomic_fetch_sub(&pool->work, 1);
+                run_task(pool, &r_tasks[t]);
+            }
+            else if (t % 8 == 0) 
+            {
+                wake_workers(pool);
+            }
+        }
+        r = next;
+    }
+    wake_workers(pool);
+    return 1;
+}
+
+/**
+ * Returns a task from another worker's deque, trying each once from a
+ * random one, or NULL.
+ */
+static pool_task_t* steal_task(gemm_pool_t* pool, pool_worker_t* self)
+{
+    int n = pool->num_workers;
+    int start = (int)(rand_r(&self->seed) % (unsigned int)n);
+
+    for (int v = 0; v < n; v++) 
+    {
+        int w = (start + v) % n;
+        if (w != self->index) 
+        {
+            pool_task_t* task = deque_steal(&pool->workers[w].deque);
+            if (task != NULL) 
+            {
+                return task;
+            }
+        }
+    }
+    return NULL;
+}
+
+/**
+ * Body of a worker: pop, steal or take submissions, and sleep when there
+ * is nothing to do.
+ */
+static void* worker_main(void* arg)
+{
+    pool_worker_t* self = (pool_worker_t*)arg;
+    gemm_pool_t* pool = self->pool;
+
+    // The creating thread may be pinned; a worker starts from the process's own CPUs
+    gebp_place_thread(pool->pin ? self->index : -1);
+
+    for (;;) 
+    {
+        pool_task_t* task = deque_pop(&self->deque);
+        if (task == NULL) 
+        {
+            task = steal_task(pool, self);
+        }
+        if (task != NULL) 
+        {
+            atomic_fetch_sub(&pool->work, 1);
+            run_task(pool, task);
+            continue;
+        }
+        if (take_submissions(pool, self)) 
+        {
+            continue;
+        }
+
+        // Work is counted before it can be found, so it may be in transit to a deque
+        if (atomic_load(&pool->work) > 0) 
+        {
+            sched_yield();
+            continue;
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        atomic_fetch_add(&pool->sleepers, 1);
+        while (atomic_load(&pool->work) <= 0 && !atomic_load(&pool->stop)) 
+        {
+            pthread_cond_wait(&pool->wake, &pool->lock);
+        }
+        atomic_fetch_sub(&pool->sleepers, 1);
+        int stop = atomic_load(&pool->stop) && atomic_load(&pool->work) <= 0;
+        pthread_mutex_unlock(&pool->lock);
+
+        if (stop) 
+        {
+            return NULL;
+        }
+    }
+}
+
+gemm_pool_t* gemm_pool_create(int num_workers, int pin, const blocking_t* blocking)
+{
+    if (num_workers <= 0) 
+    {
+        num_workers = (gebp_cpu_count() > 0) ? gebp_cpu_count() : (int)sysconf(_SC_NPROCESSORS_ONLN);
+        num_workers = (num_workers > 0) ? num_workers : 1;
+    }
+
+    gemm_pool_t* pool = (gemm_pool_t*)calloc(1, sizeof(gemm_pool_t));
+    pool_worker_t* workers = (pool_worker_t*)calloc((size_t)num_workers, sizeof(pool_worker_t));
+    if (pool == NULL || workers == NULL) 
+    {
+        free(pool);
+        free(workers);
+        return NULL;
+    }
+
+    pool->workers = workers;
+    pool->num_workers = num_workers;
+    pool->pin = pin;
+    pool->blocking = (blocking != NULL) ? *blocking : dgemm_get_blocking();
+    pool->task_m = (pool->blocking.m_c > pool->blocking.m_r) ? pool->blocking.m_c : pool->blocking.m_r;
+    pool->task_n = (POOL_TASK_COLS > pool->blocking.n_r) ? POOL_TASK_COLS / pool->blocking.n_r * pool->blocking.n_r : pool->blocking.n_r;
+    atomic_init(&pool->submitted, NULL);
+    atomic_init(&pool->work, 0);
+    atomic_init(&pool->in_flight, 0);
+    atomic_init(&pool->sleepers, 0);
+    atomic_init(&pool->stop, 0);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->wake, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    for (int w = 0; w < num_workers; w++) 
+    {
+        pool_worker_t* worker = &workers[w];
+        worker->pool = pool;
+        worker->index = w;
+        worker->seed = (unsigned int)w * 2654435761u + 1;
+        atomic_init(&worker->deque.top, 0);
+        atomic_init(&worker->deque.bottom, 0);
+
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) 
+        {
+            // Stop the workers started so far
+            pool->num_workers = w;
+            gemm_pool_destroy(pool);
+            return NULL;
+        }
+    }
+    return pool;
+}
+
+void gemm_pool_destroy(gemm_pool_t* pool)
+{
+    if (pool == NULL) 
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    while (atomic_load(&pool->in_flight) > 0) 
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    atomic_store(&pool->stop, 1);
+    pthread_cond_broadcast(&pool->wake);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int w = 0; w < pool->num_workers; w++) 
+    {
+        pthread_join(pool->workers[w].thread, NULL);
+    }
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->wake);
+    pthread_cond_destroy(&pool->done);
+    free(pool->workers);
+    free(pool);
+}
+
+int gemm_pool_workers(const gemm_pool_t* pool)
+{
+    return pool->num_workers;
+}
+
+int gemm_pool_submit(gemm_pool_t* pool, gemm_request_t* request)
+{
+    int rows = (request->M > 0) ? (request->M + pool->task_m - 1) / pool->task_m : 0;
+    int cols = (request->N > 0) ? (request->N + pool->task_n - 1) / pool->task_n : 0;
+    int count = rows * cols;
+
+    request->submitted = wall_time();
+    request->tasks = NULL;
+    atomic_store(&request->done, 0);
+
+    // An empty C completes at once, in the caller
+    if (count == 0) 
+    {
+        atomic_store(&request->remaining, 0);
+        atomic_fetch_add(&pool->in_flight, 1);
+        complete_request(pool, request);
+        return 0;
+    }
+
+    request->tasks = (pool_task_t*)malloc((size_t)count * sizeof(pool_task_t));
+    if (request->tasks == NULL) 
+    {
+        return -1;
+    }
+
+    // Column by column, so the tiles sharing a panel of B are stolen together
+    for (int c = 0; c < cols; c++) 
+    {
+        for (int r = 0; r < rows; r++) 
+        {
+            pool_task_t* task = &request->tasks[c * rows + r];
+            task->request = request;
+            task->i0 = r * pool->task_m;
+            task->j0 = c * pool->task_n;
+        }
+    }
+    atomic_store(&request->remaining, count);
+
+    // Counted before it is visible, so no worker goes to sleep with it on the stack
+    atomic_fetch_add(&pool->in_flight, 1);
+    atomic_fetch_add(&pool->work, 1);
+
+    gemm_request_t* head = atomic_load(&pool->submitted);
+    do
+    {
+        request->next = head;
+    } while (!atomic_compare_exchange_weak(&pool->submitted, &head, request));
+
+    wake_workers(pool);
+    return 0;
+}
+
+void gemm_pool_wait(gemm_pool_t* pool, gemm_request_t* request)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (!atomic_load(&request->done)) 
+    {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+}
+
+int gemm_pool_test(const gemm_request_t* request)
+{
+    return atomic_load(&request->done);
+}
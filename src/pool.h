@@ -0,0 +1,107 @@
+#ifndef POOL_H
+#define POOL_H
+#include <stdatomic.h>
+#include "tune.h"
+
+#define POOL_TASK_COLS 256 // Columns of C per task, rounded down to a multiple of n_r
+#define POOL_DEQUE_SIZE 4096 // Tasks each worker's deque holds, a power of two
+
+typedef struct gemm_pool gemm_pool_t;
+
+/**
+ * Called by a worker when a request completes, with the request's arg.
+ */
+typedef void (*gemm_callback_t)(void* arg);
+
+/**
+ * One task of a request: the tile of C at rows i0 and columns j0.
+ */
+typedef struct
+{
+    struct gemm_request* request; // Request the tile belongs to
+    int i0, j0; // Top left element of the tile
+} pool_task_t;
+
+/**
+ * A request for C = alpha * A * B + beta * C, column-major, and its future.
+ * The caller fills in the operands (and optionally callback and arg) and
+ * passes it to gemm_pool_submit; the fields below them belong to the pool
+ * until the request is done. The request, its operands and C must stay
+ * valid until then.
+ */
+typedef struct gemm_request
+{
+    int M, N, K; // Shape of the product
+    double alpha; // Scale applied to A * B
+    const double* A; // M x K
+    int lda; // Leading dimension of A
+    const double* B; // K x N
+    int ldb; // Leading dimension of B
+    double beta; // Scale applied to the existing C; C is not read when it is 0
+    double* C; // M x N
+    int ldc; // Leading dimension of C
+    gemm_callback_t callback; // Called by the worker that completes the request, or NULL
+    void* arg; // Argument of callback
+
+    // Set by the pool
+    struct gemm_request* next; // Next request in the submission stack
+    pool_task_t* tasks; // The tiles of C, freed when the request completes
+    atomic_int remaining; // Tasks not finished yet
+    atomic_int done; // 1 once C is complete and the callback has returned
+    double submitted; // Wall time of gemm_pool_submit, in seconds
+    double completed; // Wall time the last task finished, in seconds
+} gemm_request_t;
+
+/**
+ * ## GEMM worker pool
+ *
+ * This function starts a pool of persistent worker threads for services
+ * with many independent products in flight. Each request is split into
+ * tasks, tiles of C of m_c rows by POOL_TASK_COLS columns, each computed
+ * over all of K by a single threaded gebp call, so products of any size
+ * share the workers instead of each starting an OpenMP team. Requests
+ * are submitted to a lock-free stack; the first idle worker takes all of
+ * them, in order, and pushes their tasks on its own deque (Chase-Lev),
+ * from which it pops the newest while the other workers steal the
+ * oldest. Workers with nothing to pop or steal sleep until more work is
+ * submitted.
+ *
+ * @param num_workers Worker threads, 0 for one per CPU the process may use (see gebp_cpu_count)
+ * @param pin 1 to pin worker w to the w-th CPU the process may use, 0 to let every worker use all of them
+ * @param blocking Blocking for the tasks, or NULL for the one dgemm uses (see dgemm_get_blocking)
+ * @return The pool, or NULL if it could not be created.
+ */
+gemm_pool_t* gemm_pool_create(int num_workers, int pin, const blocking_t* blocking);
+
+/**
+ * This function waits for every request submitted to a pool to complete,
+ * then stops its workers and frees it.
+ */
+void gemm_pool_destroy(gemm_pool_t* pool);
+
+/**
+ * This function returns the number of workers of a pool.
+ */
+int gemm_pool_workers(const gemm_pool_t* pool);
+
+/**
+ * This function submits a request to a pool and returns at once. It may
+ * be called from any thread, including from a completion callback.
+ *
+ * @param pool Pool to run the request
+ * @param request Request with its operands filled in
+ * @return 0, or -1 if the tasks could not be allocated (the request is not submitted).
+ */
+int gemm_pool_submit(gemm_pool_t* pool, gemm_request_t* request);
+
+/**
+ * This function blocks until a submitted request is done.
+ */
+void gemm_pool_wait(gemm_pool_t* pool, gemm_request_t* request);
+
+/**
+ * This function returns 1 if a submitted request is done, 0 if not.
+ */
+int gemm_pool_test(const gemm_request_t* request);
+
+#endif
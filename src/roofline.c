@@ -0,0 +1,240 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Measures the roofline of the machine: peak FMA throughput
+ * with a register only kernel and sustained memory bandwidth
+ * with the STREAM triad, for one core and for all cores.
+ */
+
+#include <immintrin.h>
+#include <stdlib.h>
+#include <omp.h>
+#include "matrix_ops.h"
+#include "roofline.h"
+#include "tune.h"
+
+#define TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define TARGET_AVX512 __attribute__((target("avx512f")))
+
+#define PEAK_CHAINS 12 // Independent accumulators, enough to hide FMA latency on two ports
+#define PEAK_ITERS (1L << 24) // Iterations of the peak kernel per run
+#define STREAM_MIN_BYTES (32L << 20) // Smallest triad array
+#define STREAM_MAX_BYTES (256L << 20) // Largest triad array
+#define RUNS 5 // Timed runs, the best is kept
+
+/**
+ * Runs PEAK_CHAINS chains of x = x * a + b on SSE2 registers. Returns
+ * a sum of the chains so the compiler keeps the work.
+ */
+static double peak_scalar(long iters)
+{
+    double x[2 * PEAK_CHAINS];
+    double a = 0.999999, b = 1e-6;
+
+    for (int i = 0; i < 2 * PEAK_CHAINS; i++) 
+    {
+        x[i] = i;
+    }
+
+    for (long it = 0; it < iters; it++) 
+    {
+        #pragma GCC unroll 24
+        for (int i = 0; i < 2 * PEAK_CHAINS; i++) 
+        {
+            x[i] = x[i] * a + b;
+        }
+    }
+
+    double sum = 0.0;
+    for (int i = 0; i < 2 * PEAK_CHAINS; i++) 
+    {
+        sum += x[i];
+    }
+    return sum;
+}
+
+/**
+ * Runs PEAK_CHAINS chains of 256-bit fused multiply-adds.
+ */
+TARGET_AVX2 static double peak_avx2(long iters)
+{
+    __m256d x[PEAK_CHAINS];
+    __m256d a = _mm256_set1_pd(0.999999);
+    __m256d b = _mm256_set1_pd(1e-6);
+
+    for (int i = 0; i < PEAK_CHAINS; i++) 
+    {
+        x[i] = _mm256_set1_pd(i);
+    }
+
+    for (long it = 0; it < iters; it++) 
+    {
+        #pragma GCC unroll 12
+        for (int i = 0; i < PEAK_CHAINS; i++) 
+        {
+            x[i] = _mm256_fmadd_pd(x[i], a, b);
+        }
+    }
+
+    __m256d sum = _mm256_setzero_pd();
+    for (int i = 0; i < PEAK_CHAINS; i++) 
+    {
+        sum = _mm256_add_pd(sum, x[i]);
+    }
+
+    double lanes[4];
+    _mm256_storeu_pd(lanes, sum);
+    return lanes[0] + lanes[1] + lanes[2] + lanes[3];
+}
+
+/**
+ * Runs PEAK_CHAINS chains of 512-bit fused multiply-adds.
+ */
+TARGET_AVX512 static double peak_avx512(long iters)
+{
+    __m512d x[PEAK_CHAINS];
+    __m512d a = _mm512_set1_pd(0.999999);
+    __m512d b = _mm512_set1_pd(1e-6);
+
+    for (int i = 0; i < PEAK_CHAINS; i++) 
+    {
+        x[i] = _mm512_set1_pd(i);
+    }
+
+    for (long it = 0; it < iters; it++) 
+    {
+        #pragma GCC unroll 12
+        for (int i = 0; i < PEAK_CHAINS; i++) 
+        {
+            x[i] = _mm512_fmadd_pd(x[i], a, b);
+        }
+    }
+
+    __m512d sum = _mm512_setzero_pd();
+    for (int i = 0; i < PEAK_CHAINS; i++) 
+    {
+        sum = _mm512_add_pd(sum, x[i]);
+    }
+    return _mm512_reduce_add_pd(sum);
+}
+
+double measure_peak_gflops(int num_threads)
+{
+    int isa = detect_isa();
+    double (*kernel)(long) = (isa == ISA_AVX512) ? peak_avx512 : (isa == ISA_AVX2) ? peak_avx2 : peak_scalar;
+    int width = (isa == ISA_AVX512) ? 8 : (isa == ISA_AVX2) ? 4 : 2; // doubles per chain
+    double flops_per_thread = 2.0 * PEAK_ITERS * PEAK_CHAINS * width;
+    double best = 0.0;
+    volatile double sink = 0.0;
+
+    for (int run = 0; run < RUNS; run++) 
+    {
+        double t0 = 0.0, t1 = 0.0;
+
+        #pragma omp parallel num_threads(num_threads)
+        {
+            #pragma omp barrier
+            #pragma omp master
+            t0 = wall_time();
+
+            double s = kernel(PEAK_ITERS);
+
+            #pragma omp barrier
+            #pragma omp master
+            {
+                t1 = wall_time();
+                sink += s;
+            }
+        }
+
+        double gflops = flops_per_thread * num_threads / (t1 - t0) / 1e9;
+        if (gflops > best) 
+        {
+            best = gflops;
+        }
+    }
+    (void)sink;
+    return best;
+}
+
+double measure_bandwidth(int num_threads)
+{
+    cache_info_t info;
+    read_cache_info(&info);
+
+    long bytes = 4L * info.l3.size;
+    if (bytes < STREAM_MIN_BYTES) { bytes = STREAM_MIN_BYTES; }
+    if (bytes > STREAM_MAX_BYTES) { bytes = STREAM_MAX_BYTES; }
+    long n = bytes / sizeof(double);
+
+    double* a = (double*)alloc_packed(n, sizeof(double));
+    double* b = (double*)alloc_packed(n, sizeof(double));
+    double* c = (double*)alloc_packed(n, sizeof(double));
+    if (a == NULL || b == NULL || c == NULL) 
+    {
+        free(a);
+        free(b);
+        free(c);
+        return 0.0;
+    }
+
+    // First touch from the threads that run the triad, so pages land on their nodes
+    #pragma omp parallel for schedule(static) num_threads(num_threads)
+    for (long i = 0; i < n; i++) 
+    {
+        a[i] = 0.0;
+        b[i] = 1.0;
+        c[i] = 2.0;
+    }
+
+    double best = 0.0;
+    double s = 3.0;
+
+    for (int run = 0; run < RUNS; run++) 
+    {
+        double t0 = wall_time();
+
+        #pragma omp parallel for schedule(static) num_threads(num_threads)
+        for (long i = 0; i < n; i++) 
+        {
+            a[i] = b[i] + s * c[i];
+        }
+
+        double gbs = 3.0 * n * sizeof(double) / (wall_time() - t0) / 1e9;
+        if (gbs > best) 
+        {
+            best = gbs;
+        }
+    }
+
+    free(a);
+    free(b);
+    free(c);
+    return best;
+}
+
+roofline_t measure_roofline(int num_threads)
+{
+    roofline_t roof;
+
+    roof.threads = num_threads;
+    roof.isa = detect_isa();
+    roof.peak_core = measure_peak_gflops(1);
+    roof.peak_all = (num_threads > 1) ? measure_peak_gflops(num_threads) : roof.peak_core;
+    roof.bandwidth_core = measure_bandwidth(1);
+    roof.bandwidth_all = (num_threads > 1) ? measure_bandwidth(num_threads) : roof.bandwidth_core;
+    return roof;
+}
+
+double gemm_traffic_bytes(int M, int N, int K, int k_c, int n_c, int element_size)
+{
+    double panels = (N + n_c - 1) / n_c; // times A is streamed
+    double slices = (K + k_c - 1) / k_c; // times C is read and written
+
+    return (double)element_size * ((double)M * K * panels + (double)K * N + 2.0 * M * N * slices);
+}
+
+double roofline_bound(double peak, double bandwidth, double intensity)
+{
+    double memory_bound = intensity * bandwidth;
+    return (memory_bound < peak) ? memory_bound : peak;
+}
@@ -0,0 +1,75 @@
+#ifndef ROOFLINE_H
+#define ROOFLINE_H
+
+/**
+ * Measured compute and memory ceilings of the machine.
+ */
+typedef struct
+{
+    double peak_core; // FMA GFLOPS of one core
+    double peak_all; // FMA GFLOPS of all cores together
+    double bandwidth_core; // STREAM triad GB/s of one core
+    double bandwidth_all; // STREAM triad GB/s of all cores together
+    int threads; // Threads used for the all core numbers
+    int isa; // ISA_* the peak was measured with
+} roofline_t;
+
+/**
+ * This function measures peak floating point throughput with a kernel that
+ * runs independent chains of fused multiply-adds in registers, so it never
+ * touches memory and hides the FMA latency. The widest vector unit of the
+ * selected microkernel is used (scalar SSE2 code without FMA on CPUs with
+ * no AVX2). The best of several timed runs is kept.
+ *
+ * @param num_threads Threads running the kernel at once
+ * @return Achieved GFLOPS summed over all threads.
+ */
+double measure_peak_gflops(int num_threads);
+
+/**
+ * This function measures sustained memory bandwidth with the STREAM triad
+ * a[i] = b[i] + s * c[i] over arrays four times the size of the last
+ * level cache (at least 32 MB and at most 256 MB each). Bytes are counted
+ * as STREAM does (three arrays, no write allocate traffic). The best of
+ * several timed runs is kept.
+ *
+ * @param num_threads Threads sharing the triad
+ * @return Bandwidth in GB/s.
+ */
+double measure_bandwidth(int num_threads);
+
+/**
+ * This function measures the peak and bandwidth with one thread and with
+ * num_threads threads.
+ *
+ * @param num_threads Threads for the all core numbers
+ * @return The measured roofline.
+ */
+roofline_t measure_roofline(int num_threads);
+
+/**
+ * Estimates the DRAM traffic of gebp in bytes. With the panel of B held in
+ * L3 and the block of A in L2, A is streamed once per n_c panel, B is read
+ * once, and C is read and written once per k_c slice.
+ *
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A and rows of B
+ * @param k_c Columns of A and rows of B per packed block
+ * @param n_c Columns of B per packed panel
+ * @param element_size Bytes per matrix element
+ * @return Estimated bytes moved between memory and the caches.
+ */
+double gemm_traffic_bytes(int M, int N, int K, int k_c, int n_c, int element_size);
+
+/**
+ * Returns the attainable GFLOPS at an arithmetic intensity,
+ * min(peak, intensity * bandwidth).
+ *
+ * @param peak Compute ceiling in GFLOPS
+ * @param bandwidth Memory ceiling in GB/s
+ * @param intensity Flops per byte of DRAM traffic
+ */
+double roofline_bound(double peak, double bandwidth, double intensity);
+
+#endif
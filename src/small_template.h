@@ -0,0 +1,111 @@
+/**
+ * Unpacked kernels of dgemm_batch for one instruction set. batch.c
+ * includes this file once per instruction set, with:
+ *   TARGET  the target attribute of the kernels (empty for scalar)
+ *   ISA     a macro adding the instruction set to a function name
+ *   VEC     the widest vector of doubles the instruction set has
+ * Each kernel inlines ISA(small_gemm) with constant sizes, so the
+ * compiler unrolls it for that shape and instruction set.
+ * There is deliberately no include guard.
+ */
+
+/**
+ * Tile of v vectors (1 or 2) of rows by n columns, n at most SMALL_COLS,
+ * kept in registers over all of K and then merged into C.
+ */
+TARGET static inline __attribute__((always_inline)) void ISA(small_tile)(int v, int n, int K, double alpha, const double* A, int lda,
+                                                                         const double* B, int ldb, double beta, double* C, int ldc)
+{
+    const int lanes = sizeof(VEC) / sizeof(double);
+    VEC ab[SMALL_COLS][2] = {{{0}}};
+
+    for (int k = 0; k < K; k++) 
+    {
+        for (int r = 0; r < v; r++) 
+        {
+            VEC a = *(const VEC*)&A[(size_t)k * lda + r * lanes];
+            for (int jj = 0; jj < n; jj++) 
+            {
+                ab[jj][r] += a * B[(size_t)jj * ldb + k];
+            }
+        }
+    }
+
+    for (int jj = 0; jj < n; jj++) 
+    {
+        for (int r = 0; r < v; r++) 
+        {
+            VEC* c = (VEC*)&C[(size_t)jj * ldc + r * lanes];
+            *c = (beta == 0.0) ? alpha * ab[jj][r] : alpha * ab[jj][r] + beta * *c;
+        }
+    }
+}
+
+/**
+ * Walks C in tiles of two vectors (then one vector, then single rows)
+ * by SMALL_COLS columns.
+ */
+TARGET static inline __attribute__((always_inline)) void ISA(small_gemm)(int M, int N, int K, double alpha, const double* A, int lda,
+                                                                         const double* B, int ldb, double beta, double* C, int ldc)
+{
+    const int lanes = sizeof(VEC) / sizeof(double);
+
+    for (int j = 0; j < N; j += SMALL_COLS) 
+    {
+        int n = (N - j < SMALL_COLS) ? N - j : SMALL_COLS;
+        const double* b = &B[(size_t)j * ldb];
+        double* c = &C[(size_t)j * ldc];
+        int i = 0;
+
+        for (; i + 2 * lanes <= M; i += 2 * lanes) 
+        {
+            if (n == SMALL_COLS) 
+            {
+                ISA(small_tile)(2, SMALL_COLS, K, alpha, &A[i], lda, b, ldb, beta, &c[i], ldc);
+            }
+            else 
+            {
+                ISA(small_tile)(2, n, K, alpha, &A[i], lda, b, ldb, beta, &c[i], ldc);
+            }
+        }
+        if (i + lanes <= M) 
+        {
+            ISA(small_tile)(1, n, K, alpha, &A[i], lda, b, ldb, beta, &c[i], ldc);
+            i += lanes;
+        }
+        if (i < M) 
+        {
+            small_tile(M - i, n, K, alpha, &A[i], lda, b, ldb, beta, &c[i], ldc);
+        }
+    }
+}
+
+TARGET static void ISA(small_4)(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc)
+{
+    ISA(small_gemm)(4, 4, 4, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+TARGET static void ISA(small_8)(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc)
+{
+    ISA(small_gemm)(8, 8, 8, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+TARGET static void ISA(small_16)(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc)
+{
+    ISA(small_gemm)(16, 16, 16, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+TARGET static void ISA(small_32)(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc)
+{
+    ISA(small_gemm)(32, 32, 32, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+TARGET static void ISA(small_64)(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc)
+{
+    ISA(small_gemm)(64, 64, 64, alpha, A, lda, B, ldb, beta, C, ldc);
+}
+
+TARGET static void ISA(small_any)(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc)
+{
+    ISA(small_gemm)(M, N, K, alpha, A, lda, B, ldb, beta, C, ldc);
+}
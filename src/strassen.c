@@ -0,0 +1,129 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Strassen-Winograd recursion on top of gebp. The quadrant
+ * products recurse down to a crossover size and then call the
+ * blocked GEBP kernel. Everything is column major.
+ */
+
+#include <stddef.h>
+#include "gemm.h"
+#include "strassen.h"
+
+/**
+ * Returns 1 if an M x N x K product is split into quadrants.
+ */
+static int splits(int M, int N, int K, int crossover)
+{
+    return M > crossover && N > crossover && K > crossover && M >= 2 && N >= 2 && K >= 2;
+}
+
+size_t strassen_workspace(int M, int N, int K, int crossover)
+{
+    if (!splits(M, N, K, crossover)) 
+    {
+        return 0;
+    }
+
+    size_t m2 = M / 2, n2 = N / 2, k2 = K / 2;
+    size_t x = m2 * ((k2 > n2) ? k2 : n2); // S1..S4 (m2 x k2) and P1 (m2 x n2)
+    size_t y = k2 * n2; // T1..T4
+
+    return x + y + strassen_workspace(m2, n2, k2, crossover);
+}
+
+int strassen_depth(int M, int N, int K, int crossover)
+{
+    return splits(M, N, K, crossover) ? 1 + strassen_depth(M / 2, N / 2, K / 2, crossover) : 0;
+}
+
+/**
+ * Z = X + s * Y for m x n column-major matrices. Z may be X or Y.
+ */
+static void add(int m, int n, const double* X, int ldx, double s, const double* Y, int ldy, double* Z, int ldz, int num_threads)
+{
+    #pragma omp parallel for schedule(static) num_threads(num_threads) if(num_threads > 1)
+    for (int j = 0; j < n; j++) 
+    {
+        const double* x = &X[(size_t)j * ldx];
+        const double* y = &Y[(size_t)j * ldy];
+        double* z = &Z[(size_t)j * ldz];
+
+        for (int i = 0; i < m; i++) 
+        {
+            z[i] = x[i] + s * y[i];
+        }
+    }
+}
+
+void strassen(int M, int N, int K, const double* A, int lda, const double* B, int ldb, double* C, int ldc,
+              int crossover, const blocking_t* blocking, int num_threads, double* work)
+{
+    const blocking_t* b = blocking;
+
+    if (!splits(M, N, K, crossover)) 
+    {
+        gebp(M, N, K, 1.0, A, lda, B, ldb, 0.0, C, ldc, NULL, b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, num_threads, NULL);
+        return;
+    }
+
+    int m2 = M / 2, n2 = N / 2, k2 = K / 2;
+
+    const double* A11 = A;
+    const double* A21 = A + m2;
+    const double* A12 = A + (size_t)k2 * lda;
+    const double* A22 = A + m2 + (size_t)k2 * lda;
+    const double* B11 = B;
+    const double* B21 = B + k2;
+    const double* B12 = B + (size_t)n2 * ldb;
+    const double* B22 = B + k2 + (size_t)n2 * ldb;
+    double* C11 = C;
+    double* C21 = C + m2;
+    double* C12 = C + (size_t)n2 * ldc;
+    double* C22 = C + m2 + (size_t)n2 * ldc;
+
+    double* X = work; // m2 x max(k2, n2), leading dimension m2
+    double* Y = X + (size_t)m2 * ((k2 > n2) ? k2 : n2); // k2 x n2, leading dimension k2
+    double* rest = Y + (size_t)k2 * n2; // workspace of the recursive calls
+
+    // Winograd's 7 products with two temporaries, C holding the rest
+    add(m2, k2, A11, lda, -1.0, A21, lda, X, m2, num_threads); // S3 = A11 - A21
+    add(k2, n2, B22, ldb, -1.0, B12, ldb, Y, k2, num_threads); // T3 = B22 - B12
+    strassen(m2, n2, k2, X, m2, Y, k2, C21, ldc, crossover, b, num_threads, rest); // P7 = S3 T3
+    add(m2, k2, A21, lda, 1.0, A22, lda, X, m2, num_threads); // S1 = A21 + A22
+    add(k2, n2, B12, ldb, -1.0, B11, ldb, Y, k2, num_threads); // T1 = B12 - B11
+    strassen(m2, n2, k2, X, m2, Y, k2, C22, ldc, crossover, b, num_threads, rest); // P5 = S1 T1
+    add(k2, n2, B22, ldb, -1.0, Y, k2, Y, k2, num_threads); // T2 = B22 - T1
+    add(m2, k2, X, m2, -1.0, A11, lda, X, m2, num_threads); // S2 = S1 - A11
+    strassen(m2, n2, k2, X, m2, Y, k2, C12, ldc, crossover, b, num_threads, rest); // P6 = S2 T2
+    add(m2, k2, A12, lda, -1.0, X, m2, X, m2, num_threads); // S4 = A12 - S2
+    strassen(m2, n2, k2, X, m2, B22, ldb, C11, ldc, crossover, b, num_threads, rest); // P3 = S4 B22
+    strassen(m2, n2, k2, A11, lda, B11, ldb, X, m2, crossover, b, num_threads, rest); // P1 = A11 B11
+    add(m2, n2, X, m2, 1.0, C12, ldc, C12, ldc, num_threads); // U2 = P1 + P6
+    add(m2, n2, C12, ldc, 1.0, C21, ldc, C21, ldc, num_threads); // U3 = U2 + P7
+    add(m2, n2, C12, ldc, 1.0, C22, ldc, C12, ldc, num_threads); // U4 = U2 + P5
+    add(m2, n2, C21, ldc, 1.0, C22, ldc, C22, ldc, num_threads); // C22 = U7 = U3 + P5
+    add(m2, n2, C12, ldc, 1.0, C11, ldc, C12, ldc, num_threads); // C12 = U5 = U4 + P3
+    add(k2, n2, Y, k2, -1.0, B21, ldb, Y, k2, num_threads); // T4 = T2 - B21
+    strassen(m2, n2, k2, A22, lda, Y, k2, C11, ldc, crossover, b, num_threads, rest); // P4 = A22 T4
+    add(m2, n2, C21, ldc, -1.0, C11, ldc, C21, ldc, num_threads); // C21 = U6 = U3 - P4
+    strassen(m2, n2, k2, A12, lda, B21, ldb, C11, ldc, crossover, b, num_threads, rest); // P2 = A12 B21
+    add(m2, n2, X, m2, 1.0, C11, ldc, C11, ldc, num_threads); // C11 = U1 = P1 + P2
+
+    // Peel odd dimensions: the even part above left out the last k slice, column and row
+    int me = 2 * m2, ne = 2 * n2, ke = 2 * k2;
+    if (K > ke) 
+    {
+        gebp(me, ne, 1, 1.0, A + (size_t)ke * lda, lda, B + ke, ldb, 1.0, C, ldc, NULL,
+             b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, num_threads, NULL);
+    }
+    if (N > ne) 
+    {
+        gebp(M, N - ne, K, 1.0, A, lda, B + (size_t)ne * ldb, ldb, 0.0, C + (size_t)ne * ldc, ldc, NULL,
+             b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, num_threads, NULL);
+    }
+    if (M > me) 
+    {
+        gebp(M - me, ne, K, 1.0, A + me, lda, B, ldb, 0.0, C + me, ldc, NULL,
+             b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, num_threads, NULL);
+    }
+}
@@ -0,0 +1,55 @@
+#ifndef STRASSEN_H
+#define STRASSEN_H
+#include <stddef.h>
+#include "tune.h"
+
+/**
+ * Returns the number of doubles of workspace strassen needs for an
+ * M x N x K product with a crossover.
+ *
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A and rows of B
+ * @param crossover Size at or below which gebp is called
+ */
+size_t strassen_workspace(int M, int N, int K, int crossover);
+
+/**
+ * Returns how many levels of recursion strassen makes for an
+ * M x N x K product with a crossover.
+ */
+int strassen_depth(int M, int N, int K, int crossover);
+
+/**
+ * ## Strassen-Winograd
+ *
+ * Computes C = A * B (column-major, as gebp) with the Winograd variant of
+ * Strassen's algorithm: 7 half size products and 15 additions per level
+ * instead of 8 products. The quadrant products recurse until M, N or K is
+ * at or below the crossover and then run gebp. Odd dimensions are peeled:
+ * the even part recurses and the last row, column and k slice are fixed up
+ * with gebp. Each level keeps its operand sums and one product in a slice of
+ * the caller's workspace and the others in the quadrants of C (the schedule
+ * of Boyer, Dumas, Pernet and Zhou), so nothing is allocated while it runs.
+ *
+ * The error bound grows by roughly a constant factor per level, so the
+ * crossover trades speed against accuracy.
+ *
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A and rows of B
+ * @param A Matrix A
+ * @param lda Leading dimension of A
+ * @param B Matrix B
+ * @param ldb Leading dimension of B
+ * @param C Matrix C, overwritten; must not overlap A or B
+ * @param ldc Leading dimension of C
+ * @param crossover Size at or below which gebp is called
+ * @param blocking Blocking for gebp
+ * @param num_threads Threads for gebp and the additions
+ * @param work At least strassen_workspace(M, N, K, crossover) doubles
+ */
+void strassen(int M, int N, int K, const double* A, int lda, const double* B, int ldb, double* C, int ldc,
+              int crossover, const blocking_t* blocking, int num_threads, double* work);
+
+#endif
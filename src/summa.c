@@ -0,0 +1,193 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * SUMMA on a 2D grid of MPI processes. Panels of A and B are
+ * broadcast along the grid rows and columns and multiplied into
+ * each process's block of C with gebp. Everything is column major.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "gemm.h"
+#include "summa.h"
+
+void summa_grid_create(MPI_Comm comm, summa_grid_t* grid)
+{
+    int size, rank;
+    int dims[2] = {0, 0};
+
+    MPI_Comm_size(comm, &size);
+    MPI_Comm_rank(comm, &rank);
+    MPI_Dims_create(size, 2, dims); // dims[0] >= dims[1]
+
+    grid->comm = comm;
+    grid->rows = dims[1];
+    grid->cols = dims[0];
+    grid->my_row = rank / grid->cols;
+    grid->my_col = rank % grid->cols;
+    MPI_Comm_split(comm, grid->my_row, grid->my_col, &grid->row_comm);
+    MPI_Comm_split(comm, grid->my_col, grid->my_row, &grid->col_comm);
+}
+
+void summa_grid_free(summa_grid_t* grid)
+{
+    MPI_Comm_free(&grid->row_comm);
+    MPI_Comm_free(&grid->col_comm);
+}
+
+int summa_block(int n, int parts, int index, int* start)
+{
+    int base = n / parts, rem = n % parts;
+
+    *start = index * base + ((index < rem) ? index : rem);
+    return base + ((index < rem) ? 1 : 0);
+}
+
+/**
+ * Returns the block of summa_block(n, parts, ...) that holds row k.
+ */
+static int block_owner(int n, int parts, int k)
+{
+    int start;
+
+    for (int index = parts - 1; index > 0; index--) 
+    {
+        summa_block(n, parts, index, &start);
+        if (k >= start) 
+        {
+            return index;
+        }
+    }
+    return 0;
+}
+
+/** One k panel: its first row of B, width and owners. */
+typedef struct
+{
+    int k0; // First column of A and row of B in the panel
+    int w; // Panel width
+    int col_a; // Grid column owning the panel of A
+    int row_b; // Grid row owning the panel of B
+} panel_t;
+
+/**
+ * Returns the panel starting at k0: at most panel_width wide and never
+ * crossing the edge of a block of A or of B, so each side has one owner.
+ */
+static panel_t next_panel(int K, int k0, int panel_width, const summa_grid_t* grid)
+{
+    panel_t p;
+    int start_a, start_b;
+
+    p.k0 = k0;
+    p.col_a = block_owner(K, grid->cols, k0);
+    p.row_b = block_owner(K, grid->rows, k0);
+    int end_a = summa_block(K, grid->cols, p.col_a, &start_a) + start_a;
+    int end_b = summa_block(K, grid->rows, p.row_b, &start_b) + start_b;
+
+    p.w = panel_width;
+    p.w = (end_a - k0 < p.w) ? end_a - k0 : p.w;
+    p.w = (end_b - k0 < p.w) ? end_b - k0 : p.w;
+    return p;
+}
+
+/**
+ * Starts the broadcasts of panel p: the owners copy their part of A
+ * (m_loc x w) and B (w x n_loc) into the panel buffers first.
+ */
+static void post_panel(const panel_t* p, int K, int m_loc, int n_loc, const double* A, int lda, const double* B, int ldb,
+                       double* A_panel, double* B_panel, const summa_grid_t* grid, MPI_Request req[2])
+{
+    int start;
+
+    if (grid->my_col == p->col_a) 
+    {
+        summa_block(K, grid->cols, grid->my_col, &start);
+        for (int k = 0; k < p->w; k++) 
+        {
+            memcpy(&A_panel[(size_t)k * m_loc], &A[(size_t)(p->k0 - start + k) * lda], (size_t)m_loc * sizeof(double));
+        }
+    }
+    if (grid->my_row == p->row_b) 
+    {
+        summa_block(K, grid->rows, grid->my_row, &start);
+        for (int j = 0; j < n_loc; j++) 
+        {
+            memcpy(&B_panel[(size_t)j * p->w], &B[(size_t)j * ldb + (p->k0 - start)], (size_t)p->w * sizeof(double));
+        }
+    }
+
+    MPI_Ibcast(A_panel, m_loc * p->w, MPI_DOUBLE, p->col_a, grid->row_comm, &req[0]);
+    MPI_Ibcast(B_panel, p->w * n_loc, MPI_DOUBLE, p->row_b, grid->col_comm, &req[1]);
+}
+
+int summa(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc,
+          int panel_width, const summa_grid_t* grid, const blocking_t* blocking, int num_threads)
+{
+    const blocking_t* b = blocking;
+    int start;
+    int m_loc = summa_block(M, grid->rows, grid->my_row, &start);
+    int n_loc = summa_block(N, grid->cols, grid->my_col, &start);
+
+    if (K <= 0) 
+    {
+        gebp(m_loc, n_loc, 0, alpha, A, lda, B, ldb, beta, C, ldc, NULL, b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, num_threads, NULL);
+        return 0;
+    }
+
+    // Two buffers per operand: one being multiplied, one being received
+    int kb = (panel_width < K) ? panel_width : K;
+    double* A_panel[2];
+    double* B_panel[2];
+    int ok = 1, all_ok;
+
+    for (int s = 0; s < 2; s++) 
+    {
+        A_panel[s] = (double*)malloc(((size_t)m_loc * kb + 1) * sizeof(double));
+        B_panel[s] = (double*)malloc(((size_t)kb * n_loc + 1) * sizeof(double));
+        ok = ok && A_panel[s] != NULL && B_panel[s] != NULL;
+    }
+
+    // Every process must take part in the broadcasts, so all give up together
+    MPI_Allreduce(&ok, &all_ok, 1, MPI_INT, MPI_MIN, grid->comm);
+    if (!all_ok) 
+    {
+        for (int s = 0; s < 2; s++) 
+        {
+            free(A_panel[s]);
+            free(B_panel[s]);
+        }
+        return -1;
+    }
+
+    MPI_Request req[2][2];
+    panel_t cur = next_panel(K, 0, kb, grid);
+    post_panel(&cur, K, m_loc, n_loc, A, lda, B, ldb, A_panel[0], B_panel[0], grid, req[0]);
+
+    for (int step = 0; cur.w > 0; step++) 
+    {
+        int s = step % 2;
+        panel_t next = {K, 0, 0, 0};
+
+        // Start receiving the next panel before multiplying this one
+        if (cur.k0 + cur.w < K) 
+        {
+            next = next_panel(K, cur.k0 + cur.w, kb, grid);
+            post_panel(&next, K, m_loc, n_loc, A, lda, B, ldb, A_panel[1 - s], B_panel[1 - s], grid, req[1 - s]);
+        }
+
+        MPI_Waitall(2, req[s], MPI_STATUSES_IGNORE);
+        if (m_loc > 0 && n_loc > 0) 
+        {
+            gebp(m_loc, n_loc, cur.w, alpha, A_panel[s], m_loc, B_panel[s], cur.w, (step == 0) ? beta : 1.0, C, ldc, NULL,
+                 b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, num_threads, NULL);
+        }
+        cur = next;
+    }
+
+    for (int s = 0; s < 2; s++) 
+    {
+        free(A_panel[s]);
+        free(B_panel[s]);
+    }
+    return 0;
+}
@@ -0,0 +1,92 @@
+#ifndef SUMMA_H
+#define SUMMA_H
+#include <mpi.h>
+#include "tune.h"
+
+#define SUMMA_PANEL 256 // Default width of the k panels broadcast per step
+
+/**
+ * A two-dimensional grid of MPI processes. Rank (row, col) of the grid owns
+ * the block of rows row and columns col of every matrix, with the rows and
+ * columns split as evenly as summa_block splits them.
+ */
+typedef struct
+{
+    MPI_Comm comm; // All processes of the grid, ordered row by row
+    MPI_Comm row_comm; // Processes in my grid row, ranked by column
+    MPI_Comm col_comm; // Processes in my grid column, ranked by row
+    int rows; // Process rows
+    int cols; // Process columns
+    int my_row; // My row in the grid
+    int my_col; // My column in the grid
+} summa_grid_t;
+
+/**
+ * This function arranges the processes of comm in a grid as close to square
+ * as MPI_Dims_create finds, with no more rows than columns. It is collective
+ * over comm.
+ *
+ * @param comm Processes to arrange
+ * @param grid Receives the grid and its communicators
+ */
+void summa_grid_create(MPI_Comm comm, summa_grid_t* grid);
+
+/**
+ * This function frees the communicators of a grid. It is collective over
+ * the grid.
+ *
+ * @param grid Grid from summa_grid_create
+ */
+void summa_grid_free(summa_grid_t* grid);
+
+/**
+ * This function returns the part of n rows (or columns) that block index of
+ * parts owns: [start, start + count), with the first n mod parts blocks one
+ * longer than the others.
+ *
+ * @param n Rows or columns to split
+ * @param parts Number of blocks
+ * @param index Block to return
+ * @param start Receives the first row of the block
+ * @return Rows in the block.
+ */
+int summa_block(int n, int parts, int index, int* start);
+
+/**
+ * ## SUMMA
+ *
+ * Computes C = alpha * A * B + beta * C for matrices distributed over a process
+ * grid, with the Scalable Universal Matrix Multiplication Algorithm of van de
+ * Geijn and Watts. Process (r, c) holds the blocks A(r, c) with the rows of
+ * block r and the k of block c of the grid columns, B(r, c) with the k of
+ * block r of the grid rows and the columns of block c, and C(r, c), all
+ * column-major and split with summa_block. Stepping through K in panels of at
+ * most panel_width, the owners broadcast their panel of A along their grid row
+ * and their panel of B along their grid column, and every process adds the
+ * product of the two panels to its block of C with gebp. The broadcasts of the
+ * next panels are started with MPI_Ibcast before the local product of the
+ * current ones, so the transfer can proceed while gebp runs (how much it does
+ * without further MPI calls depends on the MPI library). The call is
+ * collective over the grid.
+ *
+ * @param M Rows of A and C
+ * @param N Columns of B and C
+ * @param K Columns of A and rows of B
+ * @param alpha Scale applied to A * B
+ * @param A My block of A
+ * @param lda Leading dimension of my block of A
+ * @param B My block of B
+ * @param ldb Leading dimension of my block of B
+ * @param beta Scale applied to the existing C
+ * @param C My block of C
+ * @param ldc Leading dimension of my block of C
+ * @param panel_width Widest k panel broadcast at once, e.g. SUMMA_PANEL
+ * @param grid Process grid
+ * @param blocking Blocking for gebp
+ * @param num_threads Threads for gebp on every process
+ * @return 0, or -1 if the panel buffers could not be allocated.
+ */
+int summa(int M, int N, int K, double alpha, const double* A, int lda, const double* B, int ldb, double beta, double* C, int ldc,
+          int panel_width, const summa_grid_t* grid, const blocking_t* blocking, int num_threads);
+
+#endif
@@ -0,0 +1,470 @@
+/**
+ * Author: Aman Hogan-Bailey
+ * Picks the gebp blocking for the machine: reads the cache
+ * geometry from sysfs, derives an analytical blocking from it,
+ * refines it with a short timed search, and keeps the winner in
+ * a wisdom file so later runs can skip the search.
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "gemm.h"
+#include "tune.h"
+
+#define SYSFS_CACHE "/sys/devices/system/cpu/cpu0/cache"
+#define WISDOM_LINE 512 // Longest wisdom file line
+
+static const int prefetch_candidates[] = {0, 2, 4, 8, 16}; // Distances swept by autotune_blocking
+#define PREFETCH_CANDIDATE_COUNT (int)(sizeof(prefetch_candidates) / sizeof(prefetch_candidates[0]))
+
+/**
+ * Reads one integer from a sysfs file. A K or M suffix scales it
+ * to bytes. Returns -1 if the file cannot be read.
+ */
+static long read_sysfs_value(const char* dir, const char* name)
+{
+    char path[256];
+    char text[64];
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) 
+    {
+        return -1;
+    }
+    if (fgets(text, sizeof(text), fp) == NULL) 
+    {
+        fclose(fp);
+        return -1;
+    }
+    fclose(fp);
+
+    char* end;
+    long value = strtol(text, &end, 10);
+    if (*end == 'K') { value *= 1024; }
+    if (*end == 'M') { value *= 1024 * 1024; }
+    return value;
+}
+
+/**
+ * Reads the type string ("Data", "Instruction" or "Unified") of a
+ * sysfs cache index into type.
+ */
+static int read_sysfs_type(const char* dir, char* type, int size)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/type", dir);
+
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL || fgets(type, size, fp) == NULL) 
+    {
+        if (fp != NULL) { fclose(fp); }
+        return 1;
+    }
+    fclose(fp);
+    type[strcspn(type, "\n")] = '\0';
+    return 0;
+}
+
+int read_cache_info(cache_info_t* info)
+{
+    cache_level_t defaults[3] = {
+        {32 * 1024, 8, 64, 64},
+        {256 * 1024, 4, 64, 1024},
+        {8 * 1024 * 1024, 16, 64, 8192},
+    };
+    cache_level_t* levels[3] = {&info->l1, &info->l2, &info->l3};
+    int found[3] = {0, 0, 0};
+
+    for (int index = 0; index < 16; index++) 
+    {
+        char dir[128];
+        char type[32];
+        snprintf(dir, sizeof(dir), "%s/index%d", SYSFS_CACHE, index);
+
+        long level = read_sysfs_value(dir, "level");
+        if (level < 0 || read_sysfs_type(dir, type, sizeof(type)) != 0) 
+        {
+            continue;
+        }
+        if (level < 1 || level > 3 || strcmp(type, "Instruction") == 0) 
+        {
+            continue;
+        }
+
+        cache_level_t c;
+        c.size = (int)read_sysfs_value(dir, "size");
+        c.ways = (int)read_sysfs_value(dir, "ways_of_associativity");
+        c.line = (int)read_sysfs_value(dir, "coherency_line_size");
+        c.sets = (int)read_sysfs_value(dir, "number_of_sets");
+        if (c.size <= 0 || c.ways <= 0 || c.line <= 0) 
+        {
+            continue;
+        }
+        if (c.sets <= 0) 
+        {
+            c.sets = c.size / (c.ways * c.line);
+        }
+
+        *levels[level - 1] = c;
+        found[level - 1] = 1;
+    }
+
+    int used_default = 0;
+    for (int i = 0; i < 3; i++) 
+    {
+        if (!found[i]) 
+        {
+            *levels[i] = defaults[i];
+            used_default = 1;
+        }
+    }
+    return used_default;
+}
+
+/**
+ * Rounds a blocking to legal values: k_c a multiple of 8, m_c a
+ * multiple of m_r and n_c a multiple of n_r no larger than NC_MAX.
+ */
+static void normalize_blocking(blocking_t* b)
+{
+    b->k_c = (b->k_c < 16) ? 16 : b->k_c / 8 * 8;
+    b->m_c = (b->m_c < b->m_r) ? b->m_r : b->m_c / b->m_r * b->m_r;
+    b->n_c = (b->n_c > NC_MAX) ? NC_MAX : b->n_c;
+    b->n_c = (b->n_c < b->n_r) ? b->n_r : b->n_c / b->n_r * b->n_r;
+}
+
+blocking_t analytical_blocking(const cache_info_t* info, const microkernel_t* kernel, int element_size)
+{
+    const cache_level_t* l1 = &info->l1;
+    const cache_level_t* l2 = &info->l2;
+    const cache_level_t* l3 = &info->l3;
+    int m_r = kernel->m_r, n_r = kernel->n_r;
+    blocking_t b = {0, 0, 0, n_r, m_r, PREFETCH_DEFAULT};
+
+    // L1: ways for the streamed micro-panels of A, one way spare for C
+    int ways_a1 = (int)floor((l1->ways - 1) / (1.0 + (double)n_r / m_r));
+    if (ways_a1 < 1) { ways_a1 = 1; }
+    b.k_c = ways_a1 * l1->sets * l1->line / (m_r * element_size);
+
+    // L2: the block of A gets the ways left after the micro-panel of B and C
+    int ways_b2 = (int)ceil((double)n_r * b.k_c * element_size / ((double)l2->sets * l2->line));
+    int ways_a2 = l2->ways - 1 - ways_b2;
+    if (ways_a2 < 1) { ways_a2 = 1; }
+    b.m_c = (int)((double)ways_a2 * l2->sets * l2->line / ((double)b.k_c * element_size));
+
+    // L3: the panel of B gets the ways left after the block of A and C
+    int ways_a3 = (int)ceil((double)b.m_c * b.k_c * element_size / ((double)l3->sets * l3->line));
+    int ways_b3 = l3->ways - 1 - ways_a3;
+    if (ways_b3 < 1) { ways_b3 = 1; }
+    double n_c = (double)ways_b3 * l3->sets * l3->line / ((double)b.k_c * element_size);
+    b.n_c = (n_c > NC_MAX) ? NC_MAX : (int)n_c;
+
+    normalize_blocking(&b);
+    return b;
+}
+
+/**
+ * Times gebp for an element type with a blocking on N x N x N
+ * operands and returns the best of two runs in seconds. The packing time of that run
+ * goes to pack_time and, if counters is not NULL, its hardware
+ * counts to counters.
+ */
+static double time_blocking(int dtype, const blocking_t* b, int N, int num_threads, const void* A, const void* B, void* C,
+                            double* pack_time, gebp_counters_t* counters)
+{
+    double best = 0.0;
+    gebp_counters_t counts;
+
+    for (int run = 0; run < 2; run++) 
+    {
+        struct timespec start, end;
+        double pack = 0.0;
+        gebp_counters_clear(&counts);
+        gebp_set_counters(counters != NULL ? &counts : NULL);
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        gebp_typed(dtype, N, N, N, A, N, B, N, C, N, b->m_c, b->k_c, b->n_c, b->n_r, b->m_r, b->prefetch, num_threads, &pack);
+        gebp_set_counters(NULL);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+
+        double t = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        if (run == 0 || t < best) 
+        {
+            best = t;
+            *pack_time = pack;
+            if (counters != NULL) { *counters = counts; }
+        }
+    }
+    return best;
+}
+
+blocking_t autotune_blocking(const microkernel_t* kernel, int N, int num_threads, int max_trials,
+                             tune_report_fn report, void* ctx, double* best_gflops)
+{
+    cache_info_t info;
+    read_cache_info(&info);
+    int dtype = kernel->dtype;
+    size_t size = dtype_size(dtype);
+    blocking_t best = analytical_blocking(&info, kernel, (int)size);
+
+    void* A = malloc((size_t)N * N * size);
+    void* B = malloc((size_t)N * N * size);
+    void* C = malloc((size_t)N * N * size);
+    if (A == NULL || B == NULL || C == NULL) 
+    {
+        free(A);
+        free(B);
+        free(C);
+        if (best_gflops != NULL) { *best_gflops = 0.0; }
+        return best;
+    }
+
+    random_fill(dtype, A, (size_t)N * N);
+    random_fill(dtype, B, (size_t)N * N);
+
+    double flops = (double)dtype_flops(dtype) * N * N * N;
+    double pack = 0.0;
+    gebp_counters_t counters;
+    gebp_counters_t* use_counters = (report != NULL && perf_counters_requested()) ? &counters : NULL;
+    double best_time = time_blocking(dtype, &best, N, num_threads, A, B, C, &pack, use_counters);
+    int trials = 1;
+    if (report != NULL) { report(&best, best_time, pack, use_counters, flops / best_time / 1e9, ctx); }
+
+    // The prefetch distance hardly interacts with the cache blocking, so it is settled first
+    for (int p = 0; p < PREFETCH_CANDIDATE_COUNT && trials < max_trials; p++) 
+    {
+        blocking_t cand = best;
+        cand.prefetch = prefetch_candidates[p];
+        if (cand.prefetch == best.prefetch) 
+        {
+            continue;
+        }
+
+        double t = time_blocking(dtype, &cand, N, num_threads, A, B, C, &pack, use_counters);
+        trials++;
+        if (report != NULL) { report(&cand, t, pack, use_counters, flops / t / 1e9, ctx); }
+
+        if (t < best_time) 
+        {
+            best = cand;
+            best_time = t;
+        }
+    }
+
+    // Scale k_c, m_c and n_c in turn, first down then up, and keep
+    // stepping in a direction for as long as it pays off
+    double factors[3][2] = {{0.75, 1.25}, {0.75, 1.25}, {0.5, 2.0}};
+
+    for (int param = 0; param < 3; param++) 
+    {
+        for (int dir = 0; dir < 2; dir++) 
+        {
+            int moved = 0;
+
+            while (trials < max_trials) 
+            {
+                blocking_t cand = best;
+                int* value = (param == 0) ? &cand.k_c : (param == 1) ? &cand.m_c : &cand.n_c;
+                *value = (int)(*value * factors[param][dir]);
+                normalize_blocking(&cand);
+                if (memcmp(&cand, &best, sizeof(cand)) == 0) 
+                {
+                    break;
+                }
+
+                double t = time_blocking(dtype, &cand, N, num_threads, A, B, C, &pack, use_counters);
+                trials++;
+                if (report != NULL) { report(&cand, t, pack, use_counters, flops / t / 1e9, ctx); }
+
+                if (t >= best_time) 
+                {
+                    break;
+                }
+                best = cand;
+                best_time = t;
+                moved = 1;
+            }
+
+            // No need to try the other direction once one helped
+            if (moved) 
+            {
+                break;
+            }
+        }
+    }
+
+    free(A);
+    free(B);
+    free(C);
+
+    if (best_gflops != NULL) 
+    {
+        *best_gflops = flops / best_time / 1e9;
+    }
+    return best;
+}
+
+const char* cpu_model_name(void)
+{
+    static char model[256] = "";
+
+    if (model[0] != '\0') 
+    {
+        return model;
+    }
+
+    strcpy(model, "unknown");
+    FILE* fp = fopen("/proc/cpuinfo", "r");
+    if (fp == NULL) 
+    {
+        return model;
+    }
+
+    char line[512];
+    while (fgets(line, sizeof(line), fp) != NULL) 
+    {
+        if (strncmp(line, "model name", 10) == 0) 
+        {
+            char* value = strchr(line, ':');
+            if (value != NULL) 
+            {
+                value += (value[1] == ' ') ? 2 : 1;
+                value[strcspn(value, "\n")] = '\0';
+                // Tabs separate wisdom fields, so keep them out of the name
+                for (char* p = value; *p; p++) { if (*p == '\t') { *p = ' '; } }
+                snprintf(model, sizeof(model), "%s", value);
+            }
+            break;
+        }
+    }
+    fclose(fp);
+    return model;
+}
+
+const char* wisdom_path(void)
+{
+    static char path[512] = "";
+
+    if (path[0] == '\0') 
+    {
+        const char* env = getenv("MAXGFLOPS_WISDOM");
+        const char* home = getenv("HOME");
+
+        if (env != NULL && env[0] != '\0') 
+        {
+            snprintf(path, sizeof(path), "%s", env);
+        }
+        else if (home != NULL && home[0] != '\0') 
+        {
+            snprintf(path, sizeof(path), "%s/.maxgflops_wisdom", home);
+        }
+        else 
+        {
+            snprintf(path, sizeof(path), ".maxgflops_wisdom");
+        }
+    }
+    return path;
+}
+
+/**
+ * Splits a wisdom line into its cpu model, kernel and precision
+ * keys, and the text after them. Returns 0 if the line is malformed.
+ */
+static int split_wisdom_line(char* line, char** cpu, char** kernel, char** precision, char** rest)
+{
+    *cpu = line;
+    *kernel = strchr(*cpu, '\t');
+    if (*kernel == NULL) { return 0; }
+    *(*kernel)++ = '\0';
+    *precision = strchr(*kernel, '\t');
+    if (*precision == NULL) { return 0; }
+    *(*precision)++ = '\0';
+    *rest = strchr(*precision, '\t');
+    if (*rest == NULL) { return 0; }
+    *(*rest)++ = '\0';
+    return 1;
+}
+
+int wisdom_load(const char* path, const char* cpu_model, const char* kernel, const char* precision, blocking_t* blocking)
+{
+    FILE* fp = fopen(path, "r");
+    if (fp == NULL) 
+    {
+        return 0;
+    }
+
+    char line[WISDOM_LINE];
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), fp) != NULL) 
+    {
+        char *c, *k, *p, *rest;
+        blocking_t b;
+
+        if (!split_wisdom_line(line, &c, &k, &p, &rest)) 
+        {
+            continue;
+        }
+        if (strcmp(c, cpu_model) != 0 || strcmp(k, kernel) != 0 || strcmp(p, precision) != 0) 
+        {
+            continue;
+        }
+        // Older entries end with the GFLOPS right after m_r
+        double prefetch, gflops;
+        int fields = sscanf(rest, "%d\t%d\t%d\t%d\t%d\t%lf\t%lf", &b.m_c, &b.k_c, &b.n_c, &b.n_r, &b.m_r, &prefetch, &gflops);
+        b.prefetch = (fields == 7) ? (int)prefetch : PREFETCH_DEFAULT;
+        if (fields >= 5 && b.m_c > 0 && b.k_c > 0 && b.n_c > 0 && b.n_r > 0 && b.m_r > 0 && b.prefetch >= 0) 
+        {
+            *blocking = b;
+            found = 1;
+        }
+    }
+
+    fclose(fp);
+    return found;
+}
+
+int wisdom_save(const char* path, const char* cpu_model, const char* kernel, const char* precision, const blocking_t* blocking, double gflops)
+{
+    char tmp_path[600];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path);
+
+    FILE* out = fopen(tmp_path, "w");
+    if (out == NULL) 
+    {
+        return 1;
+    }
+
+    // Copy every other entry, then append the new one
+    FILE* in = fopen(path, "r");
+    if (in != NULL) 
+    {
+        char line[WISDOM_LINE];
+        char copy[WISDOM_LINE];
+
+        while (fgets(line, sizeof(line), in) != NULL) 
+        {
+            char *c, *k, *p, *rest;
+            strcpy(copy, line);
+            if (split_wisdom_line(copy, &c, &k, &p, &rest) 
+                && strcmp(c, cpu_model) == 0 && strcmp(k, kernel) == 0 && strcmp(p, precision) == 0) 
+            {
+                continue;
+            }
+            fputs(line, out);
+        }
+        fclose(in);
+    }
+
+    fprintf(out, "%s\t%s\t%s\t%d\t%d\t%d\t%d\t%d\t%d\t%.3f\n", cpu_model, kernel, precision,
+            blocking->m_c, blocking->k_c, blocking->n_c, blocking->n_r, blocking->m_r, blocking->prefetch, gflops);
+
+    if (fclose(out) != 0 || rename(tmp_path, path) != 0) 
+    {
+        remove(tmp_path);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,149 @@
+#ifndef TUNE_H
+#define TUNE_H
+#include <stdio.h>
+#include "matrix_ops.h"
+#include "perf_counters.h"
+
+#define NC_MAX 8192 // Largest n_c the analytical model proposes
+#define PREFETCH_DEFAULT 8 // Prefetch distance in k iterations before tuning
+
+/**
+ * Geometry of one cache level, as reported in sysfs.
+ */
+typedef struct
+{
+    int size; // Capacity in bytes, 0 when the level is absent
+    int ways; // Associativity
+    int line; // Line size in bytes
+    int sets; // Number of sets
+} cache_level_t;
+
+/**
+ * Data cache hierarchy of the CPU the program runs on.
+ */
+typedef struct
+{
+    cache_level_t l1; // L1 data cache
+    cache_level_t l2; // Unified L2 cache
+    cache_level_t l3; // Unified L3 cache
+} cache_info_t;
+
+/**
+ * Cache and register blocking for gebp.
+ */
+typedef struct
+{
+    int m_c; // Rows of A per packed block (L2)
+    int k_c; // Columns of A and rows of B per packed block (L1)
+    int n_c; // Columns of B per packed panel (L3)
+    int n_r; // Register tile width
+    int m_r; // Register tile height
+    int prefetch; // Microkernel prefetch distance in k iterations, 0 for none
+} blocking_t;
+
+/**
+ * Called by autotune_blocking after each candidate it times.
+ *
+ * @param blocking The candidate blocking
+ * @param seconds Best wall time of the candidate
+ * @param pack_seconds Part of seconds spent packing A and B
+ * @param counters Hardware counts of the best run, NULL unless MAXGFLOPS_COUNTERS=1
+ * @param gflops GFLOPS of the best run
+ * @param ctx The ctx pointer given to autotune_blocking
+ */
+typedef void (*tune_report_fn)(const blocking_t* blocking, double seconds, double pack_seconds, 
+                               const gebp_counters_t* counters, double gflops, void* ctx);
+
+/**
+ * This function reads the L1 data, L2 and L3 cache geometry of CPU 0 from
+ * /sys/devices/system/cpu/cpu0/cache. Levels that cannot be read keep
+ * defaults typical of a desktop core (32 KB/8 way L1, 256 KB/4 way L2,
+ * 8 MB/16 way L3, 64 byte lines).
+ *
+ * @param info Receives the cache geometry.
+ * @return 0 if sysfs was read, 1 if any default was used.
+ */
+int read_cache_info(cache_info_t* info);
+
+/**
+ * This function derives a starting blocking for a microkernel from the cache
+ * geometry with the analytical model of Low et al. ("Analytical Modeling Is
+ * Enough for High-Performance BLIS"): the k_c x n_r micro-panel of B and the
+ * streamed m_r x k_c micro-panels of A share the L1 ways, the m_c x k_c block
+ * of A takes the L2 ways not needed for B, and the k_c x n_c panel of B takes
+ * the L3 ways not needed for A. The prefetch distance is PREFETCH_DEFAULT.
+ *
+ * @param info Cache geometry from read_cache_info
+ * @param kernel Microkernel whose register tile is used
+ * @param element_size Bytes per matrix element
+ * @return The analytical blocking.
+ */
+blocking_t analytical_blocking(const cache_info_t* info, const microkernel_t* kernel, int element_size);
+
+/**
+ * This function refines the analytical blocking with a short search: first
+ * the prefetch distances 0, 2, 4, 8 and 16 are swept, then k_c, m_c and
+ * n_c are scaled up and down in turn and a change is kept while it makes an
+ * N x N x N gebp faster. At most max_trials
+ * candidates are timed. The product is run in the element type of the
+ * kernel, and GFLOPS count real flops (8 per complex multiply-add).
+ *
+ * @param kernel Microkernel to tune
+ * @param N Dimension of the test problem
+ * @param num_threads Threads for gebp
+ * @param max_trials Maximum number of candidates to time
+ * @param report If not NULL, called after each candidate
+ * @param ctx Passed to report
+ * @param best_gflops If not NULL, receives the GFLOPS of the returned blocking
+ * @return The fastest blocking found.
+ */
+blocking_t autotune_blocking(const microkernel_t* kernel, int N, int num_threads, int max_trials,
+                             tune_report_fn report, void* ctx, double* best_gflops);
+
+/**
+ * This function returns the CPU model name from /proc/cpuinfo, or "unknown".
+ *
+ * @return Pointer to a static string.
+ */
+const char* cpu_model_name(void);
+
+/**
+ * This function returns the wisdom file path: $MAXGFLOPS_WISDOM if set,
+ * else $HOME/.maxgflops_wisdom, else .maxgflops_wisdom.
+ *
+ * @return Pointer to a static string.
+ */
+const char* wisdom_path(void);
+
+/**
+ * This function looks up the blocking stored for a (CPU model, kernel,
+ * precision) triple in a wisdom file. Each line of the file holds one entry
+ * as tab separated fields: cpu model, kernel, precision, m_c, k_c, n_c,
+ * n_r, m_r, prefetch and the GFLOPS measured when it was tuned. Entries
+ * written before the prefetch field existed get PREFETCH_DEFAULT.
+ *
+ * @param path Wisdom file
+ * @param cpu_model CPU model name
+ * @param kernel Microkernel name
+ * @param precision Element type, e.g. "double"
+ * @param blocking Receives the stored blocking
+ * @return 1 if an entry was found, 0 otherwise.
+ */
+int wisdom_load(const char* path, const char* cpu_model, const char* kernel, const char* precision, blocking_t* blocking);
+
+/**
+ * This function stores the blocking for a (CPU model, kernel, precision)
+ * triple in a wisdom file, replacing any entry for the same triple and
+ * keeping the others.
+ *
+ * @param path Wisdom file
+ * @param cpu_model CPU model name
+ * @param kernel Microkernel name
+ * @param precision Element type, e.g. "double"
+ * @param blocking Blocking to store
+ * @param gflops GFLOPS measured with the blocking
+ * @return 0 on success, 1 if the file could not be written.
+ */
+int wisdom_save(const char* path, const char* cpu_model, const char* kernel, const char* precision, const blocking_t* blocking, double gflops);
+
+#endif